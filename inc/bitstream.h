@@ -40,6 +40,7 @@ typedef struct X265_BitStream {
     UInt32      dwCache;
     Int         nCachedBits;
     UInt8      *pucBits0;
+    UInt8       bRawRBSP;       ///< no emulation prevention here, xPutRBSP() insert it at the end of the NAL
 } X265_BitStream;
 
 
@@ -57,6 +58,13 @@ typedef struct X265_BitStream {
         *(dst)++ = _tmp; \
     } \
 }
+#define flushCacheRaw(dst, x, bits)    { \
+    int _i; \
+    for(_i=0; _i < (bits)>>3; _i++) { \
+        *(dst)++ = (x) >> 24; \
+        (x) <<= 8; \
+    } \
+}
 
 // ***************************************************************************
 static void xBitStreamInit(X265_BitStream *pBS, UInt8 *pucBuffer, Int nBufferSize)
@@ -67,6 +75,7 @@ static void xBitStreamInit(X265_BitStream *pBS, UInt8 *pucBuffer, Int nBufferSiz
     pBS->pucBits0       = pucBuffer;
     pBS->dwCache        = 0;
     pBS->nCachedBits    = 0;
+    pBS->bRawRBSP       = FALSE;
 }
 
 static void xPutBits32(X265_BitStream *pBS, UInt32 uiBits)
@@ -91,8 +100,14 @@ static void xPutBits(X265_BitStream *pBS, UInt32 uiBits, Int nNumBits)
         UInt32 dwCache = pBS->dwCache;
         dwCache |= xSHR(uiBits, -nShift);
 
-        flushCache(pBS->pucBits, dwCache, 32);
-        
+        if( pBS->bRawRBSP ) {
+            putBits32(pBS->pucBits, BSWAP32(dwCache));
+            pBS->pucBits += 4;
+        }
+        else {
+            flushCache(pBS->pucBits, dwCache, 32);
+        }
+
         pBS->dwCache = xSHL(uiBits, (32 + nShift));
         pBS->nCachedBits = -nShift;
     }
@@ -118,7 +133,12 @@ static void xWriteRBSPTrailingBits(X265_BitStream *pBS)
 
 static Int32 xBitFlush(X265_BitStream *pBS)
 {
-    flushCache(pBS->pucBits, pBS->dwCache, pBS->nCachedBits);
+    if( pBS->bRawRBSP ) {
+        flushCacheRaw(pBS->pucBits, pBS->dwCache, pBS->nCachedBits);
+    }
+    else {
+        flushCache(pBS->pucBits, pBS->dwCache, pBS->nCachedBits);
+    }
     pBS->nCachedBits &= 7;
     return (pBS->pucBits - pBS->pucBits0) + (pBS->nCachedBits + 7) / 8;
 }
@@ -161,6 +181,7 @@ static void xWriteFlag( X265_BitStream *pBS, UInt32 uiCode )
 // Cabac Table
 // ***************************************************************************
 #define MAX_NUM_CTX_MOD             256       ///< maximum number of supported contexts
+#define CABAC_FRAC_BITS              15       ///< fractional precision of the estimated bits
 
 #define NUM_SPLIT_FLAG_CTX            3       ///< number of context models for split flag
 #define NUM_SKIP_FLAG_CTX             3       ///< number of context models for skip flag
@@ -38,6 +38,14 @@
 #define MAX_CU_SIZE                         (32)
 #define MAX_PU_XY                           (MAX_CU_SIZE / MIN_CU_SIZE)
 #define MAX_PART_NUM                        (MAX_PU_XY * MAX_PU_XY)
+#define MAX_CU_ROWS                         (MAX_HEIGHT / 16)   // the smallest CTU is 16x16
+#define MAX_SLICES                          (64)
+#define MAX_TILE_COLS                       (20)
+#define MAX_TILE_ROWS                       (22)
+#define MAX_TILES                           (MAX_TILE_COLS * MAX_TILE_ROWS)
+#define MAX_FRAME_THREADS                   (16)
+#define MAX_POOL_THREADS                    (64)
+#define POOL_DEQUE_SIZE                     (256)   // tasks in every worker deque, must be power of 2
 
 #define NUM_INTRA_MODE                      (36)
 #define NUM_CHROMA_MODE                     ( 6)    // total number of chroma modes
@@ -52,6 +60,25 @@
 #define MAX_SAD                             ( 1 << 30 )
 
 #define ALWAYS_INLINE                       __inline
+
+// Platform for the CPU dispatched primitives
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define ARCH_X86                            (1)
+#else
+#define ARCH_X86                            (0)
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+#define ARCH_X86_64                         (1)
+#else
+#define ARCH_X86_64                         (0)
+#endif
+
+// Enable the instruction set per function, so one binary can run on every host
+#ifdef __GNUC__
+#define X265_TARGET(isa)                    __attribute__((target(isa)))
+#else
+#define X265_TARGET(isa)
+#endif
 ////////////////////////////
 // x265 end
 ////////////////////////////
@@ -135,4 +162,10 @@ typedef UInt32  UInt;
 #define FALSE   (0)
 #define TRUE    (1)
 
+#ifdef _MSC_VER
+#define ALIGNED(n)  __declspec(align(n))
+#else
+#define ALIGNED(n)  __attribute__((aligned(n)))
+#endif
+
 #endif /* __CONFIG_H__ */
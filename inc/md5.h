@@ -25,7 +25,7 @@
 #ifndef __MD5_H__
 #define __MD5_H__
 
-#include "x265.h"
+#include "config.h"
 
 typedef struct MD5Context {
     UInt32 buf[4];
@@ -0,0 +1,274 @@
+/*****************************************************************************
+ * thread.h: Thread, mutex and condition wrappers
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+#include "config.h"
+#include "utils.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+typedef HANDLE              X265_Thread;
+typedef CRITICAL_SECTION    X265_Mutex;
+typedef CONDITION_VARIABLE  X265_Cond;
+typedef INIT_ONCE           X265_Once;
+#define X265_ONCE_INIT      INIT_ONCE_STATIC_INIT
+#else
+typedef pthread_t           X265_Thread;
+typedef pthread_mutex_t     X265_Mutex;
+typedef pthread_cond_t      X265_Cond;
+typedef pthread_once_t      X265_Once;
+#define X265_ONCE_INIT      PTHREAD_ONCE_INIT
+#endif
+
+typedef void *(*xThreadEntry)( void *pArg );
+
+#ifdef _MSC_VER
+#define X265_TLS            __declspec(thread)
+#else
+#define X265_TLS            __thread
+#endif
+
+// ***************************************************************************
+// * Thread
+// ***************************************************************************
+#ifdef _WIN32
+typedef struct {
+    xThreadEntry    pfnEntry;
+    void           *pArg;
+} X265_ThreadStart;
+
+static DWORD WINAPI xThreadStart( LPVOID pParam )
+{
+    X265_ThreadStart start = *(X265_ThreadStart *)pParam;
+    free( pParam );
+    start.pfnEntry( start.pArg );
+    return 0;
+}
+#endif
+
+/// return 0 when the thread is running
+static int xThreadCreate( X265_Thread *pThread, xThreadEntry pfnEntry, void *pArg )
+{
+#ifdef _WIN32
+    X265_ThreadStart *pStart = (X265_ThreadStart *)malloc( sizeof(X265_ThreadStart) );
+    if( pStart == NULL )
+        return -1;
+    pStart->pfnEntry = pfnEntry;
+    pStart->pArg     = pArg;
+    *pThread = CreateThread( NULL, 0, xThreadStart, pStart, 0, NULL );
+    if( *pThread == NULL ) {
+        free( pStart );
+        return -1;
+    }
+    return 0;
+#else
+    return pthread_create( pThread, NULL, pfnEntry, pArg );
+#endif
+}
+
+static void xThreadJoin( X265_Thread thread )
+{
+#ifdef _WIN32
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+#else
+    pthread_join( thread, NULL );
+#endif
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK xThreadOnceStart( PINIT_ONCE pOnce, PVOID pParam, PVOID *ppContext )
+{
+    ((void (*)( void ))pParam)();
+    return TRUE;
+}
+#endif
+
+/// call pfnInit once per process, whoever call it first
+static void xThreadOnce( X265_Once *pOnce, void (*pfnInit)( void ) )
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce( pOnce, xThreadOnceStart, (PVOID)pfnInit, NULL );
+#else
+    pthread_once( pOnce, pfnInit );
+#endif
+}
+
+/// pin the calling thread to the processor nCpu, nothing on the systems without the affinity
+static void xThreadSetAffinity( UInt nCpu )
+{
+#ifdef _WIN32
+    SetThreadAffinityMask( GetCurrentThread(), (DWORD_PTR)1 << (nCpu % (8 * sizeof(DWORD_PTR))) );
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( nCpu % CPU_SETSIZE, &set );
+    pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+#else
+    (void)nCpu;
+#endif
+}
+
+/// number of the online processors, at least 1
+static UInt xThreadCpuCount( void )
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return MAX( 1, (UInt)info.dwNumberOfProcessors );
+#else
+    long nCount = sysconf( _SC_NPROCESSORS_ONLN );
+    return (nCount > 0 ? (UInt)nCount : 1);
+#endif
+}
+
+// ***************************************************************************
+// * Atomic
+// ***************************************************************************
+/// load with the acquire order, the writes before the matching store are visible after it
+static UInt32 xAtomicLoad( volatile UInt32 *puiVal )
+{
+#ifdef _MSC_VER
+    UInt32 uiVal = *puiVal;
+    _ReadWriteBarrier();
+    return uiVal;
+#else
+    return __atomic_load_n( puiVal, __ATOMIC_ACQUIRE );
+#endif
+}
+
+/// store with the release order
+static void xAtomicStore( volatile UInt32 *puiVal, UInt32 uiVal )
+{
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+    *puiVal = uiVal;
+#else
+    __atomic_store_n( puiVal, uiVal, __ATOMIC_RELEASE );
+#endif
+}
+
+/// add and return the new value, it is a full barrier
+static UInt32 xAtomicAdd( volatile UInt32 *puiVal, Int32 iDelta )
+{
+#ifdef _MSC_VER
+    return (UInt32)InterlockedExchangeAdd( (volatile LONG *)puiVal, iDelta ) + iDelta;
+#else
+    return __atomic_add_fetch( puiVal, iDelta, __ATOMIC_SEQ_CST );
+#endif
+}
+
+static void xAtomicFence( void )
+{
+#ifdef _MSC_VER
+    MemoryBarrier();
+#else
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+#endif
+}
+
+// ***************************************************************************
+// * Mutex and Condition
+// ***************************************************************************
+static void xMutexInit( X265_Mutex *pMutex )
+{
+#ifdef _WIN32
+    InitializeCriticalSection( pMutex );
+#else
+    pthread_mutex_init( pMutex, NULL );
+#endif
+}
+
+static void xMutexFree( X265_Mutex *pMutex )
+{
+#ifdef _WIN32
+    DeleteCriticalSection( pMutex );
+#else
+    pthread_mutex_destroy( pMutex );
+#endif
+}
+
+static void xMutexLock( X265_Mutex *pMutex )
+{
+#ifdef _WIN32
+    EnterCriticalSection( pMutex );
+#else
+    pthread_mutex_lock( pMutex );
+#endif
+}
+
+static void xMutexUnlock( X265_Mutex *pMutex )
+{
+#ifdef _WIN32
+    LeaveCriticalSection( pMutex );
+#else
+    pthread_mutex_unlock( pMutex );
+#endif
+}
+
+static void xCondInit( X265_Cond *pCond )
+{
+#ifdef _WIN32
+    InitializeConditionVariable( pCond );
+#else
+    pthread_cond_init( pCond, NULL );
+#endif
+}
+
+static void xCondFree( X265_Cond *pCond )
+{
+#ifndef _WIN32
+    pthread_cond_destroy( pCond );
+#endif
+}
+
+/// the mutex must be locked, it is locked again on return
+static void xCondWait( X265_Cond *pCond, X265_Mutex *pMutex )
+{
+#ifdef _WIN32
+    SleepConditionVariableCS( pCond, pMutex, INFINITE );
+#else
+    pthread_cond_wait( pCond, pMutex );
+#endif
+}
+
+static void xCondBroadcast( X265_Cond *pCond )
+{
+#ifdef _WIN32
+    WakeAllConditionVariable( pCond );
+#else
+    pthread_cond_broadcast( pCond );
+#endif
+}
+
+#endif /* __THREAD_H__ */
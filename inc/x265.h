@@ -34,6 +34,8 @@
 #include "config.h"
 #include "bitstream.h"
 #include "utils.h"
+#include "md5.h"
+#include "thread.h"
 
 /// supported slice type
 typedef enum {
@@ -86,6 +88,56 @@ typedef enum {
     VALID_TR    = 4,
 } eValidIdx;
 
+/// instruction set level used to pick the primitives
+typedef enum {
+    CPU_LEVEL_C     = 0,    ///< reference C code only
+    CPU_LEVEL_SSE2  = 1,
+    CPU_LEVEL_SSSE3 = 2,
+    CPU_LEVEL_SSE41 = 3,
+    CPU_LEVEL_SSE42 = 4,    ///< with PCLMULQDQ too
+    CPU_LEVEL_AVX2  = 5,
+    CPU_LEVEL_AUTO  = 255,  ///< use the best level detected on this host
+} eCpuLevel;
+
+/// how the picture is split into slices, see usSliceArg
+typedef enum {
+    SLICE_MODE_NONE = 0,    ///< one slice per picture
+    SLICE_MODE_CUS  = 1,    ///< usSliceArg CTUs per slice
+    SLICE_MODE_ROWS = 2,    ///< usSliceArg CTU rows per slice
+} eSliceMode;
+
+/// method of the picture digest SEI
+typedef enum {
+    HASH_NONE       = 0,    ///< no digest SEI
+    HASH_MD5        = 1,    ///< MD5 of the whole frame
+    HASH_CRC        = 2,    ///< 16 bits CRC of each plane
+    HASH_CHECKSUM   = 3,    ///< checksum of each plane
+} eHashMethod;
+
+/// nonzero map of the coeffs, made by xQuant(), so the entropy coder need not scan the block
+typedef struct X265_CoeffInfo {
+    UInt16  nNumSig;    ///< number of nonzero coeffs
+    UInt8   nLastX;     ///< last significant column
+    UInt8   nLastY;     ///< last significant row
+    UInt32  uiSigRow;   ///< bit y is set when row y have nonzero coeff
+    UInt32  uiSigCol;   ///< bit x is set when column x have nonzero coeff
+    UInt64  uiSigCG;    ///< bit (nCGPosY * nSize/4 + nCGPosX) is set when the 4x4 group have nonzero coeff
+    UInt32  auiRowSig[MAX_CU_SIZE + 2]; ///< bit x of [y] is set when coeff (x, y) is nonzero, 2 zero rows after the block
+} X265_CoeffInfo;
+
+/// one position of a coeff scan, made once by xEncInitCoeffTables()
+typedef struct X265_ScanPos {
+    UInt8   ucPosX;
+    UInt8   ucPosY;
+    UInt8   ucCtx[2];   ///< significant_coeff_flag context of [chroma, luma], with SIG_CTX_* flags
+} X265_ScanPos;
+
+/// one 4x4 group of a coeff scan
+typedef struct X265_ScanCG {
+    UInt8   ucBlkPos;   ///< bit index of the group in uiSigCG
+    UInt64  uiNeighbour;///< right and lower groups used by the significant_coeffgroup_flag context
+} X265_ScanCG;
+
 typedef struct X265_Cache {
     /// context
     UInt32  uiOffset;
@@ -100,6 +152,7 @@ typedef struct X265_Cache {
     UInt8   pucTopLeftY[MAX_PART_NUM    ];
     UInt8   pucTopLeftU[MAX_PART_NUM / 4];
     UInt8   pucTopLeftV[MAX_PART_NUM / 4];
+    UInt8   pucTopLeftModeY[MAX_PU_XY];         //< the top left may be in another slice even if the top and left are not
 
     /// current
     UInt8   pucPixY[MAX_CU_SIZE * MAX_CU_SIZE    ];
@@ -113,11 +166,13 @@ typedef struct X265_Cache {
 
     /// IntraPred buffer
     UInt8   pucPixRef[2][4*MAX_CU_SIZE+1];          //< 0:ReconPixel, 1:Filtered
+    UInt8   bPixRefFiltered;                        //< pucPixRef[1] is built, see xEncIntraGetRef()
     UInt8   pucPixRefC[2][4*MAX_CU_SIZE/2+1];       //< 0:ReconPixel, 1:Filtered
+    UInt8   pucPixRefLM[4*MAX_CU_SIZE/2+1];         //< downsampled luma neighbours of LM, same layout as pucPixRefC
     UInt8   pucPredY[MAX_CU_SIZE * MAX_CU_SIZE];
     UInt8   pucPredC[3][MAX_CU_SIZE * MAX_CU_SIZE/4];   // 0:U, 1:V, 2:LM
     UInt8   ucMostModeY[3];
-    UInt8   ucMostModeC[5];
+    UInt8   ucMostModeC[NUM_CHROMA_MODE];
     UInt8   bValid[5];
 
     /// Encode coeff buffer
@@ -125,6 +180,7 @@ typedef struct X265_Cache {
     Int16   psCoefY[MAX_CU_SIZE*MAX_CU_SIZE];
     Int16   psCoefU[MAX_CU_SIZE*MAX_CU_SIZE/4];
     Int16   psCoefV[MAX_CU_SIZE*MAX_CU_SIZE/4];
+    X265_CoeffInfo sCoefInfo[3];    // 0:Y, 1:U, 2:V
 
 
     /// Temp buffer
@@ -133,14 +189,16 @@ typedef struct X265_Cache {
 
 typedef struct {
     // Engine
-    UInt32  uiLow;
+    UInt64  ullLow;         ///< 9 bits of range precision under the pending bits
     UInt32  uiRange;
-    Int32   iBitsLeft;
-    UInt8   ucCache;
-    UInt32  uiNumBytes;
+    Int32   iQueue;         ///< pending bits in ullLow minus 32, a word is written when it reach 0
+    UInt32  uiCache;        ///< word wait for the carry before written
+    UInt32  uiNumWords;     ///< uiCache and the 0xFFFFFFFF words after it
+    UInt8   bCountOnly;     ///< estimate the bits only, update the context states but write nothing
+    UInt32  uiFracBits;     ///< estimated bits in 1/(1 << CABAC_FRAC_BITS) unit
 
     // Context Model
-    UInt8   contextModels[MAX_NUM_CTX_MOD];
+    ALIGNED(16) UInt8 contextModels[MAX_NUM_CTX_MOD];
 #define OFF_SPLIT_FLAG_CTX          ( 0 )
 #define OFF_SKIP_FLAG_CTX           ( OFF_SPLIT_FLAG_CTX        +   NUM_SPLIT_FLAG_CTX      )
 #define OFF_ALF_CTRL_FLAG_CTX       ( OFF_SKIP_FLAG_CTX         +   NUM_SKIP_FLAG_CTX       )
@@ -168,6 +226,84 @@ typedef struct {
 
 } X265_Cabac;
 
+/// the contexts xWriteCU touch in the I slice
+#define CTX_CU_BEGIN                ( OFF_PART_SIZE_CTX )
+#define CTX_CU_END                  ( OFF_ABS_FLAG_CTX          +   NUM_ABS_FLAG_CTX        )
+
+/// checkpoint of the Cabac for the trial encode, see xCabacSave()
+typedef struct {
+    ALIGNED(16) UInt8 contextModels[MAX_NUM_CTX_MOD];
+    UInt64  ullLow;
+    UInt32  uiRange;
+    Int32   iQueue;
+    UInt32  uiCache;
+    UInt32  uiNumWords;
+    UInt8   bCountOnly;
+    UInt32  uiFracBits;
+    UInt8  *pucBits;        ///< output position, so a real trial encode can be rolled back too
+    UInt    nCtxBegin;      ///< saved contexts, aligned to 16 bytes
+    UInt    nCtxEnd;
+} X265_CabacSnapshot;
+
+/// picture hash state, carried across the CTU rows of a frame
+typedef struct X265_Hash {
+    MD5Context  ctxMD5;
+    UInt32      uiPlane[3];     ///< CRC register or checksum of every plane
+} X265_Hash;
+
+/// task of the pool, pfnTask is NULL when it is taken back by xPoolRun()
+typedef void xPOOLTASK( void *pArg );
+typedef struct X265_PoolTask {
+    xPOOLTASK  *pfnTask;
+    void       *pArg;
+} X265_PoolTask;
+
+/// deque of a worker, the owner push and pop at the bottom, the others steal from the top
+typedef struct X265_PoolDeque {
+    X265_Mutex      mutex;
+    X265_PoolTask   aTasks[POOL_DEQUE_SIZE];
+    UInt32          uiTop;
+    UInt32          uiBottom;
+} X265_PoolDeque;
+
+struct X265_Pool;
+typedef struct X265_PoolWorker {
+    struct X265_Pool   *pPool;
+    UInt                nIndex;
+    X265_Thread         thread;
+} X265_PoolWorker;
+
+/// work stealing pool, can be shared by every encoder of the process
+typedef struct X265_Pool {
+    UInt            nThreads;
+    UInt            nStarted;       ///< workers really running, only xPoolFree() use it
+    UInt8           bAffinity;
+    X265_PoolWorker workers[MAX_POOL_THREADS];
+    X265_PoolDeque  deques[MAX_POOL_THREADS];
+    X265_Mutex      mutex;          ///< guard the fields below, the workers sleep on cond
+    X265_Cond       cond;
+    UInt32          nQueued;        ///< tasks in all of the deques
+    UInt32          nNextDeque;     ///< the threads outside of the pool submit round robin
+    UInt8           bExit;
+} X265_Pool;
+
+/// bounded ring of fixed size slots, one producer and one consumer without a lock
+/// the indexes only grow and the slot is the index modulo nSlots, the mutex is only for the sleeping
+typedef struct X265_Queue {
+    UInt8          *pucData;        ///< nSlots slots of uiSlotSize bytes
+    UInt32         *puiLength;      ///< bytes in every slot, 0 is the end of the stream
+    UInt32          uiSlotSize;
+    UInt32          nSlots;
+    volatile UInt32 uiHead;         ///< next slot to be read, written by the consumer only
+    volatile UInt32 uiTail;         ///< next slot to be written, written by the producer only
+    volatile UInt32 nWaiters;       ///< the other side only lock the mutex when somebody sleep
+    X265_Mutex      mutex;
+    X265_Cond       cond;
+} X265_Queue;
+
+/// access unit of the async encoder, pucAU is NULL at the end of the stream
+typedef void xENCOUTPUT( void *pArg, const UInt8 *pucAU, UInt32 uiLength );
+
 /// main handle
 typedef struct X265_t {
     // Local
@@ -175,13 +311,64 @@ typedef struct X265_t {
     X265_Cabac      cabac;
     X265_SliceType  eSliceType;
     X265_Frame      refn[MAX_REF_NUM+1];
+    const struct X265_Primitives *pPrim;    ///< the primitives of ucCpuLevel
     X265_Frame      *pFrameRec;
     X265_Frame      *pFrameCur;
     X265_Cache      cache;
+    X265_Hash       hash;
     Int32           iPoc;
     Int32           iQP;
     UInt32          uiCUX;
     UInt32          uiCUY;
+    UInt8          *pucRBSP;        ///< scratch of the raw RBSP, see xWriteNalBegin()
+    UInt32          uiRBSPSize;
+    UInt8          *pucNalOut;      ///< where the RBSP of the current NAL go in the output
+
+    UInt32          uiSliceBegin;           ///< address of the first CTU of the slice
+    UInt32          uiSliceEnd;             ///< address after the last CTU of the slice
+    UInt32          uiTileX0, uiTileX1;     ///< pixel columns of the tile, the whole picture without tiles
+    UInt32          uiTileY0, uiTileY1;     ///< pixel rows of the tile
+
+    // WPP, slices and tiles, every CTU row, slice or tile is encoded by a copy of the main handle, see xEncEncodeRow()
+    struct X265_t  *pMain;                  ///< the main handle, itself for the main
+    struct X265_t  *pRows[MAX_CU_ROWS];     ///< handle of every CTU row of the WPP, main only
+    struct X265_t  *pSlices[MAX_SLICES];    ///< handle of every slice, main only
+    UInt32          nSlices;
+    struct X265_t  *pTiles[MAX_TILES];      ///< handle of every tile in raster order, main only
+    UInt32          nTiles;
+    UInt8          *pucSubStream[2];        ///< substream of the row or tile, or RBSP of the slice, 0:raw, 1:with the emulation prevention
+    UInt32          uiSubStreamSize;        ///< size of every pucSubStream buffer
+    UInt32          uiSubStreamLen;         ///< bytes in pucSubStream[1]
+    UInt8           aucCtxWPP[MAX_NUM_CTX_MOD]; ///< contexts after the second CTU, the row below start from them
+    UInt32          uiRowDone;              ///< CTUs done in the row, guarded by mutexRow of the main
+    X265_Mutex      mutexRow;
+    X265_Cond       condRow;
+    UInt16          ausHashCUs[MAX_CU_ROWS];///< CTUs done in every row of the slices or tiles, main only, guarded by mutexHash
+    UInt32          nHashRow;               ///< next CTU row to be hashed, main only
+    UInt8           bHashBusy;              ///< a job is hashing the rows from nHashRow, main only
+    X265_Mutex      mutexHash;
+
+    // Frame parallel of the all-intra, every frame in flight have a full handle, see xEncEncodeFrames()
+    struct X265_t  *pFrameCtx[MAX_FRAME_THREADS];   ///< main only
+    X265_Frame     *pFrameJobs;             ///< frames of the current batch, main only
+    UInt32         *puiFrameJobLen;         ///< size of every frame of the batch, NULL:not needed, main only
+    UInt32          uiFrameCtxFree;         ///< bit mask of the contexts not in flight, main only
+    UInt32          nFrameOut;              ///< next frame to be written out, main only
+    UInt8          *pucFrameOut;            ///< output of the context, the output of the batch for the main
+    UInt32          uiFrameOutSize;
+    UInt32          uiFrameOutLen;          ///< bytes in the output of the batch, main only
+    X265_Mutex      mutexFrame;
+    X265_Cond       condFrame;
+    UInt8           bOwnPool;               ///< pPool is created by xEncInit()
+
+    // Async encoding, the pipeline thread encode the frames of xEncSubmit(), see xEncAsyncThread()
+    X265_Queue      queueIn;                ///< copy of the raw frames
+    X265_Queue      queueOut;               ///< access units for xEncReceive(), not used with pfnOutput
+    X265_Thread     threadAsync;
+    UInt8          *pucAsyncOut;            ///< output of a batch of the pipeline
+    UInt32          uiAsyncOutSize;
+    volatile UInt32 uiAsyncAbort;           ///< xEncFree() stop the pipeline waiting a slot
+    UInt8           bAsyncEnd;              ///< the end of the stream is received, the receive side only
 
     // Interface
     // Profile
@@ -201,6 +388,19 @@ typedef struct X265_t {
     UInt8   ucBitsForPOC;
     UInt8   ucMaxNumMergeCand;
     UInt8   ucTSIG;
+    UInt8   ucCpuLevel;         ///< see eCpuLevel, it is clipped to the level of the host
+    UInt8   ucThreads;          ///< threads of the own pool with the caller, 0:one per processor
+    UInt8   ucFrameThreads;     ///< frames in flight of xEncEncodeFrames(), 0 and 1:one by one
+    X265_Pool *pPool;           ///< the pool of the WPP, slices, tiles and frames, NULL:create an own one when they are used
+    UInt8   ucAsyncDepth;       ///< slots of every queue of xEncSubmit() and xEncReceive(), 0:no async
+    xENCOUTPUT *pfnOutput;      ///< called on the pipeline thread for every access unit, NULL:use xEncReceive()
+    void   *pOutputArg;
+    UInt8   ucSliceMode;        ///< see eSliceMode
+    UInt16  usSliceArg;
+    UInt8   ucTileCols;         ///< tile columns, 1:no tiles
+    UInt8   ucTileRows;
+    UInt8   aucTileColWidth[MAX_TILE_COLS];     ///< in CTUs when !bTileUniform, the last column take the rest
+    UInt8   aucTileRowHeight[MAX_TILE_ROWS];
 
     // Feature
     UInt8   bUseNewRefSetting;
@@ -210,6 +410,12 @@ typedef struct X265_t {
     UInt8   bLoopFilterDisable;
     UInt8   bSignHideFlag;
     UInt8   bEnableTMVPFlag;
+    UInt8   bUseSATD;           ///< intra mode decision cost, 0:SAD, 1:SATD
+    UInt8   bUseRawRBSP;        ///< write the RBSP raw, insert the emulation prevention per NAL
+    UInt8   ucHashSEI;          ///< picture digest SEI, see eHashMethod
+    UInt8   bUseWPP;            ///< entropy coding sync, every CTU row is a substream
+    UInt8   bTileUniform;       ///< spread the tile boundaries evenly, else see aucTileColWidth
+    UInt8   bThreadAffinity;    ///< pin the workers of the own pool to the processors
 } X265_t;
 
 
@@ -220,17 +426,28 @@ void xWriteSPS( X265_t *h );
 void xWritePPS( X265_t *h );
 void xWriteSliceHeader( X265_t *h );
 void xWriteSliceEnd( X265_t *h );
+void xWriteSubStreamEnd( X265_t *h );
 Int32 xPutRBSP(UInt8 *pucDst, UInt8 *pucSrc, UInt32 uiLength);
+void xWriteNalBegin( X265_t *h );
+void xWriteNalEnd( X265_t *h );
+UInt32 xWriteSEIPictureDigest( X265_t *h );
+Int32 xPatchSEIPictureDigest( X265_t *h, UInt8 *pucOutBuf, UInt32 uiOffset, Int32 iLength );
+void xCabacInitTables( void );
 void xCabacInit( X265_t *h );
 void xCabacReset( X265_Cabac *pCabac );
 void xCabacFlush( X265_Cabac *pCabac, X265_BitStream *pBS );
 UInt xCabacGetNumWrittenBits( X265_Cabac *pCabac, X265_BitStream *pBS );
+void xCabacResetCount( X265_Cabac *pCabac );
+void xCabacSave( X265_CabacSnapshot *pSnap, const X265_Cabac *pCabac, const X265_BitStream *pBS, UInt nCtxBegin, UInt nCtxEnd );
+void xCabacRestore( X265_Cabac *pCabac, X265_BitStream *pBS, const X265_CabacSnapshot *pSnap );
+UInt32 xCabacGetFracBits( X265_Cabac *pCabac );
 void xCabacEncodeBin( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValue, UInt nCtxState );
 void xCabacEncodeBinEP( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValue );
 void xCabacEncodeBinsEP( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValues, Int numBins );
 void xCabacEncodeTerminatingBit( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValue );
 void xWriteEpExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbol, UInt uiCount );
 void xWriteGoRiceExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbol, UInt &ruiGoRiceParam );
+UInt xGoRiceExGolombBins( UInt uiSymbol, UInt &ruiGoRiceParam, UInt auiBins[2], Int anBins[2] );
 
 
 // ***************************************************************************
@@ -245,17 +462,18 @@ int xCheckParams( X265_t *h );
 extern const UInt8 g_aucIntraFilterType[5][NUM_INTRA_MODE-1];
 extern const Int8 g_aucIntraPredAngle[NUM_INTRA_MODE-1];
 extern const Int16 g_aucInvAngle[NUM_INTRA_MODE-1];
-extern const Int8 g_aiT4[4*4];
-extern const Int8 g_aiT8[8*8];
-extern const Int8 g_aiT16[16*16];
-extern const Int8 g_aiT32[32*32];
+extern const Int16 g_aiT4[4*4];
+extern const Int16 g_aiT8[8*8];
+extern const Int16 g_aiT16[16*16];
+extern const Int16 g_aiT32[32*32];
+extern const Int16 g_as_DST_MAT_4[4*4];
 extern const Int16 g_quantScales[6];
 extern const UInt8 g_invQuantScales[6];
 extern const UInt8 g_aucChromaScale[52];
-extern const UInt8 g_aucNextStateMPS[128];
-extern const UInt8 g_aucNextStateLPS[128];
+extern const UInt8 g_aucNextState[128][2];
 extern const UInt8 g_aucLPSTable[64][4];
-extern const UInt8 g_aucRenormTable[32];
+extern const UInt8 g_aucRenormTable[64];
+extern const UInt32 g_auiEntropyBits[128];
 extern const UInt16 *g_ausScanIdx[4][5];
 extern const UInt16 g_sigLastScan8x8[4][4];
 extern const UInt16 g_sigLastScanCG32x32[64];
@@ -273,30 +491,238 @@ extern const UInt g_aauiGoRiceUpdate[5][24];
 // ***************************************************************************
 void xEncInit( X265_t *h );
 void xEncFree( X265_t *h );
+void xEncInitCoeffTables( void );
 Int32 xEncEncode( X265_t *h, X265_Frame *pFrame, UInt8 *pucOutBuf, UInt32 uiBufSize );
+Int32 xEncEncodeFrames( X265_t *h, X265_Frame *pFrames, UInt nFrames, UInt8 *pucOutBuf, UInt32 uiBufSize, UInt32 *puiFrameLen );
+Int32 xEncSubmit( X265_t *h, X265_Frame *pFrame, UInt bWait );
+Int32 xEncReceive( X265_t *h, UInt8 *pucOutBuf, UInt32 uiBufSize, UInt bWait );
+void xEncEncodeRow( X265_t *h, UInt y );
+void xEncEncodeWPP( X265_t *h );
+void xEncEncodeSlices( X265_t *h );
+void xEncEncodeTiles( X265_t *h );
+void xEncWaitRow( X265_t *h, UInt32 uiCount );
+void xEncPostRow( X265_t *h );
+void xEncHashRow( X265_t *h, UInt nRow, UInt nCUs );
+void xWriteCU( X265_t *h, X265_Cabac *pCabac, UInt nDepth, UInt bLastCU );
+UInt32 xEncEstimateCUBits( X265_t *h, UInt nDepth );
 void xEncCahceInit( X265_t *h );
 void xEncCahceInitLine( X265_t *h, UInt y );
 void xEncCacheLoadCU( X265_t *h, UInt uiX, UInt uiY );
+void xEncCacheLoadTop( X265_t *h, const X265_t *pAbove, UInt uiX );
 void xEncCacheStoreCU( X265_t *h, UInt uiX, UInt uiY );
 void xEncCacheUpdate( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nWidth, UInt nHeight );
 void xEncIntraLoadRef( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nSize );
+UInt8 *xEncIntraGetRef( X265_t *h, UInt nSize, UInt bFilter );
+void xReverseRef( UInt8 *pucDst, const UInt8 *pucSrc, UInt nSize );
+void xFilterRef( UInt8 *pucDst, UInt8 *pucSrc, UInt nSize );
 UInt xGetTopLeftIndex( UInt32 uiX, UInt32 uiY );
-void xEncIntraPredLuma( X265_t *h, UInt nMode, UInt nSize );
+void xEncIntraPredLuma( X265_t *h, UInt nMode, UInt nSize, UInt8 *pucDstY );
+UInt xEncIntraSearchLuma( X265_t *h, UInt nSize, UInt32 *puiBestSad );
 void xEncIntraPredChroma( X265_t *h, UInt nMode, UInt nSize );
+void xPredIntraPlanar( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, UInt nSize );
+void xPredIntraDc( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, UInt nSize, UInt bLuma );
+void xPredIntraAngProject( UInt8 *pucRef, UInt8 *pucRefMain, Int nSize, UInt nMode );
+void xPredIntraAngRef( UInt8 *pucRef, UInt8 *pucRefMain, Int nSize, UInt nMode );
+UInt32 xPredIntraAngSad( UInt8 *pucRefMain, UInt8 *pucDst, UInt8 *pucSrc, Int nStride, Int nSize, Int nIntraPredAngle, UInt32 uiMaxSad );
+void xPredIntraAng( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, Int nSize, UInt nMode, UInt bLuma );
+void xPredIntraLMRef( UInt8 *pucRefY, UInt8 *pucRefLM, Int nSize );
+void xDownSampleLM( UInt8 *pucDst, UInt nDstStride, UInt8 *pucSrc, UInt nSrcStride, UInt nSize );
+Int xPredIntraLMParam( Int32 L, Int32 C, Int32 LL, Int32 LC, UInt nSize, Int32 *pA, Int32 *pB );
+void xPredIntraLM( UInt8 *pucRefC, UInt8 *pucRefLM, UInt8 *pucPredLM, UInt8 *pucDst, UInt nSize );
 
 // ***************************************************************************
 // * Pixel.cpp
 // ***************************************************************************
 typedef UInt32 xSad( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
-extern xSad *xSadN[MAX_CU_DEPTH+1];
+typedef void xTRANSPOSE( UInt8 *pDst, UInt8 *pSrc, UInt nStride, UInt nSize );
 typedef void xDCT( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
-extern xDCT *xDctN[MAX_CU_DEPTH+1];
-extern xDCT *xInvDctN[MAX_CU_DEPTH+1];
+typedef void xIDCT( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+typedef void xSUBDCT( Int16 *pDst, UInt8 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode );
+typedef void xIDCTADD( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode, Int nLastX, Int nLastY );
+typedef UInt32 xQUANT( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType, X265_CoeffInfo *pInfo );
+typedef void xDEQUANT( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType );
+UInt32 xSad4xN ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad8xN ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad16xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad32xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad64xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd4xN ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd8xN ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd16xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd32xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd64xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+void xTranspose( UInt8 *pDst, UInt8 *pSrc, UInt nStride, UInt nSize );
+void xDST4 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT4 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT8 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT16( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT32( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xInvDST4 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT4 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT8 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT16( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT32( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
 void xSubDct ( Int16 *pDst, UInt8 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth,  Int iHeight, UInt nMode );
-void xIDctAdd( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode );
-UInt32 xQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType );
+void xIDctAdd( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode, Int nLastX, Int nLastY );
+UInt32 xQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType, X265_CoeffInfo *pInfo );
+void xCoeffInfoFromRows( X265_CoeffInfo *pInfo, const UInt32 *puiRowSig, UInt nSize );
 void xDeQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType );
 
+// ***************************************************************************
+// * Pixel_x86.cpp
+// ***************************************************************************
+#if ARCH_X86
+UInt32 xSad4xN_sse2 ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad8xN_sse2 ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad16xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad32xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad64xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad16xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad32xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSad64xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd4xN_sse2 ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd8xN_sse2 ( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd16xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd32xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd64xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd16xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd32xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+UInt32 xSatd64xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef );
+void xTranspose_sse2( UInt8 *pDst, UInt8 *pSrc, UInt nStride, UInt nSize );
+UInt32 xQuant_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType, X265_CoeffInfo *pInfo );
+void xDeQuant_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType );
+#endif
+
+// ***************************************************************************
+// * Dct_x86.cpp
+// ***************************************************************************
+#if ARCH_X86
+void xDST4_sse2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT4_sse2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT8_sse2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT16_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT32_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT8_avx2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT16_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xDCT32_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift );
+void xSubDct_sse2( Int16 *pDst, UInt8 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode );
+void xSubDct_avx2( Int16 *pDst, UInt8 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode );
+void xInvDST4_sse2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT4_sse2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT8_sse2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT16_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT32_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT8_avx2 ( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT16_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xInvDCT32_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs );
+void xIDctAdd_sse2( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode, Int nLastX, Int nLastY );
+void xIDctAdd_avx2( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode, Int nLastX, Int nLastY );
+#endif
+
+// ***************************************************************************
+// * Intra_x86.cpp
+// ***************************************************************************
+#if ARCH_X86
+void xPredIntraPlanar_sse2( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, UInt nSize );
+void xPredIntraDc_sse2( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, UInt nSize, UInt bLuma );
+void xPredIntraAng_ssse3( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, Int nSize, UInt nMode, UInt bLuma );
+void xPredIntraAng_avx2 ( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, Int nSize, UInt nMode, UInt bLuma );
+UInt32 xPredIntraAngSad_ssse3( UInt8 *pucRefMain, UInt8 *pucDst, UInt8 *pucSrc, Int nStride, Int nSize, Int nIntraPredAngle, UInt32 uiMaxSad );
+UInt32 xPredIntraAngSad_avx2 ( UInt8 *pucRefMain, UInt8 *pucDst, UInt8 *pucSrc, Int nStride, Int nSize, Int nIntraPredAngle, UInt32 uiMaxSad );
+void xReverseRef_sse2( UInt8 *pucDst, const UInt8 *pucSrc, UInt nSize );
+void xFilterRef_sse2( UInt8 *pucDst, UInt8 *pucSrc, UInt nSize );
+void xDownSampleLM_sse2( UInt8 *pucDst, UInt nDstStride, UInt8 *pucSrc, UInt nSrcStride, UInt nSize );
+void xPredIntraLM_sse2( UInt8 *pucRefC, UInt8 *pucRefLM, UInt8 *pucPredLM, UInt8 *pucDst, UInt nSize );
+#endif
+
+// ***************************************************************************
+// * Pool.cpp
+// ***************************************************************************
+typedef void xPOOLJOB( void *pArg, UInt nJob );
+X265_Pool *xPoolCreate( UInt nThreads, UInt bAffinity );
+void xPoolFree( X265_Pool *pPool );
+void xPoolRun( X265_Pool *pPool, xPOOLJOB *pfnJob, void *pArg, UInt nJobs, UInt nMaxThreads );
+
+// ***************************************************************************
+// * Queue.cpp
+// ***************************************************************************
+void xQueueInit( X265_Queue *pQueue, UInt32 nSlots, UInt32 uiSlotSize );
+void xQueueFree( X265_Queue *pQueue );
+UInt32 xQueueCount( X265_Queue *pQueue );
+UInt xQueueWait( X265_Queue *pQueue, UInt bSpace, volatile UInt32 *puiAbort );
+void xQueueWake( X265_Queue *pQueue );
+UInt8 *xQueueSlot( X265_Queue *pQueue, UInt32 uiIndex, UInt32 **ppuiLength );
+void xQueuePush( X265_Queue *pQueue );
+void xQueuePop( X265_Queue *pQueue, UInt32 nCount );
+
+// ***************************************************************************
+// * Hash.cpp
+// ***************************************************************************
+typedef UInt32 xCRC16( UInt32 uiCrc, const UInt8 *pucSrc, UInt32 uiLength );
+typedef UInt32 xCHECKSUM( UInt32 uiSum, const UInt8 *pucSrc, UInt nStride, UInt nWidth, UInt nY0, UInt nHeight );
+UInt32 xCrc16( UInt32 uiCrc, const UInt8 *pucSrc, UInt32 uiLength );
+UInt32 xChecksum( UInt32 uiSum, const UInt8 *pucSrc, UInt nStride, UInt nWidth, UInt nY0, UInt nHeight );
+UInt xPictureDigestSize( UInt nMethod );
+void xPictureHashInit( X265_t *h );
+void xPictureHashRow( X265_t *h, UInt nY0, UInt nHeight );
+void xPictureHashFinal( X265_t *h, UInt8 *pucDigest );
+
+// ***************************************************************************
+// * Hash_x86.cpp
+// ***************************************************************************
+#if ARCH_X86
+UInt32 xCrc16_sse42( UInt32 uiCrc, const UInt8 *pucSrc, UInt32 uiLength );
+UInt32 xChecksum_sse2( UInt32 uiSum, const UInt8 *pucSrc, UInt nStride, UInt nWidth, UInt nY0, UInt nHeight );
+#endif
+
+// ***************************************************************************
+// * Bitstream_x86.cpp
+// ***************************************************************************
+#if ARCH_X86
+Int32 xPutRBSP_sse2(UInt8 *pucDst, UInt8 *pucSrc, UInt32 uiLength);
+#endif
+
+// ***************************************************************************
+// * Primitives.cpp
+// ***************************************************************************
+typedef Int32 xPUTRBSP(UInt8 *pucDst, UInt8 *pucSrc, UInt32 uiLength);
+typedef void xREVERSEREF( UInt8 *pucDst, const UInt8 *pucSrc, UInt nSize );
+typedef void xFILTERREF( UInt8 *pucDst, UInt8 *pucSrc, UInt nSize );
+typedef void xPREDPLANAR( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, UInt nSize );
+typedef void xPREDDC( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, UInt nSize, UInt bLuma );
+typedef void xPREDANG( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, Int nSize, UInt nMode, UInt bLuma );
+typedef UInt32 xPREDANGSAD( UInt8 *pucRefMain, UInt8 *pucDst, UInt8 *pucSrc, Int nStride, Int nSize, Int nIntraPredAngle, UInt32 uiMaxSad );
+typedef void xDOWNSAMPLELM( UInt8 *pucDst, UInt nDstStride, UInt8 *pucSrc, UInt nSrcStride, UInt nSize );
+typedef void xPREDLM( UInt8 *pucRefC, UInt8 *pucRefLM, UInt8 *pucPredLM, UInt8 *pucDst, UInt nSize );
+
+/// table of the hot kernels, filled by xPrimitivesInit() for every CPU level
+typedef struct X265_Primitives {
+    xSad        *xSadN[MAX_CU_DEPTH+1];     ///< index by log2(width)-2
+    xSad        *xSatdN[MAX_CU_DEPTH+1];    ///< index by log2(width)-2, 4x4 Hadamard for width 4, 8x8 for the others
+    xTRANSPOSE  *xTranspose;                ///< square block of pixels
+    xDCT        *xDctN[MAX_CU_DEPTH+1];     ///< 0:DST4, 1:DCT4 ... 4:DCT32
+    xIDCT       *xInvDctN[MAX_CU_DEPTH+1];  ///< 0:InvDST4, 1:InvDCT4 ... 4:InvDCT32
+    xSUBDCT     *xSubDct;
+    xIDCTADD    *xIDctAdd;
+    xQUANT      *xQuant;
+    xDEQUANT    *xDeQuant;
+    xREVERSEREF *xReverseRef;               ///< left neighbours to the bottom-up order of the reference
+    xFILTERREF  *xFilterRef;                ///< [1 2 1] smoothing of the 4*nSize+1 reference
+    xPREDPLANAR *xPredIntraPlanar;
+    xPREDDC     *xPredIntraDc;
+    xPREDANG    *xPredIntraAng;
+    xPREDANGSAD *xPredIntraAngSad;  ///< fused predict and SAD of the mode search
+    xPUTRBSP    *xPutRBSP;                  ///< RBSP to NAL payload with the emulation prevention
+    xCRC16      *xCrc16;                    ///< CRC register of the digest SEI
+    xCHECKSUM   *xChecksum;
+    xDOWNSAMPLELM *xDownSampleLM;   ///< reconstructed luma to the PredLM input of xPredIntraLM
+    xPREDLM     *xPredIntraLM;
+} X265_Primitives;
+
+extern X265_Primitives g_aPrimitives[CPU_LEVEL_AVX2 + 1];
+UInt xCpuDetect( void );
+void xPrimitivesInit( X265_Primitives *p, UInt nCpuLevel );
+
 // ***************************************************************************
 // * TestVec.cpp
 // ***************************************************************************
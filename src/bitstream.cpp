@@ -155,7 +155,7 @@ void xWriteSPS( X265_t *h )
     WRITE_UVLC( h->ucQuadtreeTUMaxDepthInter - 1,                                     "max_transform_hierarchy_depth_inter" );
     WRITE_UVLC( h->ucQuadtreeTUMaxDepthIntra - 1,                                     "max_transform_hierarchy_depth_intra" );
     WRITE_FLAG( 0,                                                                    "scaling_list_enabled_flag" ); 
-    WRITE_FLAG( 0,                                                                    "chroma_pred_from_luma_enabled_flag" );
+    WRITE_FLAG( h->bUseLMChroma,                                                      "chroma_pred_from_luma_enabled_flag" );
     WRITE_FLAG( 0,                                                                    "deblocking_filter_in_aps_enabled_flag");
     WRITE_FLAG( 1,                                                                    "seq_loop_filter_across_slices_enabled_flag");
     WRITE_FLAG( 1,                                                                    "asymmetric_motion_partitions_enabled_flag" );
@@ -180,7 +180,24 @@ void xWriteSPS( X265_t *h )
         WRITE_FLAG( 1, "AMVPMode");
     }
     
-    WRITE_CODE( 0, 2,                                                                 "tiles_or_entropy_coding_sync_idc" );
+    WRITE_CODE( (h->bUseWPP ? 2 : (h->nTiles > 1 ? 1 : 0)), 2,                       "tiles_or_entropy_coding_sync_idc" );
+    if( h->nTiles > 1 ) {
+        WRITE_UVLC( h->ucTileCols - 1,                                                "num_tile_columns_minus1" );
+        WRITE_UVLC( h->ucTileRows - 1,                                                "num_tile_rows_minus1" );
+        WRITE_FLAG( h->bTileUniform,                                                  "uniform_spacing_flag" );
+        if( !h->bTileUniform ) {
+            for( i=0; i+1 < h->ucTileCols; i++ ) {
+                WRITE_UVLC( h->aucTileColWidth[i],                                    "column_width" );
+            }
+            for( i=0; i+1 < h->ucTileRows; i++ ) {
+                WRITE_UVLC( h->aucTileRowHeight[i],                                   "row_height" );
+            }
+        }
+        WRITE_FLAG( 1,                                                                "loop_filter_across_tile_flag" );
+    }
+    else if( h->bUseWPP ) {
+        WRITE_UVLC( h->usHeight / h->ucMaxCUWidth - 1,                                "num_substreams_minus1" );
+    }
 
     WRITE_FLAG( 0, "sps_extension_flag" );
 
@@ -222,6 +239,14 @@ void xWritePPS( X265_t *h )
     WRITE_CODE( 0, 2,                                       "weighted_bipred_idc" );  // Use of Weighting Bi-Prediction (B_SLICE)
 
     WRITE_FLAG( 0,                                          "output_flag_present_flag" );
+    // The tile grid of the SPS is used, and the PPS repeat the substreams of the WPP
+    if( h->nTiles > 1 ) {
+        WRITE_FLAG( 0,                                      "tile_info_present_flag" );
+        WRITE_FLAG( 0,                                      "tile_control_present_flag" );
+    }
+    else if( h->bUseWPP ) {
+        WRITE_UVLC( h->usHeight / h->ucMaxCUWidth - 1,      "num_substreams_minus1" );
+    }
     WRITE_FLAG( 1,                                          "deblocking_filter_control_present_flag");
     WRITE_UVLC( 0,                                          "log2_parallel_merge_level_minus2");
     WRITE_FLAG( 0, "pps_extension_flag" );
@@ -231,11 +256,16 @@ void xWritePPS( X265_t *h )
 void xWriteSliceHeader( X265_t *h )
 {
     X265_BitStream *pBS = &h->bs;
+    const UInt32 nCUs = (h->usWidth / h->ucMaxCUWidth) * (h->usHeight / h->ucMaxCUWidth);
+    UInt i;
 #if ENC_DEC_TRACE  
     xTraceSliceHeader();
 #endif
     //write slice address
-    WRITE_FLAG( 1,              "first_slice_in_pic_flag" );
+    WRITE_FLAG( (h->uiSliceBegin == 0), "first_slice_in_pic_flag" );
+    if( h->uiSliceBegin != 0 ) {
+        WRITE_CODE( h->uiSliceBegin, xLog2( nCUs - 1 ), "slice_address" );
+    }
 
     WRITE_UVLC( h->eSliceType,  "slice_type" );
     WRITE_FLAG( 0,              "lightweight_slice_flag" );
@@ -291,7 +321,31 @@ void xWriteSliceHeader( X265_t *h )
     WRITE_UVLC(MRG_MAX_NUM_CANDS - h->ucMaxNumMergeCand, "maxNumMergeCand");
 
     WRITE_FLAG( 0, "encodeTileMarkerFlag" );
+
+    // Every CTU row or tile is a substream, the offset is the size of the substream before it
+    if( h->bUseWPP || h->nTiles > 1 ) {
+        X265_t * const *pSubStreams = (h->bUseWPP ? h->pRows : h->pTiles);
+        const UInt nNumOffsets = (h->bUseWPP ? h->usHeight / h->ucMaxCUWidth : h->nTiles) - 1;
+        UInt32 uiMaxOffset = 0;
+        UInt nOffsetLen;
+
+        for( i=0; i<nNumOffsets; i++ ) {
+            uiMaxOffset = MAX( uiMaxOffset, pSubStreams[i]->uiSubStreamLen );
+        }
+        nOffsetLen = xLog2( uiMaxOffset );
+
+        WRITE_UVLC( nNumOffsets, "num_entry_point_offsets" );
+        if( nNumOffsets > 0 ) {
+            WRITE_UVLC( nOffsetLen - 1, "offset_len_minus1" );
+            for( i=0; i<nNumOffsets; i++ ) {
+                WRITE_CODE( pSubStreams[i]->uiSubStreamLen, nOffsetLen, "entry_point_offset" );
+            }
+        }
+    }
     xWriteAlignOne(pBS);
+
+    // The Cabac write the slice data by words, empty the cache here
+    xBitFlush(pBS);
 }
 
 void xWriteSliceEnd( X265_t *h )
@@ -303,38 +357,114 @@ void xWriteSliceEnd( X265_t *h )
     xWriteRBSPTrailingBits(pBS);
 }
 
-Int32 xPutRBSP(UInt8 *pucDst, UInt8 *pucSrc, UInt32 uiLength)
+/// end a substream of the WPP but the last one, the Cabac is flushed and the substream is byte aligned
+void xWriteSubStreamEnd( X265_t *h )
 {
-    assert( uiLength > 2 );
+    X265_BitStream *pBS = &h->bs;
+
+    xCabacEncodeTerminatingBit( &h->cabac, pBS, 1 );
+    xCabacFlush( &h->cabac, pBS );
+    WRITE_FLAG( 1, "stop bit" );
+    xWriteAlignZero(pBS);
+}
 
+/// copy the RBSP and insert the emulation prevention bytes, return the size of the output
+/// the byte before pucSrc must be non-zero (the NAL header), so the first two bytes never need it
+Int32 xPutRBSP(UInt8 *pucDst, UInt8 *pucSrc, UInt32 uiLength)
+{
     UInt8 *pucDst0 = pucDst;
     UInt i;
-    *pucDst++ = *pucSrc++;
-    *pucDst++ = *pucSrc++;
 
-    for( i=2; i < uiLength; i++ ) {
-        const Int nLeadZero = (pucSrc[-2] | pucSrc[-1]);
-        if ( (nLeadZero == 0) && (pucSrc[0] <= 3) ) {
+    for( i=0; i < uiLength; i++ ) {
+        if ( (i >= 2) && (pucDst[-2] | pucDst[-1]) == 0 && (pucSrc[i] <= 3) ) {
             *pucDst++ = 0x03;
         }
-        *pucDst++ = *pucSrc++;
+        *pucDst++ = pucSrc[i];
     }
     return(pucDst - pucDst0);
 }
 
+/// write the picture digest SEI with a placeholder, return the offset of the hash method in the output
+/// it is always written directly since xPatchSEIPictureDigest() fill it in place
+UInt32 xWriteSEIPictureDigest( X265_t *h )
+{
+    X265_BitStream *pBS = &h->bs;
+    const UInt nSize = xPictureDigestSize( h->ucHashSEI );
+    UInt32 uiOffset;
+    UInt i;
+
+    xPutBits32(pBS, 0x06010000);
+    xPutBits(pBS, 0x01,        8); // temporal_id and reserved_one_5bits
+    xPutBits(pBS, 0xFF01,     16); // PICTURE_DIGEST
+    xPutBits(pBS, 1 + nSize,   8); // Payload length
+    uiOffset = xBitFlush(pBS);
+    // Non-zero placeholder of the method and the digest, so it need no emulation prevention
+    for( i=0; i<1 + nSize; i++ ) {
+        xPutBits(pBS, 0xA0 + i, 8);
+    }
+    xWriteRBSPTrailingBits(pBS);
+    xBitFlush(pBS);
+    return uiOffset;
+}
+
+/// fill the digest of the reconstructed frame into the SEI, return the new size of the output
+/// when the digest need emulation prevention bytes, the NALs after the SEI are moved
+Int32 xPatchSEIPictureDigest( X265_t *h, UInt8 *pucOutBuf, UInt32 uiOffset, Int32 iLength )
+{
+    const UInt nSize = xPictureDigestSize( h->ucHashSEI );
+    const UInt32 uiOldSize = 1 + nSize + 1;
+    UInt8 aucRBSP[1 + 16 + 1];
+    UInt8 aucPayload[2 * sizeof(aucRBSP)];
+    UInt32 uiNewSize;
+
+    aucRBSP[0] = h->ucHashSEI - HASH_MD5;   // Method, 0:MD5, 1:CRC, 2:Checksum
+    xPictureHashFinal( h, &aucRBSP[1] );
+    aucRBSP[1 + nSize] = 0x80;              // rbsp_trailing_bits
+
+    uiNewSize = xPutRBSP( aucPayload, aucRBSP, uiOldSize );
+    if( uiNewSize != uiOldSize ) {
+        memmove( &pucOutBuf[uiOffset + uiNewSize], &pucOutBuf[uiOffset + uiOldSize], iLength - uiOffset - uiOldSize );
+    }
+    memcpy( &pucOutBuf[uiOffset], aucPayload, uiNewSize );
+    return iLength + uiNewSize - uiOldSize;
+}
+
+/// called after the NAL header, with bUseRawRBSP the RBSP is written raw to the scratch buffer
+void xWriteNalBegin( X265_t *h )
+{
+    X265_BitStream *pBS = &h->bs;
+
+    if( h->bUseRawRBSP ) {
+        xBitFlush(pBS);
+        assert( pBS->nCachedBits == 0 );
+        h->pucNalOut  = pBS->pucBits;
+        pBS->pucBits  = h->pucRBSP;
+        pBS->bRawRBSP = TRUE;
+    }
+}
+
+/// called after the RBSP trailing bits, insert the emulation prevention of the NAL in one pass
+void xWriteNalEnd( X265_t *h )
+{
+    X265_BitStream *pBS = &h->bs;
+
+    xBitFlush(pBS);
+    if( pBS->bRawRBSP ) {
+        assert( pBS->nCachedBits == 0 );
+        pBS->pucBits  = h->pucNalOut + h->pPrim->xPutRBSP( h->pucNalOut, h->pucRBSP, (UInt32)(pBS->pucBits - h->pucRBSP) );
+        pBS->bRawRBSP = FALSE;
+    }
+}
+
 #define CABAC_ENTER \
-    UInt32  uiLow = pCabac->uiLow; \
+    UInt64  ullLow = pCabac->ullLow; \
     UInt32  uiRange = pCabac->uiRange; \
-    Int32   iBitsLeft = pCabac->iBitsLeft; \
-    UInt8   ucCache = pCabac->ucCache; \
-    UInt32  uiNumBytes = pCabac->uiNumBytes;
+    Int32   iQueue = pCabac->iQueue;
 
 #define CABAC_LEAVE \
-    pCabac->uiLow = uiLow; \
+    pCabac->ullLow = ullLow; \
     pCabac->uiRange = uiRange; \
-    pCabac->iBitsLeft = iBitsLeft; \
-    pCabac->ucCache = ucCache; \
-    pCabac->uiNumBytes = uiNumBytes;
+    pCabac->iQueue = iQueue;
 
 
 // ***************************************************************************
@@ -541,13 +671,13 @@ void xCabacInitEntry( UInt n, const Int qp, UInt8 *pucState, const UInt8 *pInitV
     }
 }
 
-void xCabacInit( X265_t *h )
+/// initial context states of every slice type and QP, built once per process by xCabacInitTables()
+static ALIGNED(16) UInt8 s_aucInitState[3][52][MAX_NUM_CTX_MOD];
+static UInt8 s_bInitStateReady = FALSE;
+
+static void xCabacInitState( UInt8 *pucState, const UInt nSlice, const Int iQp )
 {
-          X265_Cabac   *pCabac  = &h->cabac;
-    const UInt          nSlice  = h->eSliceType;
-    const Int           iQp     = h->iQP;
-          UInt8        *pucState= pCabac->contextModels;
-          UInt          nOffset = 0;
+    UInt nOffset = 0;
 
 #define INIT_CABAC( n, m, v ) \
     xCabacInitEntry( (m)*(n), iQp, pucState, (v)[nSlice] ); \
@@ -608,173 +738,278 @@ void xCabacInit( X265_t *h )
     assert( nOffset < MAX_NUM_CTX_MOD );
 }
 
+void xCabacInitTables( void )
+{
+    UInt nSlice;
+    Int  iQp;
+
+    if( s_bInitStateReady )
+        return;
+
+    for( nSlice=0; nSlice<3; nSlice++ ) {
+        for( iQp=0; iQp<52; iQp++ ) {
+            xCabacInitState( s_aucInitState[nSlice][iQp], nSlice, iQp );
+        }
+    }
+    s_bInitStateReady = TRUE;
+}
+
+/// the slice start is one copy of the prebuilt states
+void xCabacInit( X265_t *h )
+{
+    X265_Cabac *pCabac = &h->cabac;
+
+    assert( s_bInitStateReady );
+    assert( (h->iQP >= 0) && (h->iQP <= 51) );
+    memcpy( pCabac->contextModels, s_aucInitState[h->eSliceType][h->iQP], sizeof(pCabac->contextModels) );
+}
+
 void xCabacReset( X265_Cabac *pCabac )
 {
-    pCabac->uiLow         = 0;
+    pCabac->ullLow        = 0;
     pCabac->uiRange       = 510;
-    pCabac->iBitsLeft     = 23;
-    pCabac->ucCache       = 0xFF;
-    pCabac->uiNumBytes    = 0;
+    pCabac->iQueue        = -32;
+    pCabac->uiCache       = 0;
+    pCabac->uiNumWords    = 0;
+    pCabac->bCountOnly    = FALSE;
+    pCabac->uiFracBits    = 0;
+}
+
+/// switch to count only, the bins after it update the context states and the estimated bits only
+void xCabacResetCount( X265_Cabac *pCabac )
+{
+    pCabac->bCountOnly    = TRUE;
+    pCabac->uiFracBits    = 0;
+}
+
+/// save the engine and the contexts [nCtxBegin, nCtxEnd), the range is widen to 16 bytes so the copy is aligned
+void xCabacSave( X265_CabacSnapshot *pSnap, const X265_Cabac *pCabac, const X265_BitStream *pBS, UInt nCtxBegin, UInt nCtxEnd )
+{
+    assert( nCtxBegin < nCtxEnd && nCtxEnd <= MAX_NUM_CTX_MOD );
+    nCtxBegin &= ~15;
+    nCtxEnd    = (nCtxEnd + 15) & ~15;
+
+    memcpy( &pSnap->contextModels[nCtxBegin], &pCabac->contextModels[nCtxBegin], nCtxEnd - nCtxBegin );
+    pSnap->ullLow       = pCabac->ullLow;
+    pSnap->uiRange      = pCabac->uiRange;
+    pSnap->iQueue       = pCabac->iQueue;
+    pSnap->uiCache      = pCabac->uiCache;
+    pSnap->uiNumWords   = pCabac->uiNumWords;
+    pSnap->bCountOnly   = pCabac->bCountOnly;
+    pSnap->uiFracBits   = pCabac->uiFracBits;
+    pSnap->pucBits      = pBS->pucBits;
+    pSnap->nCtxBegin    = nCtxBegin;
+    pSnap->nCtxEnd      = nCtxEnd;
+}
+
+/// roll the Cabac and the output back to xCabacSave(), the bytes written after it are overwrite later
+void xCabacRestore( X265_Cabac *pCabac, X265_BitStream *pBS, const X265_CabacSnapshot *pSnap )
+{
+    const UInt nCtxBegin = pSnap->nCtxBegin;
+    const UInt nCtxEnd   = pSnap->nCtxEnd;
+
+    assert( pBS->nCachedBits == 0 );
+    memcpy( &pCabac->contextModels[nCtxBegin], &pSnap->contextModels[nCtxBegin], nCtxEnd - nCtxBegin );
+    pCabac->ullLow      = pSnap->ullLow;
+    pCabac->uiRange     = pSnap->uiRange;
+    pCabac->iQueue      = pSnap->iQueue;
+    pCabac->uiCache     = pSnap->uiCache;
+    pCabac->uiNumWords  = pSnap->uiNumWords;
+    pCabac->bCountOnly  = pSnap->bCountOnly;
+    pCabac->uiFracBits  = pSnap->uiFracBits;
+    pBS->pucBits        = pSnap->pucBits;
+}
+
+/// estimated bits since xCabacResetCount() in 1/(1 << CABAC_FRAC_BITS) unit
+UInt32 xCabacGetFracBits( X265_Cabac *pCabac )
+{
+    return pCabac->uiFracBits;
+}
+
+/// the slice data start at byte boundary, so the words go to the output without xPutBits
+static void xCabacWriteWord( X265_BitStream *pBS, UInt32 uiWord )
+{
+    assert( pBS->nCachedBits == 0 );
+    if( pBS->bRawRBSP ) {
+        putBits32(pBS->pucBits, BSWAP32(uiWord));
+        pBS->pucBits += 4;
+    }
+    else {
+        flushCache(pBS->pucBits, uiWord, 32);
+    }
+}
+
+/// move the top 32 pending bits out of ullLow, the word is held until the carry into it is known
+static void xCabacPutWord( X265_Cabac *pCabac, X265_BitStream *pBS )
+{
+    const UInt   nShift  = 9 + pCabac->iQueue;
+    const UInt32 uiWord  = (UInt32)(pCabac->ullLow >> nShift);
+    const UInt32 uiCarry = (UInt32)(pCabac->ullLow >> (nShift + 32));
+
+    pCabac->ullLow &= ((UInt64)1 << nShift) - 1;
+    pCabac->iQueue -= 32;
+
+    if( uiWord == 0xFFFFFFFF && !uiCarry ) {
+        pCabac->uiNumWords++;
+    }
+    else {
+        if( pCabac->uiNumWords > 0 ) {
+            xCabacWriteWord( pBS, pCabac->uiCache + uiCarry );
+            while( pCabac->uiNumWords > 1 ) {
+                xCabacWriteWord( pBS, 0xFFFFFFFF + uiCarry );
+                pCabac->uiNumWords--;
+            }
+        }
+        else {
+            pCabac->uiNumWords = 1;
+        }
+        pCabac->uiCache = uiWord;
+    }
 }
 
 void xCabacFlush( X265_Cabac *pCabac, X265_BitStream *pBS )
 {
     CABAC_ENTER;
-    if ( uiLow >> (32 - iBitsLeft) ) {
-        //assert( uiNumBytes > 0 );
-        //assert( ucCache != 0xff );
-        WRITE_CODE( ucCache + 1, 8, "xCabacFlush0" );
-        while( uiNumBytes > 1 ) {
-            WRITE_CODE( 0x00, 8, "xCabacFlush1" );
-            uiNumBytes--;
+    const UInt nBits = iQueue + 32;
+
+    if( ullLow >> (9 + nBits) ) {
+        xCabacWriteWord( pBS, pCabac->uiCache + 1 );
+        while( pCabac->uiNumWords > 1 ) {
+            xCabacWriteWord( pBS, 0x00000000 );
+            pCabac->uiNumWords--;
         }
-        uiLow -= 1 << ( 32 - iBitsLeft );
+        ullLow -= (UInt64)1 << (9 + nBits);
     }
-    else  {
-        if ( uiNumBytes > 0 ) {
-            WRITE_CODE( ucCache, 8, "xCabacFlush2" );
+    else {
+        if( pCabac->uiNumWords > 0 ) {
+            xCabacWriteWord( pBS, pCabac->uiCache );
+        }
+        while( pCabac->uiNumWords > 1 ) {
+            xCabacWriteWord( pBS, 0xFFFFFFFF );
+            pCabac->uiNumWords--;
         }
-        while ( uiNumBytes > 1 ) {
-            WRITE_CODE( 0xFF, 8, "xCabacFlush3" );
-            uiNumBytes--;
-        }    
     }
-    WRITE_CODE( uiLow >> 8, 24 - iBitsLeft, "xCabacFlush4" );
+    pCabac->uiNumWords = 0;
+    WRITE_CODE( (UInt32)(ullLow >> 8), nBits + 1, "xCabacFlush" );
     CABAC_LEAVE;
 }
 
 UInt xCabacGetNumWrittenBits( X265_Cabac *pCabac, X265_BitStream *pBS )
 {
     Int32 iLen = xBitFlush(pBS);
-    return iLen + 8 * pCabac->uiNumBytes + 23 - pCabac->iBitsLeft;
+    return 8 * iLen + 32 * pCabac->uiNumWords + pCabac->iQueue + 32;
 }
 
 #define GetMPS( state )     ( (state) &  1 )
 #define GetState( state )   ( (state) >> 1 )
-#define UpdateLPS( state )  ( (state) = g_aucNextStateLPS[ (state) ] )
-#define UpdateMPS( state )  ( (state) = g_aucNextStateMPS[ (state) ] )
-
-static void testAndWriteOut( X265_Cabac *pCabac, X265_BitStream *pBS )
-{
-    CABAC_ENTER;
-    while( iBitsLeft < 12 ) {
-        UInt leadByte = uiLow >> (24 - iBitsLeft);
-        iBitsLeft += 8;
-        uiLow     &= 0xFFFFFFFF >> iBitsLeft;
-
-        if ( leadByte == 0xff ) {
-            uiNumBytes++;
-        }
-        else {
-            if ( uiNumBytes > 0 ) {
-                UInt carry = leadByte >> 8;
-                UInt byte = ucCache + carry;
-                ucCache = leadByte & 0xff;
-                WRITE_CODE( byte, 8, "testAndWriteOut0" );
-
-                byte = ( 0xff + carry ) & 0xff;
-                while ( uiNumBytes > 1 ) {
-                    WRITE_CODE( byte, 8, "testAndWriteOut0" );
-                    uiNumBytes--;
-                }
-            }
-            else {
-                uiNumBytes = 1;
-                ucCache = leadByte;
-            }
-        }
-    }
-    CABAC_LEAVE;
-}
 
 void xCabacEncodeBin( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValue, UInt nCtxState )
 {
     CABAC_ENTER;
     UInt8 ucState = pCabac->contextModels[nCtxState];
     UInt  uiLPS   = g_aucLPSTable[ GetState( ucState ) ][ ( uiRange >> 6 ) & 3 ];
-    uiRange    -= uiLPS;
-  
-    if( binValue != GetMPS(ucState) ) {
-        Int numBits = g_aucRenormTable[ uiLPS >> 3 ];
-        uiLow     = ( uiLow + uiRange ) << numBits;
-        uiRange   = uiLPS << numBits;
-        UpdateLPS( ucState );
-        
-        iBitsLeft -= numBits;
+    Int   numBits;
+
+    pCabac->contextModels[nCtxState] = g_aucNextState[ ucState ][ binValue ];
+    if( pCabac->bCountOnly ) {
+        pCabac->uiFracBits += g_auiEntropyBits[ ucState ^ binValue ];
+        return;
     }
-    else {
-        UpdateMPS( ucState );
-        if ( uiRange < 256 ) {
-            uiLow <<= 1;
-            uiRange <<= 1;
-            iBitsLeft--;
-        }
+
+    uiRange -= uiLPS;
+    if( binValue != GetMPS(ucState) ) {
+        ullLow  += uiRange;
+        uiRange  = uiLPS;
     }
-    
-    pCabac->contextModels[nCtxState] = ucState;
+
+    numBits  = g_aucRenormTable[ uiRange >> 3 ];
+    ullLow <<= numBits;
+    uiRange<<= numBits;
+    iQueue  += numBits;
     CABAC_LEAVE;
 
-    testAndWriteOut( pCabac, pBS );
+    if( iQueue >= 0 )
+        xCabacPutWord( pCabac, pBS );
 }
 
 void xCabacEncodeBinEP( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValue )
 {
+    if( pCabac->bCountOnly ) {
+        pCabac->uiFracBits += 1 << CABAC_FRAC_BITS;
+        return;
+    }
+
     CABAC_ENTER;
 
-    uiLow <<= 1;
+    ullLow <<= 1;
     if( binValue ) {
-        uiLow += uiRange;
+        ullLow += uiRange;
     }
-    iBitsLeft--;
+    iQueue++;
     CABAC_LEAVE;
 
-    testAndWriteOut( pCabac, pBS );
+    if( iQueue >= 0 )
+        xCabacPutWord( pCabac, pBS );
 }
 
 void xCabacEncodeBinsEP( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValues, Int numBins )
 {
-    assert( binValues < (1 << numBins) );
+    assert( numBins == 32 || binValues < (1U << numBins) );
 
-    while ( numBins > 8 ) {
-        numBins -= 8;
-        UInt pattern = binValues >> numBins; 
-        pCabac->uiLow <<= 8;
-        pCabac->uiLow += pCabac->uiRange * pattern;
-        binValues -= pattern << numBins;
-        pCabac->iBitsLeft -= 8;
+    if( pCabac->bCountOnly ) {
+        pCabac->uiFracBits += numBins << CABAC_FRAC_BITS;
+        return;
+    }
+
+    // 16 bins at a time keep the pending bits under 31+16, ullLow never overflow
+    while ( numBins > 16 ) {
+        numBins -= 16;
+        UInt pattern = binValues >> numBins;
+        pCabac->ullLow  = (pCabac->ullLow << 16) + pCabac->uiRange * pattern;
+        binValues      -= pattern << numBins;
+        pCabac->iQueue += 16;
 
-        testAndWriteOut( pCabac, pBS );
+        if( pCabac->iQueue >= 0 )
+            xCabacPutWord( pCabac, pBS );
     }
-    
-    pCabac->uiLow <<= numBins;
-    pCabac->uiLow  += pCabac->uiRange * binValues;
-    pCabac->iBitsLeft -= numBins;
 
-    testAndWriteOut( pCabac, pBS );
+    pCabac->ullLow  = (pCabac->ullLow << numBins) + pCabac->uiRange * binValues;
+    pCabac->iQueue += numBins;
+
+    if( pCabac->iQueue >= 0 )
+        xCabacPutWord( pCabac, pBS );
 }
 
 void xCabacEncodeTerminatingBit( X265_Cabac *pCabac, X265_BitStream *pBS, UInt binValue )
 {
+    // the range lose 2 only, so the 0 cost nearly nothing and the 1 renormalize 7 bits
+    if( pCabac->bCountOnly ) {
+        pCabac->uiFracBits += (binValue ? 7 << CABAC_FRAC_BITS : 0);
+        return;
+    }
+
     CABAC_ENTER;
 
     uiRange -= 2;
     if( binValue ) {
-        uiLow  += uiRange;
-        uiLow <<= 7;
+        ullLow += uiRange;
+        ullLow <<= 7;
         uiRange = 2 << 7;
-        iBitsLeft -= 7;
+        iQueue += 7;
     }
     else if ( uiRange < 256 ) {
-        uiLow   <<= 1;
+        ullLow  <<= 1;
         uiRange <<= 1;
-        iBitsLeft--;    
+        iQueue++;
     }
 
     CABAC_LEAVE;
-    testAndWriteOut( pCabac, pBS );
+    if( iQueue >= 0 )
+        xCabacPutWord( pCabac, pBS );
 }
 
-void xWriteEpExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbol, UInt uiCount )
+/// bins of the Exp-Golomb code of uiSymbol, at most 32
+static void xEpExGolombBins( UInt uiSymbol, UInt uiCount, UInt *puiBins, Int *pnBins )
 {
     UInt bins = 0;
     Int numBins = 0;
@@ -792,10 +1027,22 @@ void xWriteEpExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbol, U
     numBins += uiCount;
   
     assert( numBins <= 32 );
+    *puiBins = bins;
+    *pnBins  = numBins;
+}
+
+void xWriteEpExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbol, UInt uiCount )
+{
+    UInt bins;
+    Int numBins;
+
+    xEpExGolombBins( uiSymbol, uiCount, &bins, &numBins );
     xCabacEncodeBinsEP( pCabac, pBS, bins, numBins );
 }
 
-void xWriteGoRiceExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbol, UInt &ruiGoRiceParam )
+/// bins of the Golomb-Rice code of uiSymbol in auiBins[0] and of its Exp-Golomb escape in auiBins[1],
+/// return the number of the groups of bins
+UInt xGoRiceExGolombBins( UInt uiSymbol, UInt &ruiGoRiceParam, UInt auiBins[2], Int anBins[2] )
 {
     UInt uiMaxVlc     = g_auiGoRiceRange[ ruiGoRiceParam ];
     UInt bExGolomb    = ( uiSymbol > uiMaxVlc );
@@ -815,7 +1062,8 @@ void xWriteGoRiceExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbo
         binValues = ( 1 << numBins ) - 2;
     }
     
-    xCabacEncodeBinsEP( pCabac, pBS, ( binValues << ruiGoRiceParam ) + uiCodeWord - ( uiQuotient << ruiGoRiceParam ), numBins + ruiGoRiceParam );
+    auiBins[0] = ( binValues << ruiGoRiceParam ) + uiCodeWord - ( uiQuotient << ruiGoRiceParam );
+    anBins[0]  = numBins + ruiGoRiceParam;
     
 #if !SIMPLE_PARAM_UPDATE  
     ruiGoRiceParam = g_aauiGoRiceUpdate[ruiGoRiceParam][MIN(uiSymbol, 23)];
@@ -823,6 +1071,20 @@ void xWriteGoRiceExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbo
     
     if( bExGolomb ) {
         uiSymbol -= uiMaxVlc + 1;
-        xWriteEpExGolomb( pCabac, pBS, uiSymbol, 0 );
+        xEpExGolombBins( uiSymbol, 0, &auiBins[1], &anBins[1] );
+        return 2;
+    }
+    return 1;
+}
+
+void xWriteGoRiceExGolomb( X265_Cabac *pCabac, X265_BitStream *pBS, UInt uiSymbol, UInt &ruiGoRiceParam )
+{
+    UInt auiBins[2];
+    Int  anBins[2];
+    UInt i, n;
+
+    n = xGoRiceExGolombBins( uiSymbol, ruiGoRiceParam, auiBins, anBins );
+    for( i=0; i<n; i++ ) {
+        xCabacEncodeBinsEP( pCabac, pBS, auiBins[i], anBins[i] );
     }
 }
@@ -0,0 +1,97 @@
+/*****************************************************************************
+ * bitstream_x86.cpp: Bitstream functions for x86 SIMD
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#include "x265.h"
+
+#if ARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// ***************************************************************************
+// * Internal Functions
+// ***************************************************************************
+/// index of the lowest set bit, uiMask must not be zero
+static ALWAYS_INLINE UInt xCtz( UInt32 uiMask )
+{
+#ifdef _MSC_VER
+    unsigned long nIdx;
+    _BitScanForward( &nIdx, uiMask );
+    return nIdx;
+#else
+    return __builtin_ctz( uiMask );
+#endif
+}
+
+// ***************************************************************************
+// * Emulation Prevention
+// ***************************************************************************
+// A 0x03 go before pucSrc[i] when pucSrc[i] <= 3 and the two bytes before it are zero,
+// every 16 positions are checked at once and the runs between the hits are copied
+// with memcpy. The inserted byte break the zero pair, so the scan restart at i + 2.
+X265_TARGET("sse2")
+Int32 xPutRBSP_sse2(UInt8 *pucDst, UInt8 *pucSrc, UInt32 uiLength)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c3   = _mm_set1_epi8( 3 );
+    UInt8 *pucDst0  = pucDst;
+    UInt32 uiCopied = 0;    // pucSrc[0] to pucSrc[uiCopied-1] are in the output
+    UInt32 i        = 2;    // the first position to check
+
+    while( i + 16 <= uiLength ) {
+        const __m128i X  = _mm_loadu_si128( (const __m128i *)&pucSrc[i    ] );
+        const __m128i Z1 = _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[i - 1] ), zero );
+        const __m128i Z2 = _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[i - 2] ), zero );
+        const __m128i S  = _mm_cmpeq_epi8( _mm_min_epu8( X, c3 ), X );
+        const UInt32 uiMask = _mm_movemask_epi8( _mm_and_si128( _mm_and_si128( Z1, Z2 ), S ) );
+
+        if( uiMask == 0 ) {
+            i += 16;
+            continue;
+        }
+        const UInt32 j = i + xCtz( uiMask );
+        memcpy( pucDst, &pucSrc[uiCopied], j - uiCopied );
+        pucDst   += j - uiCopied;
+        *pucDst++ = 0x03;
+        uiCopied  = j;
+        i         = j + 2;
+    }
+    for( ; i < uiLength; i++ ) {
+        if( (pucSrc[i - 2] | pucSrc[i - 1]) == 0 && pucSrc[i] <= 3 ) {
+            memcpy( pucDst, &pucSrc[uiCopied], i - uiCopied );
+            pucDst   += i - uiCopied;
+            *pucDst++ = 0x03;
+            uiCopied  = i;
+            i++;
+        }
+    }
+    if( uiLength > uiCopied ) {
+        memcpy( pucDst, &pucSrc[uiCopied], uiLength - uiCopied );
+        pucDst += uiLength - uiCopied;
+    }
+    return (Int32)(pucDst - pucDst0);
+}
+
+#endif /* ARCH_X86 */
@@ -0,0 +1,619 @@
+/*****************************************************************************
+ * dct_x86.cpp: Transform functions for x86 SIMD
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#include "x265.h"
+
+#if ARCH_X86
+#include <immintrin.h>
+
+// ***************************************************************************
+// * Forward Transform
+// ***************************************************************************
+// Every line is a full matrix multiply in 32-bits:
+//   pDst[k*nDstStride+i] = (Sum_j T[k][j] * pSrc[i*nSrcStride+j] + rnd) >> nShift
+// The 4x4 transposes (dword unit) put 4 lines in the lanes of one register,
+// each lane hold the pair (pSrc[i][2p], pSrc[i][2p+1]), so one pmaddwd with
+// the broadcast pair (T[k][2p], T[k][2p+1]) give 4 lines of output k, and the
+// result is written in transposed order directly.
+// The butterfly is not need, the sum equal to the C partial butterfly exactly.
+// When pPix is not NULL, the input is the residual pPix - pPred, made in register.
+
+// Load 8 (or 4 when N is 4) inputs of a line
+X265_TARGET("sse2")
+static __m128i xLoadRow_sse2( const Int16 *pSrc, const UInt8 *pPix, const UInt8 *pPred, const UInt nOffset, const Int N )
+{
+    if( pPix ) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i pix, pred;
+        if( N == 4 ) {
+            pix  = _mm_cvtsi32_si128( *(const Int32 *)&pPix [nOffset] );
+            pred = _mm_cvtsi32_si128( *(const Int32 *)&pPred[nOffset] );
+        }
+        else {
+            pix  = _mm_loadl_epi64( (const __m128i *)&pPix [nOffset] );
+            pred = _mm_loadl_epi64( (const __m128i *)&pPred[nOffset] );
+        }
+        return _mm_sub_epi16( _mm_unpacklo_epi8( pix, zero ), _mm_unpacklo_epi8( pred, zero ) );
+    }
+    if( N == 4 )
+        return _mm_loadl_epi64( (const __m128i *)&pSrc[nOffset] );
+    return _mm_loadu_si128( (const __m128i *)&pSrc[nOffset] );
+}
+
+// Load 4 lines of N inputs as N/2 registers of pairs
+X265_TARGET("sse2")
+static void xLoadPairs4_sse2( __m128i *V, const Int16 *pSrc, const UInt8 *pPix, const UInt8 *pPred, const UInt nOffset, const UInt nStride, const Int N )
+{
+    Int p;
+
+    for( p=0; p<N/2; p+=4 ) {
+        __m128i r0 = xLoadRow_sse2( pSrc, pPix, pPred, nOffset + 0*nStride + 2*p, N );
+        __m128i r1 = xLoadRow_sse2( pSrc, pPix, pPred, nOffset + 1*nStride + 2*p, N );
+        __m128i r2 = xLoadRow_sse2( pSrc, pPix, pPred, nOffset + 2*nStride + 2*p, N );
+        __m128i r3 = xLoadRow_sse2( pSrc, pPix, pPred, nOffset + 3*nStride + 2*p, N );
+        __m128i t0 = _mm_unpacklo_epi32( r0, r1 );
+        __m128i t1 = _mm_unpacklo_epi32( r2, r3 );
+        __m128i t2 = _mm_unpackhi_epi32( r0, r1 );
+        __m128i t3 = _mm_unpackhi_epi32( r2, r3 );
+        V[p+0] = _mm_unpacklo_epi64( t0, t1 );
+        V[p+1] = _mm_unpackhi_epi64( t0, t1 );
+        if( N > 4 ) {
+            V[p+2] = _mm_unpacklo_epi64( t2, t3 );
+            V[p+3] = _mm_unpackhi_epi64( t2, t3 );
+        }
+    }
+}
+
+X265_TARGET("sse2")
+static void xDctNxN_sse2( Int16 *pDst, const UInt nDstStride, const Int16 *pSrc, const UInt8 *pPix, const UInt8 *pPred, const UInt nSrcStride,
+                          Int nLines, Int nShift, const Int16 *pT, const Int N )
+{
+    const __m128i rnd   = _mm_set1_epi32( 1 << (nShift-1) );
+    const __m128i shift = _mm_cvtsi32_si128( nShift );
+    __m128i V0[16], V1[16];
+    Int i, k, p;
+
+    for( i=0; i<nLines; i+=8 ) {
+        const Int bFull = (nLines - i >= 8);
+
+        xLoadPairs4_sse2( V0, pSrc, pPix, pPred, (i+0)*nSrcStride, nSrcStride, N );
+        if( bFull )
+            xLoadPairs4_sse2( V1, pSrc, pPix, pPred, (i+4)*nSrcStride, nSrcStride, N );
+
+        for( k=0; k<N; k++ ) {
+            __m128i sum0 = rnd;
+            __m128i sum1 = rnd;
+            for( p=0; p<N/2; p++ ) {
+                const __m128i c = _mm_set1_epi32( *(const Int32 *)&pT[k*N + 2*p] );
+                sum0 = _mm_add_epi32( sum0, _mm_madd_epi16( V0[p], c ) );
+                if( bFull )
+                    sum1 = _mm_add_epi32( sum1, _mm_madd_epi16( V1[p], c ) );
+            }
+            sum0 = _mm_sra_epi32( sum0, shift );
+            if( bFull ) {
+                sum1 = _mm_sra_epi32( sum1, shift );
+                _mm_storeu_si128( (__m128i *)&pDst[k*nDstStride + i], _mm_packs_epi32( sum0, sum1 ) );
+            }
+            else {
+                _mm_storel_epi64( (__m128i *)&pDst[k*nDstStride + i], _mm_packs_epi32( sum0, sum0 ) );
+            }
+        }
+    }
+}
+
+X265_TARGET("sse2")
+void xDST4_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_sse2( pDst, nStride, pSrc, NULL, NULL, nStride, 4, nShift, g_as_DST_MAT_4, 4 );
+}
+
+X265_TARGET("sse2")
+void xDCT4_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_sse2( pDst, nStride, pSrc, NULL, NULL, nStride, nLines, nShift, g_aiT4, 4 );
+}
+
+X265_TARGET("sse2")
+void xDCT8_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_sse2( pDst, nStride, pSrc, NULL, NULL, nStride, nLines, nShift, g_aiT8, 8 );
+}
+
+X265_TARGET("sse2")
+void xDCT16_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_sse2( pDst, nStride, pSrc, NULL, NULL, nStride, nLines, nShift, g_aiT16, 16 );
+}
+
+X265_TARGET("sse2")
+void xDCT32_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_sse2( pDst, nStride, pSrc, NULL, NULL, nStride, nLines, nShift, g_aiT32, 32 );
+}
+
+// AVX2, 8 lines per register, low lane is line 0-3 and high lane is line 4-7
+X265_TARGET("avx2")
+static __m256i xLoadRow_avx2( const Int16 *pSrc, const UInt8 *pPix, const UInt8 *pPred, const UInt nOffset0, const UInt nOffset1 )
+{
+    if( pPix ) {
+        __m256i pix  = _mm256_cvtepu8_epi16( _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i *)&pPix [nOffset0] ),
+                                                                 _mm_loadl_epi64( (const __m128i *)&pPix [nOffset1] ) ) );
+        __m256i pred = _mm256_cvtepu8_epi16( _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i *)&pPred[nOffset0] ),
+                                                                 _mm_loadl_epi64( (const __m128i *)&pPred[nOffset1] ) ) );
+        return _mm256_sub_epi16( pix, pred );
+    }
+    return _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)&pSrc[nOffset0] ) ),
+                                    _mm_loadu_si128( (const __m128i *)&pSrc[nOffset1] ), 1 );
+}
+
+X265_TARGET("avx2")
+static void xLoadPairs8_avx2( __m256i *V, const Int16 *pSrc, const UInt8 *pPix, const UInt8 *pPred, const UInt nOffset, const UInt nStride, const Int N )
+{
+    Int p;
+
+    for( p=0; p<N/2; p+=4 ) {
+        __m256i r0 = xLoadRow_avx2( pSrc, pPix, pPred, nOffset + 0*nStride + 2*p, nOffset + 4*nStride + 2*p );
+        __m256i r1 = xLoadRow_avx2( pSrc, pPix, pPred, nOffset + 1*nStride + 2*p, nOffset + 5*nStride + 2*p );
+        __m256i r2 = xLoadRow_avx2( pSrc, pPix, pPred, nOffset + 2*nStride + 2*p, nOffset + 6*nStride + 2*p );
+        __m256i r3 = xLoadRow_avx2( pSrc, pPix, pPred, nOffset + 3*nStride + 2*p, nOffset + 7*nStride + 2*p );
+        __m256i t0 = _mm256_unpacklo_epi32( r0, r1 );
+        __m256i t1 = _mm256_unpacklo_epi32( r2, r3 );
+        __m256i t2 = _mm256_unpackhi_epi32( r0, r1 );
+        __m256i t3 = _mm256_unpackhi_epi32( r2, r3 );
+        V[p+0] = _mm256_unpacklo_epi64( t0, t1 );
+        V[p+1] = _mm256_unpackhi_epi64( t0, t1 );
+        V[p+2] = _mm256_unpacklo_epi64( t2, t3 );
+        V[p+3] = _mm256_unpackhi_epi64( t2, t3 );
+    }
+}
+
+X265_TARGET("avx2")
+static __m256i xDctRow_avx2( const __m256i *V, const Int16 *pT, const Int N, const __m256i rnd, const __m128i shift )
+{
+    __m256i sum = rnd;
+    Int p;
+
+    for( p=0; p<N/2; p++ ) {
+        const __m256i c = _mm256_set1_epi32( *(const Int32 *)&pT[2*p] );
+        sum = _mm256_add_epi32( sum, _mm256_madd_epi16( V[p], c ) );
+    }
+    return _mm256_sra_epi32( sum, shift );
+}
+
+// nLines must be multiple of 8
+X265_TARGET("avx2")
+static void xDctNxN_avx2( Int16 *pDst, const UInt nDstStride, const Int16 *pSrc, const UInt8 *pPix, const UInt8 *pPred, const UInt nSrcStride,
+                          Int nLines, Int nShift, const Int16 *pT, const Int N )
+{
+    const __m256i rnd   = _mm256_set1_epi32( 1 << (nShift-1) );
+    const __m128i shift = _mm_cvtsi32_si128( nShift );
+    __m256i V[16];
+    Int i, k;
+
+    for( i=0; i<nLines; i+=8 ) {
+        xLoadPairs8_avx2( V, pSrc, pPix, pPred, i*nSrcStride, nSrcStride, N );
+
+        // Two output rows per store, packs interleave the lanes, so fix the order by permute
+        for( k=0; k<N; k+=2 ) {
+            __m256i sum0 = xDctRow_avx2( V, &pT[(k+0)*N], N, rnd, shift );
+            __m256i sum1 = xDctRow_avx2( V, &pT[(k+1)*N], N, rnd, shift );
+            __m256i out  = _mm256_permute4x64_epi64( _mm256_packs_epi32( sum0, sum1 ), 0xD8 );
+            _mm_storeu_si128( (__m128i *)&pDst[(k+0)*nDstStride + i], _mm256_castsi256_si128( out ) );
+            _mm_storeu_si128( (__m128i *)&pDst[(k+1)*nDstStride + i], _mm256_extracti128_si256( out, 1 ) );
+        }
+    }
+}
+
+X265_TARGET("avx2")
+void xDCT8_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_avx2( pDst, nStride, pSrc, NULL, NULL, nStride, nLines, nShift, g_aiT8, 8 );
+}
+
+X265_TARGET("avx2")
+void xDCT16_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_avx2( pDst, nStride, pSrc, NULL, NULL, nStride, nLines, nShift, g_aiT16, 16 );
+}
+
+X265_TARGET("avx2")
+void xDCT32_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+{
+    xDctNxN_avx2( pDst, nStride, pSrc, NULL, NULL, nStride, nLines, nShift, g_aiT32, 32 );
+}
+
+// ***************************************************************************
+// * Residual and Forward Transform
+// ***************************************************************************
+// Same as xSubDct(), the residual is made inside the 1st pass and the
+// intermediate stay in a local buffer with stride of the TU size, so
+// piTmp0 and piTmp1 are not touched
+static void xSubDct_x86( Int16 *pDst, UInt8 *pSrc, UInt8 *pRef, UInt nStride, Int iWidth, Int iHeight, UInt nMode, Int bUseAvx2 )
+{
+    const Int bUseDst     = (iWidth + iHeight == 8) && (nMode != MODE_INVALID);
+    const Int bUseDstHor  = bUseDst && (!nMode || (nMode>=2  && nMode <= 25));
+    const Int bUseDstVer  = bUseDst && (!nMode || (nMode>=11 && nMode <= 34));
+    const Int16 *pTHor = (iWidth  == 4 ? (bUseDstHor ? g_as_DST_MAT_4 : g_aiT4) : iWidth  == 8 ? g_aiT8 : iWidth  == 16 ? g_aiT16 : g_aiT32);
+    const Int16 *pTVer = (iHeight == 4 ? (bUseDstVer ? g_as_DST_MAT_4 : g_aiT4) : iHeight == 8 ? g_aiT8 : iHeight == 16 ? g_aiT16 : g_aiT32);
+    __m128i aTmp[MAX_CU_SIZE * MAX_CU_SIZE * sizeof(Int16) / sizeof(__m128i)];
+    Int16 *piTmp = (Int16 *)aTmp;
+
+    // The TU must be less than or equal to 32x32
+    assert( (iWidth <= 32) && (iHeight <= 32) );
+
+    if( bUseAvx2 && iWidth >= 8 ) {
+        xDctNxN_avx2( piTmp, iHeight, NULL, pSrc, pRef, nStride, iHeight, xLog2( iWidth  - 1 ) - 1, pTHor, iWidth );
+        xDctNxN_avx2( pDst,  nStride, piTmp, NULL, NULL, iHeight, iWidth,  xLog2( iHeight - 1 ) + 6, pTVer, iHeight );
+    }
+    else {
+        xDctNxN_sse2( piTmp, iHeight, NULL, pSrc, pRef, nStride, iHeight, xLog2( iWidth  - 1 ) - 1, pTHor, iWidth );
+        xDctNxN_sse2( pDst,  nStride, piTmp, NULL, NULL, iHeight, iWidth,  xLog2( iHeight - 1 ) + 6, pTVer, iHeight );
+    }
+}
+
+void xSubDct_sse2( Int16 *pDst, UInt8 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode )
+{
+    xSubDct_x86( pDst, pSrc, pRef, nStride, iWidth, iHeight, nMode, FALSE );
+}
+
+void xSubDct_avx2( Int16 *pDst, UInt8 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1, Int iWidth, Int iHeight, UInt nMode )
+{
+    xSubDct_x86( pDst, pSrc, pRef, nStride, iWidth, iHeight, nMode, TRUE );
+}
+
+// ***************************************************************************
+// * Inverse Transform
+// ***************************************************************************
+// pDst[i*nStride+k] = Clip3(-32768, 32767, (Sum_{j<nCoeffs} T[j][k] * pSrc[j*nStride+i] + rnd) >> nShift)
+// The input rows are lines already, so the pair (pSrc[j][i], pSrc[j+1][i]) is
+// one unpack, pmaddwd with the pair (T[j][k], T[j+1][k]) give 8 lines of
+// output k, and a 8x8 transpose turn them into rows. The rows from nCoeffs
+// are not read, an odd nCoeffs pair the last row with zero.
+// When pRec is not NULL, the rows are add to pRef and clip to pixel directly.
+
+// in: R[k] is line 0-7 of output k, out: R[l] is output 0-7 of line l
+X265_TARGET("sse2")
+static void xTranspose8x8_sse2( __m128i *R )
+{
+    __m128i a0 = _mm_unpacklo_epi16( R[0], R[1] );
+    __m128i a1 = _mm_unpackhi_epi16( R[0], R[1] );
+    __m128i a2 = _mm_unpacklo_epi16( R[2], R[3] );
+    __m128i a3 = _mm_unpackhi_epi16( R[2], R[3] );
+    __m128i a4 = _mm_unpacklo_epi16( R[4], R[5] );
+    __m128i a5 = _mm_unpackhi_epi16( R[4], R[5] );
+    __m128i a6 = _mm_unpacklo_epi16( R[6], R[7] );
+    __m128i a7 = _mm_unpackhi_epi16( R[6], R[7] );
+    __m128i b0 = _mm_unpacklo_epi32( a0, a2 );
+    __m128i b1 = _mm_unpackhi_epi32( a0, a2 );
+    __m128i b2 = _mm_unpacklo_epi32( a1, a3 );
+    __m128i b3 = _mm_unpackhi_epi32( a1, a3 );
+    __m128i b4 = _mm_unpacklo_epi32( a4, a6 );
+    __m128i b5 = _mm_unpackhi_epi32( a4, a6 );
+    __m128i b6 = _mm_unpacklo_epi32( a5, a7 );
+    __m128i b7 = _mm_unpackhi_epi32( a5, a7 );
+    R[0] = _mm_unpacklo_epi64( b0, b4 );
+    R[1] = _mm_unpackhi_epi64( b0, b4 );
+    R[2] = _mm_unpacklo_epi64( b1, b5 );
+    R[3] = _mm_unpackhi_epi64( b1, b5 );
+    R[4] = _mm_unpacklo_epi64( b2, b6 );
+    R[5] = _mm_unpackhi_epi64( b2, b6 );
+    R[6] = _mm_unpacklo_epi64( b3, b7 );
+    R[7] = _mm_unpackhi_epi64( b3, b7 );
+}
+
+// Store 8 outputs of a line, or reconstruct them
+X265_TARGET("sse2")
+static void xStoreRow8_sse2( __m128i R, Int16 *pDst, UInt8 *pRec, const UInt8 *pRef, const UInt nOffset )
+{
+    if( pRec ) {
+        __m128i ref = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)&pRef[nOffset] ), _mm_setzero_si128() );
+        R = _mm_adds_epi16( R, ref );
+        _mm_storel_epi64( (__m128i *)&pRec[nOffset], _mm_packus_epi16( R, R ) );
+    }
+    else {
+        _mm_storeu_si128( (__m128i *)&pDst[nOffset], R );
+    }
+}
+
+X265_TARGET("sse2")
+static void xInvDct4x4_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs, const Int16 *pT,
+                             UInt8 *pRec, const UInt8 *pRef )
+{
+    const __m128i rnd   = _mm_set1_epi32( 1 << (nShift-1) );
+    const __m128i shift = _mm_cvtsi32_si128( nShift );
+    const __m128i zero  = _mm_setzero_si128();
+    __m128i P[2], C[2], R[4];
+    Int j, l;
+
+    for( j=0; j<2; j++ ) {
+        __m128i r0 = (2*j+0 < nCoeffs) ? _mm_loadl_epi64( (const __m128i *)&pSrc[(2*j+0)*nStride] ) : zero;
+        __m128i r1 = (2*j+1 < nCoeffs) ? _mm_loadl_epi64( (const __m128i *)&pSrc[(2*j+1)*nStride] ) : zero;
+        P[j] = _mm_unpacklo_epi16( r0, r1 );
+        C[j] = _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i *)&pT[(2*j+0)*4] ),
+                                   _mm_loadl_epi64( (const __m128i *)&pT[(2*j+1)*4] ) );
+    }
+
+    #define INV4_ROW( k, imm ) \
+    { \
+        __m128i sum = _mm_add_epi32( _mm_madd_epi16( P[0], _mm_shuffle_epi32( C[0], imm ) ), \
+                                     _mm_madd_epi16( P[1], _mm_shuffle_epi32( C[1], imm ) ) ); \
+        sum  = _mm_sra_epi32( _mm_add_epi32( sum, rnd ), shift ); \
+        R[k] = _mm_packs_epi32( sum, sum ); \
+    }
+    INV4_ROW( 0, 0x00 );
+    INV4_ROW( 1, 0x55 );
+    INV4_ROW( 2, 0xAA );
+    INV4_ROW( 3, 0xFF );
+    #undef INV4_ROW
+
+    // Transpose 4x4, line 0 and 1 in R[2], line 2 and 3 in R[3]
+    R[0] = _mm_unpacklo_epi16( R[0], R[1] );
+    R[1] = _mm_unpacklo_epi16( R[2], R[3] );
+    R[2] = _mm_unpacklo_epi32( R[0], R[1] );
+    R[3] = _mm_unpackhi_epi32( R[0], R[1] );
+
+    for( l=0; l<nLines; l++ ) {
+        __m128i row = (l & 1) ? _mm_srli_si128( R[2 + (l>>1)], 8 ) : R[2 + (l>>1)];
+        if( pRec ) {
+            __m128i ref = _mm_unpacklo_epi8( _mm_cvtsi32_si128( *(const Int32 *)&pRef[l*nStride] ), zero );
+            row = _mm_adds_epi16( row, ref );
+            *(Int32 *)&pRec[l*nStride] = _mm_cvtsi128_si32( _mm_packus_epi16( row, row ) );
+        }
+        else {
+            _mm_storel_epi64( (__m128i *)&pDst[l*nStride], row );
+        }
+    }
+}
+
+X265_TARGET("sse2")
+static void xInvDctNxN_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs, const Int16 *pT, const Int N,
+                             UInt8 *pRec, const UInt8 *pRef )
+{
+    const __m128i rnd   = _mm_set1_epi32( 1 << (nShift-1) );
+    const __m128i shift = _mm_cvtsi32_si128( nShift );
+    const __m128i zero  = _mm_setzero_si128();
+    const Int nPairs = (nCoeffs + 1) >> 1;
+    __m128i P0[16], P1[16];
+    Int i, j, k, l, m;
+
+    for( i=0; i<nLines; i+=8 ) {
+        for( j=0; j<nPairs; j++ ) {
+            __m128i r0 = _mm_loadu_si128( (const __m128i *)&pSrc[(2*j+0)*nStride + i] );
+            __m128i r1 = (2*j+1 < nCoeffs) ? _mm_loadu_si128( (const __m128i *)&pSrc[(2*j+1)*nStride + i] ) : zero;
+            P0[j] = _mm_unpacklo_epi16( r0, r1 );
+            P1[j] = _mm_unpackhi_epi16( r0, r1 );
+        }
+
+        for( k=0; k<N; k+=8 ) {
+            __m128i R[8];
+
+            // 4 outputs per round, the coeff pair (T[j][k+m], T[j+1][k+m]) broadcast by pshufd
+            for( m=0; m<8; m+=4 ) {
+                __m128i s00 = rnd, s01 = rnd, s10 = rnd, s11 = rnd;
+                __m128i s20 = rnd, s21 = rnd, s30 = rnd, s31 = rnd;
+                for( j=0; j<nPairs; j++ ) {
+                    __m128i t0 = _mm_loadl_epi64( (const __m128i *)&pT[(2*j+0)*N + k + m] );
+                    __m128i t1 = _mm_loadl_epi64( (const __m128i *)&pT[(2*j+1)*N + k + m] );
+                    __m128i c  = _mm_unpacklo_epi16( t0, t1 );
+                    __m128i c0 = _mm_shuffle_epi32( c, 0x00 );
+                    __m128i c1 = _mm_shuffle_epi32( c, 0x55 );
+                    __m128i c2 = _mm_shuffle_epi32( c, 0xAA );
+                    __m128i c3 = _mm_shuffle_epi32( c, 0xFF );
+                    s00 = _mm_add_epi32( s00, _mm_madd_epi16( P0[j], c0 ) );
+                    s01 = _mm_add_epi32( s01, _mm_madd_epi16( P1[j], c0 ) );
+                    s10 = _mm_add_epi32( s10, _mm_madd_epi16( P0[j], c1 ) );
+                    s11 = _mm_add_epi32( s11, _mm_madd_epi16( P1[j], c1 ) );
+                    s20 = _mm_add_epi32( s20, _mm_madd_epi16( P0[j], c2 ) );
+                    s21 = _mm_add_epi32( s21, _mm_madd_epi16( P1[j], c2 ) );
+                    s30 = _mm_add_epi32( s30, _mm_madd_epi16( P0[j], c3 ) );
+                    s31 = _mm_add_epi32( s31, _mm_madd_epi16( P1[j], c3 ) );
+                }
+                R[m+0] = _mm_packs_epi32( _mm_sra_epi32( s00, shift ), _mm_sra_epi32( s01, shift ) );
+                R[m+1] = _mm_packs_epi32( _mm_sra_epi32( s10, shift ), _mm_sra_epi32( s11, shift ) );
+                R[m+2] = _mm_packs_epi32( _mm_sra_epi32( s20, shift ), _mm_sra_epi32( s21, shift ) );
+                R[m+3] = _mm_packs_epi32( _mm_sra_epi32( s30, shift ), _mm_sra_epi32( s31, shift ) );
+            }
+            xTranspose8x8_sse2( R );
+
+            for( l=0; l<8 && i+l<nLines; l++ ) {
+                xStoreRow8_sse2( R[l], pDst, pRec, pRef, (i+l)*nStride + k );
+            }
+        }
+    }
+}
+
+X265_TARGET("sse2")
+void xInvDST4_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDct4x4_sse2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_as_DST_MAT_4, NULL, NULL );
+}
+
+X265_TARGET("sse2")
+void xInvDCT4_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDct4x4_sse2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_aiT4, NULL, NULL );
+}
+
+X265_TARGET("sse2")
+void xInvDCT8_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDctNxN_sse2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_aiT8, 8, NULL, NULL );
+}
+
+X265_TARGET("sse2")
+void xInvDCT16_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDctNxN_sse2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_aiT16, 16, NULL, NULL );
+}
+
+X265_TARGET("sse2")
+void xInvDCT32_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDctNxN_sse2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_aiT32, 32, NULL, NULL );
+}
+
+// AVX2, low lane is line 0-3 and high lane is line 4-7, 8 outputs per round
+X265_TARGET("avx2")
+static void xInvDctNxN_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs, const Int16 *pT, const Int N,
+                             UInt8 *pRec, const UInt8 *pRef )
+{
+    const __m256i rnd   = _mm256_set1_epi32( 1 << (nShift-1) );
+    const __m128i shift = _mm_cvtsi32_si128( nShift );
+    const __m128i zero  = _mm_setzero_si128();
+    const Int nPairs = (nCoeffs + 1) >> 1;
+    __m256i P[16];
+    Int i, j, k, l;
+
+    for( i=0; i<nLines; i+=8 ) {
+        for( j=0; j<nPairs; j++ ) {
+            __m128i r0 = _mm_loadu_si128( (const __m128i *)&pSrc[(2*j+0)*nStride + i] );
+            __m128i r1 = (2*j+1 < nCoeffs) ? _mm_loadu_si128( (const __m128i *)&pSrc[(2*j+1)*nStride + i] ) : zero;
+            P[j] = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( r0, r1 ) ), _mm_unpackhi_epi16( r0, r1 ), 1 );
+        }
+
+        for( k=0; k<N; k+=8 ) {
+            __m256i s0 = rnd, s1 = rnd, s2 = rnd, s3 = rnd;
+            __m256i s4 = rnd, s5 = rnd, s6 = rnd, s7 = rnd;
+
+            for( j=0; j<nPairs; j++ ) {
+                __m128i t0 = _mm_loadu_si128( (const __m128i *)&pT[(2*j+0)*N + k] );
+                __m128i t1 = _mm_loadu_si128( (const __m128i *)&pT[(2*j+1)*N + k] );
+                __m256i cl = _mm256_broadcastsi128_si256( _mm_unpacklo_epi16( t0, t1 ) );
+                __m256i ch = _mm256_broadcastsi128_si256( _mm_unpackhi_epi16( t0, t1 ) );
+                s0 = _mm256_add_epi32( s0, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( cl, 0x00 ) ) );
+                s1 = _mm256_add_epi32( s1, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( cl, 0x55 ) ) );
+                s2 = _mm256_add_epi32( s2, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( cl, 0xAA ) ) );
+                s3 = _mm256_add_epi32( s3, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( cl, 0xFF ) ) );
+                s4 = _mm256_add_epi32( s4, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( ch, 0x00 ) ) );
+                s5 = _mm256_add_epi32( s5, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( ch, 0x55 ) ) );
+                s6 = _mm256_add_epi32( s6, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( ch, 0xAA ) ) );
+                s7 = _mm256_add_epi32( s7, _mm256_madd_epi16( P[j], _mm256_shuffle_epi32( ch, 0xFF ) ) );
+            }
+
+            // Transpose in lane, line 0-3 in low lane and 4-7 in high lane of every step
+            #define INV_PACK( a, b ) _mm256_packs_epi32( _mm256_sra_epi32( a, shift ), _mm256_sra_epi32( b, shift ) )
+            __m256i q0 = INV_PACK( s0, s1 );    // k0 l0-3, k1 l0-3
+            __m256i q1 = INV_PACK( s2, s3 );
+            __m256i q2 = INV_PACK( s4, s5 );
+            __m256i q3 = INV_PACK( s6, s7 );
+            #undef INV_PACK
+            __m256i a0 = _mm256_unpacklo_epi16( q0, q1 );   // k0 k2 of l0-3
+            __m256i a1 = _mm256_unpackhi_epi16( q0, q1 );   // k1 k3 of l0-3
+            __m256i a2 = _mm256_unpacklo_epi16( q2, q3 );
+            __m256i a3 = _mm256_unpackhi_epi16( q2, q3 );
+            __m256i b0 = _mm256_unpacklo_epi16( a0, a1 );   // k0-3 of l0-1
+            __m256i b1 = _mm256_unpackhi_epi16( a0, a1 );   // k0-3 of l2-3
+            __m256i b2 = _mm256_unpacklo_epi16( a2, a3 );   // k4-7 of l0-1
+            __m256i b3 = _mm256_unpackhi_epi16( a2, a3 );
+            __m256i R[4];
+            R[0] = _mm256_unpacklo_epi64( b0, b2 );
+            R[1] = _mm256_unpackhi_epi64( b0, b2 );
+            R[2] = _mm256_unpacklo_epi64( b1, b3 );
+            R[3] = _mm256_unpackhi_epi64( b1, b3 );
+
+            for( l=0; l<4 && i+l<nLines; l++ ) {
+                const UInt nOffset0 = (i+l+0)*nStride + k;
+                const UInt nOffset1 = (i+l+4)*nStride + k;
+                if( pRec ) {
+                    __m256i ref = _mm256_cvtepu8_epi16( _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i *)&pRef[nOffset0] ),
+                                                                            _mm_loadl_epi64( (const __m128i *)&pRef[nOffset1] ) ) );
+                    __m256i rec = _mm256_adds_epi16( R[l], ref );
+                    __m128i pix = _mm_packus_epi16( _mm256_castsi256_si128( rec ), _mm256_extracti128_si256( rec, 1 ) );
+                    _mm_storel_epi64( (__m128i *)&pRec[nOffset0], pix );
+                    if( i+l+4 < nLines )
+                        _mm_storel_epi64( (__m128i *)&pRec[nOffset1], _mm_srli_si128( pix, 8 ) );
+                }
+                else {
+                    _mm_storeu_si128( (__m128i *)&pDst[nOffset0], _mm256_castsi256_si128( R[l] ) );
+                    if( i+l+4 < nLines )
+                        _mm_storeu_si128( (__m128i *)&pDst[nOffset1], _mm256_extracti128_si256( R[l], 1 ) );
+                }
+            }
+        }
+    }
+}
+
+X265_TARGET("avx2")
+void xInvDCT8_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDctNxN_avx2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_aiT8, 8, NULL, NULL );
+}
+
+X265_TARGET("avx2")
+void xInvDCT16_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDctNxN_avx2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_aiT16, 16, NULL, NULL );
+}
+
+X265_TARGET("avx2")
+void xInvDCT32_avx2( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
+{
+    xInvDctNxN_avx2( pDst, pSrc, nStride, nLines, nShift, nCoeffs, g_aiT32, 32, NULL, NULL );
+}
+
+// ***************************************************************************
+// * Inverse Transform and Reconstruct
+// ***************************************************************************
+// Same as xIDctAdd(), but the 2nd pass add the prediction and clip in register,
+// so the residual is never write to piTmp1
+// The 1st pass is the one of the same level in xPrimitivesInit()
+static xIDCT *const s_apfnInvDct_sse2[MAX_CU_DEPTH+1] = { xInvDST4_sse2, xInvDCT4_sse2, xInvDCT8_sse2, xInvDCT16_sse2, xInvDCT32_sse2 };
+static xIDCT *const s_apfnInvDct_avx2[MAX_CU_DEPTH+1] = { xInvDST4_sse2, xInvDCT4_sse2, xInvDCT8_avx2, xInvDCT16_avx2, xInvDCT32_avx2 };
+
+static void xIDctAdd_x86( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0,
+                          Int iWidth, Int iHeight, UInt nMode, Int nLastX, Int nLastY, Int bUseAvx2 )
+{
+    const Int nLog2Width  = xLog2( iWidth - 1 );
+    const Int bUseDst     = (iWidth + iHeight == 8) && (nMode != MODE_INVALID);
+    const Int bUseDstHor  = bUseDst && (!nMode || (nMode>=11 && nMode <= 34));
+    const Int bUseDstVer  = bUseDst && (!nMode || (nMode>=2  && nMode <= 25));
+    const Int16 *pT;
+
+    (bUseAvx2 ? s_apfnInvDct_avx2 : s_apfnInvDct_sse2)[nLog2Width - 1 - bUseDstHor]( piTmp0, pSrc, nStride, nLastX+1, SHIFT_INV_1ST, nLastY+1 );
+
+    if( iHeight == 4 ) {
+        pT = bUseDstVer ? g_as_DST_MAT_4 : g_aiT4;
+        xInvDct4x4_sse2( NULL, piTmp0, nStride, iWidth, SHIFT_INV_2ND, nLastX+1, pT, pDst, pRef );
+        return;
+    }
+    pT = (iHeight == 8 ? g_aiT8 : iHeight == 16 ? g_aiT16 : g_aiT32);
+    if( bUseAvx2 )
+        xInvDctNxN_avx2( NULL, piTmp0, nStride, iWidth, SHIFT_INV_2ND, nLastX+1, pT, iHeight, pDst, pRef );
+    else
+        xInvDctNxN_sse2( NULL, piTmp0, nStride, iWidth, SHIFT_INV_2ND, nLastX+1, pT, iHeight, pDst, pRef );
+}
+
+void xIDctAdd_sse2( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1,
+                    Int iWidth, Int iHeight, UInt nMode, Int nLastX, Int nLastY )
+{
+    xIDctAdd_x86( pDst, pSrc, pRef, nStride, piTmp0, iWidth, iHeight, nMode, nLastX, nLastY, FALSE );
+}
+
+void xIDctAdd_avx2( UInt8 *pDst, Int16 *pSrc, UInt8 *pRef, UInt nStride, Int16 *piTmp0, Int16 *piTmp1,
+                    Int iWidth, Int iHeight, UInt nMode, Int nLastX, Int nLastY )
+{
+    xIDctAdd_x86( pDst, pSrc, pRef, nStride, piTmp0, iWidth, iHeight, nMode, nLastX, nLastY, TRUE );
+}
+
+#endif /* ARCH_X86 */
@@ -23,20 +23,75 @@
  *****************************************************************************/
 
 #include "x265.h"
-#ifdef CHECK_SEI
-#include "md5.h"
-#endif
+
+static void *xEncAsyncThread( void *pArg );
 
 // ***************************************************************************
 // * Interface Functions
 // ***************************************************************************
+/// the primitives and the tables are global, the encoders of a process may be created on any thread
+static X265_Once    s_onceInit = X265_ONCE_INIT;
+static X265_Mutex   s_mutexInit;
+static UInt8        s_bInitDone = FALSE;
+static UInt         s_nHostLevel;
+
+static void xEncInitMutex( void )
+{
+    xMutexInit( &s_mutexInit );
+}
+
 void xEncInit( X265_t *h )
 {
     const UInt32 uiWidth    = h->usWidth;
     const UInt32 uiHeight   = h->usHeight;
     const UInt32 uiYSize    = uiWidth * uiHeight;
+    const UInt   bParallel  = (h->bUseWPP || h->ucSliceMode != SLICE_MODE_NONE || h->ucTileCols * h->ucTileRows > 1 || h->ucFrameThreads > 1);
     int i;
 
+    xThreadOnce( &s_onceInit, xEncInitMutex );
+    xMutexLock( &s_mutexInit );
+    if( !s_bInitDone ) {
+        s_nHostLevel = xCpuDetect();
+        for( i=0; i <= CPU_LEVEL_AVX2; i++ ) {
+            xPrimitivesInit( &g_aPrimitives[i], MIN( (UInt)i, s_nHostLevel ) );
+        }
+        xCabacInitTables();
+        xEncInitCoeffTables();
+        s_bInitDone = TRUE;
+    }
+    xMutexUnlock( &s_mutexInit );
+    h->pPrim = &g_aPrimitives[MIN( s_nHostLevel, h->ucCpuLevel )];
+
+    /// The pool may be shared by other encoders, the calling thread is a worker too
+    /// an own pool is only created for the parallel modes, without one xPoolRun() run the jobs on the caller
+    h->bOwnPool = FALSE;
+    if( h->pPool == NULL && bParallel ) {
+        const UInt nThreads = (h->ucThreads ? h->ucThreads : xThreadCpuCount());
+
+        if( nThreads > 1 ) {
+            h->pPool    = xPoolCreate( nThreads - 1, h->bThreadAffinity );
+            h->bOwnPool = TRUE;
+        }
+    }
+
+    /// Every frame in flight is a full encoder of its own, copied from the params before anything is allocated
+    if( h->ucFrameThreads > 1 ) {
+        xMutexInit( &h->mutexFrame );
+        xCondInit( &h->condFrame );
+        for( i=0; i < h->ucFrameThreads; i++ ) {
+            X265_t *pCtx = (X265_t *)MALLOC( sizeof(X265_t) );
+            assert( pCtx != NULL );
+            memcpy( pCtx, h, sizeof(X265_t) );
+            pCtx->ucFrameThreads = 0;
+            pCtx->ucAsyncDepth   = 0;
+            xEncInit( pCtx );
+            pCtx->uiFrameOutSize = uiYSize * 3 / 2 * 4 + 4096;
+            pCtx->pucFrameOut    = (UInt8 *)MALLOC( pCtx->uiFrameOutSize );
+            assert( pCtx->pucFrameOut != NULL );
+            h->pFrameCtx[i] = pCtx;
+        }
+    }
+
     for( i=0; i < MAX_REF_NUM+1; i++ ) {
         UInt8 *ptr = (UInt8 *)MALLOC(uiYSize * 3 / 2);
         assert(ptr != NULL);
@@ -45,6 +100,124 @@ void xEncInit( X265_t *h )
         h->refn[i].pucV = (UInt8 *)ptr + uiYSize * 5 / 4;
     }
     h->iPoc = -1;
+    h->pucRBSP    = NULL;
+    h->uiRBSPSize = 0;
+    h->pMain      = h;
+    h->uiSliceBegin = 0;
+    h->uiSliceEnd   = (uiWidth / h->ucMaxCUWidth) * (uiHeight / h->ucMaxCUWidth);
+    h->nSlices      = 1;
+    h->uiTileX0     = 0;
+    h->uiTileX1     = uiWidth;
+    h->uiTileY0     = 0;
+    h->uiTileY1     = uiHeight;
+    h->nTiles       = h->ucTileCols * h->ucTileRows;
+
+    /// Every CTU row of the WPP have a copy of the handle, a substream can't be larger than 4 times of the raw pixels
+    if( h->bUseWPP ) {
+        const UInt nRows = uiHeight / h->ucMaxCUWidth;
+
+        assert( nRows <= MAX_CU_ROWS );
+        xMutexInit( &h->mutexRow );
+        xCondInit( &h->condRow );
+        for( i=0; i < (int)nRows; i++ ) {
+            X265_t *pRow = (X265_t *)MALLOC( sizeof(X265_t) );
+            assert( pRow != NULL );
+            memcpy( pRow, h, sizeof(X265_t) );
+            pRow->uiSubStreamSize = uiWidth * h->ucMaxCUWidth * 3 / 2 * 4 + 1024;
+            pRow->pucSubStream[0] = (UInt8 *)MALLOC( pRow->uiSubStreamSize );
+            pRow->pucSubStream[1] = (UInt8 *)MALLOC( pRow->uiSubStreamSize * 3 / 2 );
+            assert( pRow->pucSubStream[0] != NULL && pRow->pucSubStream[1] != NULL );
+            h->pRows[i] = pRow;
+        }
+    }
+
+    /// Every slice have a copy of the handle too, the last slice may be shorter
+    if( h->ucSliceMode != SLICE_MODE_NONE ) {
+        const UInt32 nCUs       = h->uiSliceEnd;
+        const UInt32 nSliceCUs  = h->usSliceArg * (h->ucSliceMode == SLICE_MODE_ROWS ? uiWidth / h->ucMaxCUWidth : 1);
+
+        h->nSlices = (nCUs + nSliceCUs - 1) / nSliceCUs;
+        assert( h->nSlices <= MAX_SLICES );
+        for( i=0; i < (int)h->nSlices; i++ ) {
+            X265_t *pSlice = (X265_t *)MALLOC( sizeof(X265_t) );
+            assert( pSlice != NULL );
+            memcpy( pSlice, h, sizeof(X265_t) );
+            pSlice->uiSliceBegin    = i * nSliceCUs;
+            pSlice->uiSliceEnd      = MIN( (i + 1) * nSliceCUs, nCUs );
+            pSlice->uiSubStreamSize = (pSlice->uiSliceEnd - pSlice->uiSliceBegin) * h->ucMaxCUWidth * h->ucMaxCUWidth * 3 / 2 * 4 + 1024;
+            pSlice->pucSubStream[0] = (UInt8 *)MALLOC( pSlice->uiSubStreamSize );
+            pSlice->pucSubStream[1] = (UInt8 *)MALLOC( pSlice->uiSubStreamSize * 3 / 2 );
+            assert( pSlice->pucSubStream[0] != NULL && pSlice->pucSubStream[1] != NULL );
+            h->pSlices[i] = pSlice;
+        }
+    }
+
+    /// Every tile have a copy of the handle too, the boundaries are in CTUs like the SPS
+    if( h->nTiles > 1 ) {
+        const UInt nCUSize = h->ucMaxCUWidth;
+        const UInt nCols   = uiWidth  / nCUSize;
+        const UInt nRows   = uiHeight / nCUSize;
+        UInt auiColBd[MAX_TILE_COLS + 1];
+        UInt auiRowBd[MAX_TILE_ROWS + 1];
+        UInt nTileX, nTileY;
+
+        auiColBd[0] = 0;
+        for( nTileX=0; nTileX < h->ucTileCols; nTileX++ ) {
+            if( nTileX == h->ucTileCols - 1u )
+                auiColBd[nTileX + 1] = nCols;
+            else if( h->bTileUniform )
+                auiColBd[nTileX + 1] = (nTileX + 1) * nCols / h->ucTileCols;
+            else
+                auiColBd[nTileX + 1] = auiColBd[nTileX] + h->aucTileColWidth[nTileX];
+        }
+        auiRowBd[0] = 0;
+        for( nTileY=0; nTileY < h->ucTileRows; nTileY++ ) {
+            if( nTileY == h->ucTileRows - 1u )
+                auiRowBd[nTileY + 1] = nRows;
+            else if( h->bTileUniform )
+                auiRowBd[nTileY + 1] = (nTileY + 1) * nRows / h->ucTileRows;
+            else
+                auiRowBd[nTileY + 1] = auiRowBd[nTileY] + h->aucTileRowHeight[nTileY];
+        }
+
+        for( i=0; i < (int)h->nTiles; i++ ) {
+            X265_t *pTile = (X265_t *)MALLOC( sizeof(X265_t) );
+            assert( pTile != NULL );
+            memcpy( pTile, h, sizeof(X265_t) );
+            nTileX = i % h->ucTileCols;
+            nTileY = i / h->ucTileCols;
+            pTile->uiTileX0 = auiColBd[nTileX    ] * nCUSize;
+            pTile->uiTileX1 = auiColBd[nTileX + 1] * nCUSize;
+            pTile->uiTileY0 = auiRowBd[nTileY    ] * nCUSize;
+            pTile->uiTileY1 = auiRowBd[nTileY + 1] * nCUSize;
+            pTile->uiSubStreamSize = (pTile->uiTileX1 - pTile->uiTileX0) * (pTile->uiTileY1 - pTile->uiTileY0) * 3 / 2 * 4 + 1024;
+            pTile->pucSubStream[0] = (UInt8 *)MALLOC( pTile->uiSubStreamSize );
+            pTile->pucSubStream[1] = (UInt8 *)MALLOC( pTile->uiSubStreamSize * 3 / 2 );
+            assert( pTile->pucSubStream[0] != NULL && pTile->pucSubStream[1] != NULL );
+            h->pTiles[i] = pTile;
+        }
+    }
+
+    /// The slices and the tiles finish the CTU rows in any order, the rows are hashed in order, see xEncHashRow()
+    if( h->ucSliceMode != SLICE_MODE_NONE || h->nTiles > 1 ) {
+        xMutexInit( &h->mutexHash );
+    }
+
+    /// The pipeline own a copy of every frame in flight, so the caller may reuse its buffers after xEncSubmit()
+    if( h->ucAsyncDepth ) {
+        const UInt32 uiAUSize = uiYSize * 3 / 2 * 4 + 4096;
+
+        xQueueInit( &h->queueIn, h->ucAsyncDepth, uiYSize * 3 / 2 );
+        if( h->pfnOutput == NULL )
+            xQueueInit( &h->queueOut, h->ucAsyncDepth, uiAUSize );
+        h->uiAsyncOutSize = uiAUSize * MAX( h->ucFrameThreads, 1 );
+        h->pucAsyncOut    = (UInt8 *)MALLOC( h->uiAsyncOutSize );
+        assert( h->pucAsyncOut != NULL );
+        h->uiAsyncAbort   = FALSE;
+        h->bAsyncEnd      = FALSE;
+        if( xThreadCreate( &h->threadAsync, xEncAsyncThread, h ) != 0 )
+            abort();
+    }
     #if (CHECK_TV)
     if( tInitTv( "CHEN_TV.TXT" ) < 0)
         abort();
@@ -54,30 +227,79 @@ void xEncInit( X265_t *h )
 void xEncFree( X265_t *h )
 {
     int i;
+
+    /// The frames submitted are encoded still, the pipeline only give up when nobody receive or submit
+    if( h->ucAsyncDepth ) {
+        xAtomicStore( &h->uiAsyncAbort, TRUE );
+        xQueueWake( &h->queueIn );
+        if( h->pfnOutput == NULL )
+            xQueueWake( &h->queueOut );
+        xThreadJoin( h->threadAsync );
+        xQueueFree( &h->queueIn );
+        if( h->pfnOutput == NULL )
+            xQueueFree( &h->queueOut );
+        FREE( h->pucAsyncOut );
+        h->pucAsyncOut = NULL;
+    }
     for( i=0; i < MAX_REF_NUM+1; i++ ) {
         assert( h->refn[i].pucY != NULL );
         FREE( h->refn[i].pucY );
     }
     memset( h->refn, 0, sizeof(h->refn) );
+    if( h->pucRBSP != NULL ) {
+        FREE( h->pucRBSP );
+        h->pucRBSP    = NULL;
+        h->uiRBSPSize = 0;
+    }
+    if( h->bUseWPP ) {
+        for( i=0; i < MAX_CU_ROWS && h->pRows[i] != NULL; i++ ) {
+            FREE( h->pRows[i]->pucSubStream[0] );
+            FREE( h->pRows[i]->pucSubStream[1] );
+            FREE( h->pRows[i] );
+            h->pRows[i] = NULL;
+        }
+        xCondFree( &h->condRow );
+        xMutexFree( &h->mutexRow );
+    }
+    if( h->ucSliceMode != SLICE_MODE_NONE ) {
+        for( i=0; i < (int)h->nSlices; i++ ) {
+            FREE( h->pSlices[i]->pucSubStream[0] );
+            FREE( h->pSlices[i]->pucSubStream[1] );
+            FREE( h->pSlices[i] );
+            h->pSlices[i] = NULL;
+        }
+    }
+    if( h->nTiles > 1 ) {
+        for( i=0; i < (int)h->nTiles; i++ ) {
+            FREE( h->pTiles[i]->pucSubStream[0] );
+            FREE( h->pTiles[i]->pucSubStream[1] );
+            FREE( h->pTiles[i] );
+            h->pTiles[i] = NULL;
+        }
+    }
+    if( h->ucSliceMode != SLICE_MODE_NONE || h->nTiles > 1 ) {
+        xMutexFree( &h->mutexHash );
+    }
+    if( h->ucFrameThreads > 1 ) {
+        for( i=0; i < h->ucFrameThreads; i++ ) {
+            xEncFree( h->pFrameCtx[i] );
+            FREE( h->pFrameCtx[i]->pucFrameOut );
+            FREE( h->pFrameCtx[i] );
+            h->pFrameCtx[i] = NULL;
+        }
+        xCondFree( &h->condFrame );
+        xMutexFree( &h->mutexFrame );
+    }
+    if( h->bOwnPool ) {
+        xPoolFree( h->pPool );
+        h->pPool    = NULL;
+        h->bOwnPool = FALSE;
+    }
 }
 
 // ***************************************************************************
 // * Internal Functions
 // ***************************************************************************
-UInt32 countNonZeroCoeffs( Int16 *psCoef, UInt nStride, UInt nSize )
-{
-    Int count = 0;
-    UInt x, y;
-
-    for( y=0; y<nSize; y++ ) {
-        for( x=0; x<nSize; x++ ) {
-            count += (psCoef[y*nStride+x] != 0);
-        }
-    }
-
-    return count;
-}
-
 UInt getCoefScanIdx( UInt nWidth, UInt8 bIsIntra, UInt8 bIsLuma, UInt nLumaMode )
 {
     UInt uiCTXIdx;
@@ -189,35 +411,6 @@ Int getSigCtxInc(Int16 *psCoeff, Int posX, Int posY, Int blockType, Int nSize, U
     return (( bIsLuma && ((posX>>2) + (posY>>2)) > 0 ) ? 4 : 1) + offset + cnt;
 }
 
-UInt getSigCoeffGroupCtxInc(const UInt8 *uiSigCoeffGroupFlag, const UInt nCGPosX, const UInt nCGPosY, const UInt scanIdx, UInt nSize)
-{
-    UInt uiRight = 0;
-    UInt uiLower = 0;
-    UInt width = nSize;
-    UInt height = nSize;
-    
-    width >>= 2;
-    height >>= 2;
-    // 8x8
-    if( nSize == 8 ) {
-        if( scanIdx == SCAN_HOR ) {
-            width = 1;
-            height = 4;
-        }
-        else if( scanIdx == SCAN_VER ) {
-            width = 4;
-            height = 1;
-        }
-    }
-    if( nCGPosX < width - 1 ) {
-        uiRight = (uiSigCoeffGroupFlag[ nCGPosY * width + nCGPosX + 1 ] != 0);
-    }
-    if( nCGPosY < height - 1 ) {
-        uiLower = (uiSigCoeffGroupFlag[ (nCGPosY  + 1 ) * width + nCGPosX ] != 0);
-    }
-    return (uiRight || uiLower);
-}
-
 void codeLastSignificantXY( X265_Cabac *pCabac, X265_BitStream *pBS, UInt nPosX, UInt nPosY, UInt nSize, UInt8 bIsLuma, UInt nScanIdx )
 {
     const UInt nLog2Size = xLog2( nSize - 1 );
@@ -267,19 +460,133 @@ void codeLastSignificantXY( X265_Cabac *pCabac, X265_BitStream *pBS, UInt nPosX,
     }
 }
 
-void xEncodeCoeffNxN( X265_Cabac *pCabac, X265_BitStream *pBS, Int16 *psCoef, UInt nSize, UInt nDepth, UInt8 bIsLuma, UInt nLumaMode )
+// ***************************************************************************
+// * Coeff Tables
+// ***************************************************************************
+#define SIG_CTX_COUNT       0x80    ///< add the count of the significant neighbours
+#define SIG_CTX_BELOW       0x40    ///< the neighbour below is counted too
+#define SIG_CTX_MASK        0x3F
+
+/// scan order of every size, every position carry the significant_coeff_flag context of chroma and luma
+static X265_ScanPos s_aScanPos[4][16 + 64 + 256 + 1024];
+/// scan order of the 4x4 groups, the 8x8 HOR/VER use a group of 2 rows/columns
+static X265_ScanCG  s_aScanCG[4][1 + 4 + 16 + 64];
+static const UInt   s_nScanPosOffset[4] = { 0, 16, 16 + 64, 16 + 64 + 256 };
+static const UInt   s_nScanCGOffset[4]  = { 0, 1,  1 + 4,  1 + 4 + 16     };
+static UInt8        s_bCoeffTablesReady = FALSE;
+
+/// build the scan tables once per process, the contexts come from getSigCtxInc() of a zero block,
+/// so the coder add the neighbours count only
+void xEncInitCoeffTables( void )
+{
+    static const Int16 s_asZero[MAX_CU_SIZE * MAX_CU_SIZE] = { 0 };
+    UInt nScanIdx, nLog2Size;
+    UInt i, bLuma;
+
+    if( s_bCoeffTablesReady )
+        return;
+
+    for( nScanIdx = SCAN_HOR; nScanIdx <= SCAN_DIAG; nScanIdx++ ) {
+        for( nLog2Size = 2; nLog2Size <= 5; nLog2Size++ ) {
+            const UInt      nSize   = 1 << nLog2Size;
+            const UInt      nNumCG  = (nSize * nSize) >> LOG2_SCAN_SET_SIZE;
+            const UInt      nCGSide = nSize >> 2;
+            const UInt16   *scan    = g_ausScanIdx[ nScanIdx ][ nLog2Size - 1 ];
+            const UInt16   *scanCG  = g_ausScanIdx[ nScanIdx ][ nLog2Size < 3 ? 0 : 1 ];
+            X265_ScanPos   *pPos    = &s_aScanPos[nScanIdx][s_nScanPosOffset[nLog2Size - 2]];
+            X265_ScanCG    *pCG     = &s_aScanCG[nScanIdx][s_nScanCGOffset[nLog2Size - 2]];
+
+            if( nLog2Size == 3 ) {
+                scanCG = g_sigLastScan8x8[ nScanIdx ];
+            }
+            else if( nLog2Size == 5 ) {
+                scanCG = g_sigLastScanCG32x32;
+            }
+
+            for( i=0; i<nSize*nSize; i++ ) {
+                const UInt nPosX = scan[i] & (nSize - 1);
+                const UInt nPosY = scan[i] >> nLog2Size;
+
+                pPos[i].ucPosX = nPosX;
+                pPos[i].ucPosY = nPosY;
+                for( bLuma=0; bLuma<2; bLuma++ ) {
+                    // The last position of the 4x4 is always the last coeff, it never have a sig_coeff_flag
+                    UInt8 ucCtx = (nLog2Size == 2 && i == nSize*nSize - 1) ? 0 : getSigCtxInc( (Int16 *)s_asZero, nPosX, nPosY, nLog2Size, nSize, bLuma );
+
+                    if(    nLog2Size >= 4
+                        && (nPosX + nPosY) != 0
+                        && (nPosX >> 2) + (nPosY >> 2) < 3 * (nSize >> 4) ) {
+                        ucCtx |= SIG_CTX_COUNT;
+                        if( ((nPosX & 3) || (nPosY & 3)) && (((nPosX + 1) & 3) || ((nPosY + 2) & 3)) ) {
+                            ucCtx |= SIG_CTX_BELOW;
+                        }
+                    }
+                    pPos[i].ucCtx[bLuma] = ucCtx;
+                }
+            }
+
+            for( i=0; i<nNumCG; i++ ) {
+                const UInt nBlkPos = scanCG[i];
+                UInt64 uiNeighbour = 0;
+
+                if( nLog2Size == 3 && nScanIdx != SCAN_DIAG ) {
+                    if( nBlkPos < 3 )
+                        uiNeighbour = (UInt64)1 << (nBlkPos + 1);
+                }
+                else {
+                    if( (nBlkPos % nCGSide) < nCGSide - 1 )
+                        uiNeighbour |= (UInt64)1 << (nBlkPos + 1);
+                    if( (nBlkPos / nCGSide) < nCGSide - 1 )
+                        uiNeighbour |= (UInt64)1 << (nBlkPos + nCGSide);
+                }
+                pCG[i].ucBlkPos    = nBlkPos;
+                pCG[i].uiNeighbour = uiNeighbour;
+            }
+        }
+    }
+    s_bCoeffTablesReady = TRUE;
+}
+
+/// bit k is set when the k-th coeff of the group in scan order is nonzero
+static UInt xGetSigMaskCG( const UInt32 *puiRowSig, const X265_ScanPos *pPos )
+{
+    UInt uiMask = 0;
+    UInt k;
+
+    for( k=0; k<SCAN_SET_SIZE; k++ ) {
+        uiMask |= ((puiRowSig[ pPos[k].ucPosY ] >> pPos[k].ucPosX) & 1) << k;
+    }
+    return uiMask;
+}
+
+/// queue the bypass bins, the queue is coded when it can't hold them
+static void xQueueBinsEP( X265_Cabac *pCabac, X265_BitStream *pBS, UInt64 &ruiQueue, Int &rnQueue, UInt binValues, Int numBins )
+{
+    if( rnQueue + numBins > 32 ) {
+        xCabacEncodeBinsEP( pCabac, pBS, (UInt)ruiQueue, rnQueue );
+        ruiQueue = 0;
+        rnQueue  = 0;
+    }
+    ruiQueue = (ruiQueue << numBins) | binValues;
+    rnQueue += numBins;
+}
+
+void xEncodeCoeffNxN( X265_Cabac *pCabac, X265_BitStream *pBS, Int16 *psCoef, const X265_CoeffInfo *pInfo, UInt nSize, UInt nDepth, UInt8 bIsLuma, UInt nLumaMode )
 {
     const UInt      nStride      = (MAX_CU_SIZE >> (bIsLuma ? 0 : 1));
-          UInt      nLog2Size    = xLog2( nSize - 1 );
-          UInt32    uiNumSig     = countNonZeroCoeffs( psCoef, nStride, nSize );
+    const UInt      nLog2Size    = xLog2( nSize - 1 );
           UInt      nScanIdx     = getCoefScanIdx( nSize, TRUE, bIsLuma, nLumaMode );
-    const UInt16   *scan         = NULL;
-    const UInt16   *scanCG       = NULL;
-    const UInt      uiShift      = MLS_CG_SIZE >> 1;
-    const UInt      uiNumBlkSide = nSize >> uiShift;
-    const Int       blockType    = nLog2Size;
-    UInt8 uiSigCoeffGroupFlag[MLS_GRP_NUM];
-    Int idx;
+    const UInt32   *puiRowSig    = pInfo->auiRowSig;
+    const UInt      nBaseCoeffGroupCtx = OFF_SIG_CG_FLAG_CTX + (bIsLuma ? 0 : NUM_SIG_CG_FLAG_CTX);
+    const UInt      nBaseCtx     = OFF_SIG_FLAG_CTX + (bIsLuma ? 0 : NUM_SIG_FLAG_CTX_LUMA);
+    const X265_ScanPos *pScan;
+    const X265_ScanCG  *pScanCG;
+    UInt64 uiSigCG;
+    UInt   uiSigMask;
+    Int    iLastScanSet, iLastK;
+    Int    iSubSet;
+    UInt   uiNumOne = 0;
+    Int    idx;
 
     // Map zigzag to diagonal scan
     if( nScanIdx == SCAN_ZIGZAG ) {
@@ -287,130 +594,109 @@ void xEncodeCoeffNxN( X265_Cabac *pCabac, X265_BitStream *pBS, Int16 *psCoef, UI
     }
 
     // CHECK_ME: I think the size of 64x64 can't be here, but the HM say that 128x128 can be here?
-    assert( nLog2Size <= 5 );
-    scan   = g_ausScanIdx[ nScanIdx ][ nLog2Size - 1 ];
-    scanCG = g_ausScanIdx[ nScanIdx ][ nLog2Size < 3 ? 0 : 1 ];
-    if( nLog2Size == 3 ) {
-      scanCG = g_sigLastScan8x8[ nScanIdx ];
+    assert( nLog2Size >= 2 && nLog2Size <= 5 );
+    assert( s_bCoeffTablesReady );
+    pScan   = &s_aScanPos[nScanIdx][s_nScanPosOffset[nLog2Size - 2]];
+    pScanCG = &s_aScanCG[nScanIdx][s_nScanCGOffset[nLog2Size - 2]];
+
+    // L1 sig map from the masks of xQuant, the 8x8 HOR/VER use a group of 2 rows/columns
+    if( nSize == 8 && (nScanIdx == SCAN_HOR || nScanIdx == SCAN_VER) ) {
+        const UInt32 uiSigLine = (nScanIdx == SCAN_HOR ? pInfo->uiSigRow : pInfo->uiSigCol);
+        uiSigCG = 0;
+        for( idx=0; idx<4; idx++ ) {
+            uiSigCG |= (UInt64)(((uiSigLine >> (2*idx)) & 3) != 0) << idx;
+        }
     }
-    else if( nLog2Size == 5 ) {
-      scanCG = g_sigLastScanCG32x32;
+    else {
+        uiSigCG = pInfo->uiSigCG;
     }
 
-    memset( uiSigCoeffGroupFlag, 0, sizeof(uiSigCoeffGroupFlag) );
-
-    // Find position of last coefficient
-    Int scanPosLast = -1;
-    Int iRealPos = -1;
-    Int posLast;
-    do {
-        posLast = scan[ ++scanPosLast ];
-
-        // get L1 sig map
-        UInt nPosY    = posLast >> nLog2Size;
-        UInt nPosX    = posLast - ( nPosY << nLog2Size );
-        UInt nBlkIdx  = uiNumBlkSide * (nPosY >> uiShift) + (nPosX >> uiShift);
-
-        iRealPos = nPosY * nStride + nPosX;
-
-        if( nSize == 8 && (nScanIdx == SCAN_HOR || nScanIdx == SCAN_VER) ) {
-            if( nScanIdx == SCAN_HOR ) {
-                nBlkIdx = nPosY >> 1;
-            }
-            else if( nScanIdx == SCAN_VER ) {
-                nBlkIdx = nPosX >> 1;
-            }
-        }
-
-        if( psCoef[iRealPos] ) {
-            uiSigCoeffGroupFlag[nBlkIdx] = 1;
-        }
-
-        uiNumSig -= ( psCoef[iRealPos] != 0 );
-    } while( uiNumSig > 0 );
+    // Find position of last coefficient, the last nonzero group first and then its highest bit in scan order
+    iLastScanSet = ((nSize * nSize) >> LOG2_SCAN_SET_SIZE) - 1;
+    while( iLastScanSet > 0 && !((uiSigCG >> pScanCG[iLastScanSet].ucBlkPos) & 1) ) {
+        iLastScanSet--;
+    }
+    uiSigMask = xGetSigMaskCG( puiRowSig, &pScan[iLastScanSet << LOG2_SCAN_SET_SIZE] );
+    assert( uiSigMask != 0 );
+    iLastK = xLog2( uiSigMask ) - 1;
 
     // Code position of last coefficient
-    UInt posLastY = posLast >> nLog2Size;
-    UInt posLastX = posLast - ( posLastY << nLog2Size );
-    codeLastSignificantXY( pCabac, pBS, posLastX, posLastY, nSize, bIsLuma, nScanIdx );
+    const X265_ScanPos *pLast = &pScan[(iLastScanSet << LOG2_SCAN_SET_SIZE) + iLastK];
+    codeLastSignificantXY( pCabac, pBS, pLast->ucPosX, pLast->ucPosY, nSize, bIsLuma, nScanIdx );
 
-    //===== code significance flag =====
-    UInt nBaseCoeffGroupCtx = OFF_SIG_CG_FLAG_CTX + (bIsLuma ? 0 : NUM_SIG_CG_FLAG_CTX);
-    UInt nBaseCtx = OFF_SIG_FLAG_CTX + (bIsLuma ? 0 : NUM_SIG_FLAG_CTX_LUMA);
-    
-    const Int  iLastScanSet      = scanPosLast >> LOG2_SCAN_SET_SIZE;
-    UInt uiNumOne                = 0;
-    UInt uiGoRiceParam           = 0;
-    Int  iScanPosSig             = scanPosLast;
-    Int  iSubSet;
-    
     for( iSubSet = iLastScanSet; iSubSet >= 0; iSubSet-- ) {
-        Int numNonZero = 0;
-        Int  iSubPos     = iSubSet << LOG2_SCAN_SET_SIZE;
-        uiGoRiceParam    = 0;
+        const X265_ScanPos *pPos = &pScan[iSubSet << LOG2_SCAN_SET_SIZE];
+        const UInt  nCGBlkPos   = pScanCG[iSubSet].ucBlkPos;
+        const UInt  bSigCG      = (iSubSet == iLastScanSet || iSubSet == 0 || ((uiSigCG >> nCGBlkPos) & 1));
         Int16 absCoeff[16];
         UInt32 coeffSigns = 0;
-        
-        if( iScanPosSig == scanPosLast ) {
-            absCoeff[0] = abs( psCoef[iRealPos] );
-            coeffSigns  = ( psCoef[iRealPos] < 0 );
+        Int numNonZero = 0;
+        Int k = SCAN_SET_SIZE - 1;
+
+        if( iSubSet == iLastScanSet ) {
+            const Int16 iCoef = psCoef[ pLast->ucPosY * nStride + pLast->ucPosX ];
+            absCoeff[0] = abs( iCoef );
+            coeffSigns  = ( iCoef < 0 );
             numNonZero  = 1;
-            iScanPosSig--;
-        }
-        
-        // encode significant_coeffgroup_flag
-        Int iCGBlkPos = scanCG[ iSubSet ];
-        Int iCGPosY   = iCGBlkPos / uiNumBlkSide;
-        Int iCGPosX   = iCGBlkPos - (iCGPosY * uiNumBlkSide);
-        if( nSize == 8 && (nScanIdx == SCAN_HOR || nScanIdx == SCAN_VER) ) {
-            iCGPosY = (nScanIdx == SCAN_HOR ? iCGBlkPos : 0);
-            iCGPosX = (nScanIdx == SCAN_VER ? iCGBlkPos : 0);
-        }
-        if( iSubSet == iLastScanSet || iSubSet == 0) {
-            uiSigCoeffGroupFlag[ iCGBlkPos ] = 1;
+            k           = iLastK - 1;
         }
         else {
-            UInt nSigCoeffGroup   = (uiSigCoeffGroupFlag[ iCGBlkPos ] != 0);
-            UInt nCtxSig  = getSigCoeffGroupCtxInc( uiSigCoeffGroupFlag, iCGPosX, iCGPosY, nScanIdx, nSize );
-            xCabacEncodeBin( pCabac, pBS, nSigCoeffGroup, nBaseCoeffGroupCtx + nCtxSig );
+            // encode significant_coeffgroup_flag
+            if( iSubSet != 0 ) {
+                xCabacEncodeBin( pCabac, pBS, bSigCG, nBaseCoeffGroupCtx + ((uiSigCG & pScanCG[iSubSet].uiNeighbour) != 0) );
+            }
+            uiSigMask = (bSigCG ? xGetSigMaskCG( puiRowSig, pPos ) : 0);
         }
-        
+
         // encode significant_coeff_flag
-        if( uiSigCoeffGroupFlag[ iCGBlkPos ] ) {
-            UInt nBlkPos, nPosY, nPosX, nSig, nCtxSig;
-            UInt nRealBlkPos;
-            for( ; iScanPosSig >= iSubPos; iScanPosSig-- ) {
-                nBlkPos     = scan[ iScanPosSig ]; 
-                nPosY       = nBlkPos >> nLog2Size;
-                nPosX       = nBlkPos - ( nPosY << nLog2Size );
-                nRealBlkPos = nPosY * nStride + nPosX;
-                nSig        = (psCoef[ nRealBlkPos ] != 0);
-                if( (iScanPosSig != iSubPos) || iSubSet == 0 || numNonZero ) {
-                    nCtxSig  = getSigCtxInc( psCoef, nPosX, nPosY, blockType, nSize, bIsLuma );
+        if( bSigCG ) {
+            for( ; k >= 0; k-- ) {
+                const UInt nSig = (uiSigMask >> k) & 1;
+
+                if( k != 0 || iSubSet == 0 || numNonZero ) {
+                    const UInt nPosX = pPos[k].ucPosX;
+                    const UInt nPosY = pPos[k].ucPosY;
+                    UInt nCtxSig = pPos[k].ucCtx[bIsLuma];
+
+                    if( nCtxSig & SIG_CTX_COUNT ) {
+                        const UInt32 uiRow0 = (puiRowSig[nPosY    ] >> nPosX) >> 1;
+                        const UInt32 uiRow1 =  puiRowSig[nPosY + 1] >> nPosX;
+                        const UInt32 uiRow2 =  puiRowSig[nPosY + 2] >> nPosX;
+                        UInt cnt = (uiRow0 & 1) + ((uiRow0 >> 1) & 1) + ((uiRow1 >> 1) & 1);
+
+                        if( nCtxSig & SIG_CTX_BELOW ) {
+                            cnt += (uiRow1 & 1);
+                        }
+                        if( cnt < 4 ) {
+                            cnt += (uiRow2 & 1);
+                        }
+                        nCtxSig = (nCtxSig & SIG_CTX_MASK) + ((cnt + 1) >> 1);
+                    }
                     xCabacEncodeBin( pCabac, pBS, nSig, nBaseCtx + nCtxSig );
                 }
                 if( nSig ) {
-                    absCoeff[numNonZero] = abs( psCoef[nRealBlkPos] );
-                    coeffSigns = (coeffSigns << 1) + ( psCoef[nRealBlkPos] < 0 );
+                    const Int16 iCoef = psCoef[ pPos[k].ucPosY * nStride + pPos[k].ucPosX ];
+                    absCoeff[numNonZero] = abs( iCoef );
+                    coeffSigns = (coeffSigns << 1) + ( iCoef < 0 );
                     numNonZero++;
                 }
             }
         }
-        else {
-            iScanPosSig = iSubPos - 1;
-        }
-        
+
         if( numNonZero > 0 ) {
             UInt c1 = 1;
             UInt uiCtxSet = (iSubSet > 0 && bIsLuma) ? 2 : 0;
-            
+            UInt uiGoRiceParam = 0;
+            UInt64 uiQueue = 0;
+            Int    nQueue  = 0;
+
             if( uiNumOne > 0 ) {
                 uiCtxSet++;
             }
-            
+
             uiNumOne       >>= 1;
             UInt nBaseCtxMod = OFF_ONE_FLAG_CTX + 4 * uiCtxSet + ( bIsLuma ? 0 : NUM_ONE_FLAG_CTX_LUMA);
-            
+
             Int numC1Flag = MIN(numNonZero, C1FLAG_NUMBER);
             Int firstC2FlagIdx = 16;
             for( idx = 0; idx < numC1Flag; idx++ ) {
@@ -433,7 +719,8 @@ void xEncodeCoeffNxN( X265_Cabac *pCabac, X265_BitStream *pBS, Int16 *psCoef, UI
                 }
             }
 
-            xCabacEncodeBinsEP( pCabac, pBS, coeffSigns, numNonZero );
+            // The signs and the remainders are all bypass, code them by 32 bins
+            xQueueBinsEP( pCabac, pBS, uiQueue, nQueue, coeffSigns, numNonZero );
 
             Int iFirstCoeff2 = 1;    
             if( c1 == 0 || numNonZero > C1FLAG_NUMBER ) {
@@ -441,7 +728,14 @@ void xEncodeCoeffNxN( X265_Cabac *pCabac, X265_BitStream *pBS, Int16 *psCoef, UI
                     Int baseLevel = (idx < C1FLAG_NUMBER) ? (2 + iFirstCoeff2 ) : 1;
                     
                     if( absCoeff[ idx ] >= baseLevel ) {
-                        xWriteGoRiceExGolomb( pCabac, pBS, absCoeff[ idx ] - baseLevel, uiGoRiceParam ); 
+                        UInt auiBins[2];
+                        Int  anBins[2];
+                        UInt i, n;
+
+                        n = xGoRiceExGolombBins( absCoeff[ idx ] - baseLevel, uiGoRiceParam, auiBins, anBins );
+                        for( i=0; i<n; i++ ) {
+                            xQueueBinsEP( pCabac, pBS, uiQueue, nQueue, auiBins[i], anBins[i] );
+                        }
 #if SIMPLE_PARAM_UPDATE
                     if(absCoeff[idx] > 3*(1<<uiGoRiceParam))
                         uiGoRiceParam = MIN(uiGoRiceParam+ 1, 4);
@@ -453,6 +747,7 @@ void xEncodeCoeffNxN( X265_Cabac *pCabac, X265_BitStream *pBS, Int16 *psCoef, UI
                     }
                 }        
             }
+            xCabacEncodeBinsEP( pCabac, pBS, (UInt)uiQueue, nQueue );
         }
         else {
             uiNumOne >>= 1;
@@ -471,10 +766,10 @@ UInt getCtxQtCbf( UInt bLuma )
     }
 }
 
-void xWriteCU( X265_t *h, UInt nDepth, UInt bLastCU )
+/// write the CU with pCabac, a count only pCabac estimate the bits of it and write nothing
+void xWriteCU( X265_t *h, X265_Cabac *pCabac, UInt nDepth, UInt bLastCU )
 {
     X265_BitStream *pBS         = &h->bs;
-    X265_Cabac     *pCabac      = &h->cabac;
     X265_Cache     *pCache      = &h->cache;
     UInt8          *pucMostModeY= pCache->ucMostModeY;
     UInt8          *pCbf        = pCache->bCbf;
@@ -546,6 +841,9 @@ void xWriteCU( X265_t *h, UInt nDepth, UInt bLastCU )
         xCabacEncodeBin( pCabac, pBS, (nModeC != NUM_CHROMA_MODE - 1), OFF_CHROMA_PRED_CTX );
         if ( nModeC != NUM_CHROMA_MODE - 1 ) {
             // Non DM_CHROMA_IDX
+            if( h->bUseLMChroma ) {
+                xCabacEncodeBin( pCabac, pBS, (nModeC != NUM_CHROMA_MODE - 2), OFF_CHROMA_PRED_CTX + 1 );
+            }
             if( nModeC < NUM_CHROMA_MODE - 2 ) {
                 xCabacEncodeBinsEP( pCabac, pBS, nModeC, 2 );
             }
@@ -566,13 +864,13 @@ void xWriteCU( X265_t *h, UInt nDepth, UInt bLastCU )
 
         // Coeff
         if(pCbf[0]) {
-            xEncodeCoeffNxN( pCabac, pBS, pCache->psCoefY, nCUWidth,   nDepth, TRUE,  nModeYBak );
+            xEncodeCoeffNxN( pCabac, pBS, pCache->psCoefY, &pCache->sCoefInfo[0], nCUWidth,   nDepth, TRUE,  nModeYBak );
         }
         if(pCbf[1]) {
-            xEncodeCoeffNxN( pCabac, pBS, pCache->psCoefU, nCUWidth/2, nDepth, FALSE, 0         );
+            xEncodeCoeffNxN( pCabac, pBS, pCache->psCoefU, &pCache->sCoefInfo[1], nCUWidth/2, nDepth, FALSE, 0         );
         }
         if(pCbf[2]) {
-            xEncodeCoeffNxN( pCabac, pBS, pCache->psCoefV, nCUWidth/2, nDepth, FALSE, 0         );
+            xEncodeCoeffNxN( pCabac, pBS, pCache->psCoefV, &pCache->sCoefInfo[2], nCUWidth/2, nDepth, FALSE, 0         );
         }
 
         // FinishCU
@@ -584,37 +882,320 @@ void xWriteCU( X265_t *h, UInt nDepth, UInt bLastCU )
     }
 }
 
-Int32 xEncEncode( X265_t *h, X265_Frame *pFrame, UInt8 *pucOutBuf, UInt32 uiBufSize )
+/// estimated bits of the current CU in 1/(1 << CABAC_FRAC_BITS) unit, h->cabac is rolled back after it
+UInt32 xEncEstimateCUBits( X265_t *h, UInt nDepth )
+{
+    X265_Cabac        *pCabac = &h->cabac;
+    X265_CabacSnapshot snap;
+    UInt32             uiBits;
+
+    xCabacSave( &snap, pCabac, &h->bs, CTX_CU_BEGIN, CTX_CU_END );
+    xCabacResetCount( pCabac );
+    xWriteCU( h, pCabac, nDepth, FALSE );
+    uiBits = xCabacGetFracBits( pCabac );
+    xCabacRestore( pCabac, &h->bs, &snap );
+    return uiBits;
+}
+
+/// encode the CTU row at y, with the WPP the row wait for the row above before every CTU
+void xEncEncodeRow( X265_t *h, UInt y )
 {
     const UInt32    uiWidth     = h->usWidth;
-    const UInt32    uiHeight    = h->usHeight;
     const UInt32    nMaxCuWidth = h->ucMaxCUWidth;
-    X265_Cabac     *pCabac      = &h->cabac;
-    X265_BitStream *pBS         = &h->bs;
+    const UInt      nCols       = uiWidth / nMaxCuWidth;
+    const UInt      nRow        = y / nMaxCuWidth;
+    const UInt32    uiX0        = MAX( (MAX( h->uiSliceBegin, nRow * nCols ) - nRow * nCols) * nMaxCuWidth, h->uiTileX0 );
+    const UInt32    uiX1        = MIN( (MIN( h->uiSliceEnd, (nRow + 1) * nCols ) - nRow * nCols) * nMaxCuWidth, h->uiTileX1 );
+          X265_t   *pAbove      = (h->bUseWPP && nRow > 0 ? h->pMain->pRows[nRow - 1] : NULL);
     X265_Cache     *pCache      = &h->cache;
           Int       nQP         = h->iQP;
           Int       nQPC        = g_aucChromaScale[nQP];
-    const Int32     lambda      = nQP;
-          UInt8    *pucMostModeY= pCache->ucMostModeY;
           UInt8    *pCbf        = pCache->bCbf;
           UInt8    *pucPixY     = pCache->pucPixY;
           UInt8    *pucRecY     = pCache->pucRecY;
           UInt8    *pucPredY    = pCache->pucPredY;
           UInt8    *pucPixC[2]  = { pCache->pucPixU, pCache->pucPixV };
           UInt8    *pucRecC[2]  = { pCache->pucRecU, pCache->pucRecV };
-          UInt8    *pucPredC[2] = { pCache->pucPredC[0], pCache->pucPredC[1] };
+          UInt8    *pucPredC[3] = { pCache->pucPredC[0], pCache->pucPredC[1], pCache->pucPredC[2] };
           Int16    *piTmp0      = pCache->piTmp[0];
           Int16    *piTmp1      = pCache->piTmp[1];
           Int16    *piCoefY     = pCache->psCoefY;
           Int16    *piCoefC[2]  = { pCache->psCoefU, pCache->psCoefV };
+          X265_CoeffInfo *pInfoY      = &pCache->sCoefInfo[0];
+          X265_CoeffInfo *pInfoC[2]   = { &pCache->sCoefInfo[1], &pCache->sCoefInfo[2] };
           UInt8    *pucMostModeC= pCache->ucMostModeC;
           UInt      realModeC;
-    UInt x, y;
+    UInt x;
     UInt i;
     UInt32 uiSumY, uiSumC[2];
-    #ifdef CHECK_SEI
-    UInt nOffsetSEI = 0;
-    #endif
+
+    h->uiCUY = y;
+    xEncCahceInitLine( h, y );
+    pCache->uiOffset = uiX0;
+    for( x=uiX0; x < uiX1; x+=nMaxCuWidth ) {
+        const UInt   bLastCU     = (nRow * nCols + x / nMaxCuWidth == h->uiSliceEnd - 1);
+        const UInt   nCUSize     = h->ucMaxCUWidth;
+        const UInt   nLog2CUSize = xLog2(nCUSize-1);
+        xSad        *pxCostC     = (h->bUseSATD ? h->pPrim->xSatdN : h->pPrim->xSadN)[nLog2CUSize-2-1];
+        UInt32 uiBestSadY, uiBestSadC;
+        UInt   nBestModeY, nBestModeC;
+        UInt   nMode;
+
+        // Stage 0: Init internal
+        h->uiCUX = x;
+
+        // Stage 0b: WPP, wait the top right CTU, the first CTU start from the contexts of the row above
+        if( pAbove != NULL ) {
+            xEncWaitRow( pAbove, MIN( x / nMaxCuWidth + 2, nCols ) );
+            if( x == 0 && nCols >= 2 ) {
+                memcpy( h->cabac.contextModels, pAbove->aucCtxWPP, sizeof(h->aucCtxWPP) );
+            }
+            xEncCacheLoadTop( h, pAbove, x );
+        }
+
+        #if (CHECK_TV)
+        tGetVector();
+        #endif
+
+        // Stage 1a: Load image to cache
+        xEncCacheLoadCU( h, x, y );
+        #if (CHECK_TV)
+        // Check Y
+        {
+            UInt x, y;
+            for( y=0; y<nCUSize; y++ ) {
+                for( x=0; x<nCUSize; x++ ) {
+                    if( pCache->pucPixY[y * MAX_CU_SIZE + x] != tv_orig[y * MAX_CU_SIZE + x] ) {
+                        fprintf( stderr, "Orig Pixel Y Wrong, (%d,%d), %02X -> %02X\n", y, x, tv_orig[y * MAX_CU_SIZE + x], pCache->pucPixY[y * MAX_CU_SIZE + x] );
+                        abort();
+                    }
+                }
+            }
+        }
+        // Check U and V
+        {
+            UInt x, y;
+            for( y=0; y<nCUSize/2; y++ ) {
+                for( x=0; x<nCUSize/2; x++ ) {
+                    if( pCache->pucPixU[y * MAX_CU_SIZE/2 + x] != tv_origC[0][y * MAX_CU_SIZE/2 + x] ) {
+                        fprintf( stderr, "Orig Pixel U Wrong, (%d,%d), %02X -> %02X\n", y, x, tv_origC[0][y * MAX_CU_SIZE/2 + x], pCache->pucPixY[y * MAX_CU_SIZE/2 + x] );
+                        abort();
+                    }
+                    if( pCache->pucPixV[y * MAX_CU_SIZE/2 + x] != tv_origC[1][y * MAX_CU_SIZE/2 + x] ) {
+                        fprintf( stderr, "OrigC Pixel V Wrong, (%d,%d), %02X -> %02X\n", y, x, tv_origC[1][y * MAX_CU_SIZE/2 + x], pCache->pucPixY[y * MAX_CU_SIZE/2 + x] );
+                        abort();
+                    }
+                }
+            }
+        }
+        #endif
+
+        // Stage 1b: Load Intra PU Reference Samples
+        // TODO: ASSUME one PU only
+        xEncIntraLoadRef( h, 0, 0, h->ucMaxCUWidth );
+
+        // Stage 2a: Decide Intra Luma
+        // TODO: Support more size
+        nBestModeY = xEncIntraSearchLuma( h, nCUSize, &uiBestSadY );
+        #if (CHECK_TV)
+        if( nBestModeY != tv_bestmode ) {
+            printf( " BestMode %d -> %d Failed!\n", tv_bestmode, nBestModeY );
+            abort();
+        }
+        #endif
+
+        // Stage 3a: Encode CU Luma, the prediction is kept by the mode search
+        pCache->nBestModeY = nBestModeY;
+        h->pPrim->xSubDct( piTmp0,
+                              pucPixY,
+                              pucPredY, MAX_CU_SIZE,
+                              piTmp0, piTmp1,
+                              nCUSize, nCUSize, nBestModeY );
+        uiSumY = h->pPrim->xQuant( piCoefY, piTmp0, MAX_CU_SIZE, nQP, nCUSize, nCUSize, SLICE_I, pInfoY );
+        pCbf[0] = (uiSumY != 0);
+
+        // Stage 3b: Decode CU Luma
+        if( uiSumY ) {
+            h->pPrim->xDeQuant( piTmp0, piCoefY, MAX_CU_SIZE, nQP, nCUSize, nCUSize, SLICE_I );
+            h->pPrim->xIDctAdd( pucRecY,
+                                   piTmp0,
+                                   pucPredY, MAX_CU_SIZE,
+                                   piTmp1, piTmp0,
+                                   nCUSize, nCUSize, nBestModeY,
+                                   pInfoY->nLastX, pInfoY->nLastY );
+        }
+        else {
+            for( i=0; i<nCUSize; i++ ) {
+                memcpy( &pucRecY[i*MAX_CU_SIZE], &pucPredY[i*MAX_CU_SIZE], nCUSize );
+            }
+        }
+
+        // Stage 2b: Decide Intra Chroma, after the luma reconstruct since LM predict from it
+        if( h->bUseLMChroma ) {
+            xPredIntraLMRef( pCache->pucPixRef[0], pCache->pucPixRefLM, nCUSize >> 1 );
+            h->pPrim->xDownSampleLM( pucPredC[2], MAX_CU_SIZE/2, pucRecY, MAX_CU_SIZE, nCUSize >> 1 );
+        }
+
+        // GetAllowedChromaMode
+        pucMostModeC[0] = PLANAR_IDX;
+        pucMostModeC[1] = VER_IDX;
+        pucMostModeC[2] = HOR_IDX;
+        pucMostModeC[3] = DC_IDX;
+        pucMostModeC[4] = LM_CHROMA_IDX;
+        pucMostModeC[5] = nBestModeY;
+        for( i=0;i<4; i++ ) {
+            if( pucMostModeC[i] == nBestModeY ) {
+                pucMostModeC[i] = 34;
+                break;
+            }
+        }
+
+        uiBestSadC = MAX_SAD;
+        for( nMode=0; nMode<NUM_CHROMA_MODE; nMode++ ) {
+            UInt32 uiSumSad;
+            UInt32 uiSad[2];
+            realModeC = pucMostModeC[nMode];
+
+            if ( realModeC == LM_CHROMA_IDX && !h->bUseLMChroma )
+                continue;
+
+            #if (CHECK_TV)
+            memset( pCache->pucPredC, 0xCD, sizeof(pCache->pucPredC) );
+            #endif
+
+            xEncIntraPredChroma( h, realModeC, nCUSize >> 1 );
+
+            #if (CHECK_TV)
+            {
+                UInt x, y;
+                for( y=0; y<nCUSize/2; y++ ) {
+                    for( x=0; x<nCUSize/2; x++ ) {
+                        if( pucPredC[0][y * MAX_CU_SIZE/2 + x] != tv_predC[0][nMode][y * MAX_CU_SIZE/2 + x] ) {
+                            fprintf( stderr, "Intra Pred U Wrong, Mode %d at (%d,%d), %02X -> %02X\n", nMode, y, x, tv_predC[0][nMode][y*nCUSize+x], pCache->pucPredC[0][y * MAX_CU_SIZE/2 + x] );
+                            //abort();
+                            goto _exit;
+                        }
+                        if( pucPredC[1][y * MAX_CU_SIZE/2 + x] != tv_predC[1][nMode][y * MAX_CU_SIZE/2 + x] ) {
+                            fprintf( stderr, "Intra Pred V Wrong, Mode %d at (%d,%d), %02X -> %02X\n", nMode, y, x, tv_predC[1][nMode][y*nCUSize+x], pCache->pucPredC[1][y * MAX_CU_SIZE/2 + x] );
+                            //abort();
+                            goto _exit;
+                        }
+                    }
+                }
+_exit:;
+            }
+            #endif
+            uiSad[0] = pxCostC(
+                        nCUSize / 2,
+                        pucPixC[0], MAX_CU_SIZE/2,
+                        pucPredC[0], MAX_CU_SIZE/2
+                    );
+
+            uiSad[1] = pxCostC(
+                        nCUSize / 2,
+                        pucPixC[1], MAX_CU_SIZE/2,
+                        pucPredC[1], MAX_CU_SIZE/2
+                    );
+
+            #if (CHECK_TV)
+            assert( uiSad[0] == tv_sadC[0][nMode] );
+            assert( uiSad[1] == tv_sadC[1][nMode] );
+            #endif
+
+            uiSumSad = uiSad[0] + uiSad[1];
+            if( uiSumSad < uiBestSadC ) {
+                uiBestSadC = uiSumSad;
+                nBestModeC = nMode;
+            }
+        }
+        realModeC = pucMostModeC[nBestModeC];
+        #if (CHECK_TV)
+        {
+            // Check Chroma Mode and Sad
+            assert( uiBestSadC == tv_BestSadC );
+            assert( (nBestModeC == NUM_CHROMA_MODE-1 && realModeC == tv_bestmode) || (pucMostModeC[nBestModeC] == tv_bestmodeC) );
+            tv_nModeC = nBestModeC;
+        }
+        #endif
+
+        // Stage 3a: Encode CU Chroma
+        pCache->nBestModeC = nBestModeC;
+        xEncIntraPredChroma( h, realModeC, nCUSize >> 1 );
+        for( i=0; i<2; i++ ) {
+            #if (CHECK_TV)
+            tv_nIdxC = i;
+            #endif
+            h->pPrim->xSubDct( piTmp0,
+                                  pucPixC[i],
+                                  pucPredC[i], MAX_CU_SIZE/2,
+                                  piTmp0, piTmp1,
+                                  nCUSize/2, nCUSize/2, realModeC );
+            uiSumC[i] = h->pPrim->xQuant( piCoefC[i], piTmp0, MAX_CU_SIZE/2, nQPC, nCUSize/2, nCUSize/2, SLICE_I, pInfoC[i] );
+        }
+        pCbf[1] = (uiSumC[0] != 0);
+        pCbf[2] = (uiSumC[1] != 0);
+
+        // Stage 3b: Decode CU Chroma
+        for( i=0; i<2; i++ ) {
+            #if (CHECK_TV)
+            tv_nIdxC = i;
+            #endif
+            if( uiSumC[i] ) {
+                h->pPrim->xDeQuant( piTmp0, piCoefC[i], MAX_CU_SIZE/2, nQPC, nCUSize/2, nCUSize/2, SLICE_I );
+                h->pPrim->xIDctAdd( pucRecC[i],
+                                       piTmp0,
+                                       pucPredC[i], MAX_CU_SIZE/2,
+                                       piTmp1, piTmp0,
+                                       nCUSize/2, nCUSize/2, realModeC,
+                                       pInfoC[i]->nLastX, pInfoC[i]->nLastY );
+            }
+            else {
+                UInt k;
+                for( k=0; k<nCUSize/2; k++ ) {
+                    memcpy( &pucRecC[i][k*MAX_CU_SIZE/2], &pucPredC[i][k*MAX_CU_SIZE/2], nCUSize/2 );
+                }
+            }
+        }
+
+        // Stage 4: Write CU
+        xWriteCU( h, &h->cabac, 0, bLastCU );
+
+        // Stage 5a: Update reconstr
+        xEncCacheStoreCU( h, x, y );
+
+        // Stage 5b: Update context
+        xEncCacheUpdate( h, 0, 0, nCUSize, nCUSize );
+        pCache->uiOffset += nCUSize;
+
+        // Stage 6: WPP, save the contexts after the second CTU and report the progress to the row below
+        if( h->bUseWPP ) {
+            if( x == nMaxCuWidth ) {
+                memcpy( h->aucCtxWPP, h->cabac.contextModels, sizeof(h->aucCtxWPP) );
+            }
+            xEncPostRow( h );
+        }
+
+        #if (CHECK_TV)
+        printf( "CU(%2d,%2d) Passed!\n", y/h->ucMaxCUWidth, x/h->ucMaxCUWidth );
+        #endif
+    }
+
+    // The slices and the tiles finish the rows in any order, the rows are hashed in order as soon as they are complete
+    if( h->ucHashSEI != HASH_NONE && (h->ucSliceMode != SLICE_MODE_NONE || h->nTiles > 1) && uiX1 > uiX0 ) {
+        xEncHashRow( h, nRow, (uiX1 - uiX0) / nMaxCuWidth );
+    }
+}
+
+Int32 xEncEncode( X265_t *h, X265_Frame *pFrame, UInt8 *pucOutBuf, UInt32 uiBufSize )
+{
+    const UInt32    uiHeight    = h->usHeight;
+    const UInt32    nMaxCuWidth = h->ucMaxCUWidth;
+    X265_Cabac     *pCabac      = &h->cabac;
+    X265_BitStream *pBS         = &h->bs;
+    UInt y;
+    UInt i;
+    UInt32 uiOffsetSEI = 0;
+    Int32  iLength;
 
     /// Copy to local
     h->pFrameCur = pFrame;
@@ -624,352 +1205,530 @@ Int32 xEncEncode( X265_t *h, X265_Frame *pFrame, UInt8 *pucOutBuf, UInt32 uiBufS
     h->iPoc++;
     xBitStreamInit( pBS, pucOutBuf, uiBufSize );
 
+    /// The raw RBSP of a NAL is never larger than the output
+    if( h->bUseRawRBSP && h->uiRBSPSize < uiBufSize ) {
+        if( h->pucRBSP != NULL )
+            FREE( h->pucRBSP );
+        h->pucRBSP = (UInt8 *)MALLOC( uiBufSize );
+        assert( h->pucRBSP != NULL );
+        h->uiRBSPSize = uiBufSize;
+    }
+
     /// Write SPS Header
     xPutBits32(pBS, 0x01000000);
     xPutBits(pBS, 0x47, 8);
     xPutBits(pBS, 0x01, 8); // temporal_id and reserved_one_5bits
+    xWriteNalBegin(h);
     xWriteSPS(h);
-    xBitFlush(pBS);
+    xWriteNalEnd(h);
 
     /// Write PPS Header
     xPutBits32(pBS, 0x01000000);
     xPutBits(pBS, 0x48, 8);
     xPutBits(pBS, 0x01, 8); // temporal_id and reserved_one_5bits
+    xWriteNalBegin(h);
     xWritePPS(h);
-    xBitFlush(pBS);
-
-    #ifdef CHECK_SEI
-    /// Write SEI Header
-    xPutBits32(pBS, 0x06010000);
-    xPutBits(pBS, 0x01,        8); // temporal_id and reserved_one_5bits
-    xPutBits(pBS, 0xFF01,     16); // PICTURE_DIGEST
-    xPutBits(pBS, 0x11,        8); // Payload length
-    xPutBits(pBS, 0x00,        8); // Method = MD5
-    nOffsetSEI = xBitFlush(pBS);
-    xPutBits(pBS, 0xA0A1A2A3, 32);
-    xPutBits(pBS, 0xB4B5B6B7, 32);
-    xPutBits(pBS, 0xC8C9CACB, 32);
-    xPutBits(pBS, 0xDCDDDEDF, 32);
-    xWriteRBSPTrailingBits(pBS);
-    xBitFlush(pBS);
-    #endif
+    xWriteNalEnd(h);
+
+    /// Write SEI, the digest is hashed row by row and filled after the frame is done
+    if( h->ucHashSEI != HASH_NONE ) {
+        uiOffsetSEI = xWriteSEIPictureDigest( h );
+        xPictureHashInit( h );
+    }
 
-    /// Write Silces Header
+    /// Write Silces
     // FIX_ME: the HM-6.1 can't decoder my IDR only stream,
     //         they want CDR, so I do this chunk
-    xPutBits32(pBS, (h->iPoc == 0 ? 0x45010000 : 0x41010000));
-    xPutBits(pBS, 0x01, 8); // temporal_id and reserved_one_5bits
-    xWriteSliceHeader(h);
+    if( h->ucSliceMode != SLICE_MODE_NONE ) {
+        // Every slice is a NAL, its RBSP have the emulation prevention already
+        xEncEncodeSlices( h );
+        for( i=0; i < h->nSlices; i++ ) {
+            const X265_t *pSlice = h->pSlices[i];
+            xPutBits32(pBS, (h->iPoc == 0 ? 0x45010000 : 0x41010000));
+            xPutBits(pBS, 0x01, 8); // temporal_id and reserved_one_5bits
+            xBitFlush(pBS);
+            memcpy( pBS->pucBits, pSlice->pucSubStream[1], pSlice->uiSubStreamLen );
+            pBS->pucBits += pSlice->uiSubStreamLen;
+        }
+    }
+    else {
+        xPutBits32(pBS, (h->iPoc == 0 ? 0x45010000 : 0x41010000));
+        xPutBits(pBS, 0x01, 8); // temporal_id and reserved_one_5bits
+        xWriteNalBegin(h);
+
+        /// Encode loop
+        if( h->bUseWPP || h->nTiles > 1 ) {
+            X265_t * const *pSubStreams = (h->bUseWPP ? h->pRows : h->pTiles);
+            const UInt nSubStreams = (h->bUseWPP ? uiHeight / nMaxCuWidth : h->nTiles);
+
+            // The entry points in the header need the size of every substream
+            if( h->bUseWPP )
+                xEncEncodeWPP( h );
+            else
+                xEncEncodeTiles( h );
+            xWriteSliceHeader(h);
+            xWriteNalEnd( h );
+
+            // The substreams have the emulation prevention already, the byte before each of them is non-zero
+            for( i=0; i < nSubStreams; i++ ) {
+                const X265_t *pSub = pSubStreams[i];
+                memcpy( pBS->pucBits, pSub->pucSubStream[1], pSub->uiSubStreamLen );
+                pBS->pucBits += pSub->uiSubStreamLen;
+            }
+        }
+        else {
+            xWriteSliceHeader(h);
+            xEncCahceInit( h );
+            xCabacInit( h );
+            xCabacReset( &h->cabac );
+            for( y=0; y < uiHeight; y+=nMaxCuWidth ) {
+                xEncEncodeRow( h, y );
+            }
+            xCabacFlush( pCabac, pBS );
+            xWriteSliceEnd( h );
+            xWriteNalEnd( h );
+        }
+    }
+    iLength = xBitFlush( pBS );
+
+    if( h->ucHashSEI != HASH_NONE ) {
+        iLength = xPatchSEIPictureDigest( h, pucOutBuf, uiOffsetSEI, iLength );
+    }
+
+    #ifdef WRITE_REC
+    // Save Restruct
+    {
+        static FILE *fpx=NULL;
+        if ( fpx == NULL )
+            fpx = fopen("OX.YUV", "wb");
+        assert( fpx != NULL );
+        fwrite(h->pFrameRec->pucY, 1, h->usWidth*uiHeight*3/2, fpx);
+        fflush(fpx);
+        //fclose(fpx);
+    }
+    #endif
+
+    // Update Reference Frame Pointer
+    X265_Frame tmp = h->refn[MAX_REF_NUM];
+    for( i=MAX_REF_NUM; i>0; i-- ) {
+        h->refn[i] = h->refn[i-1];
+    }
+    h->refn[0] = tmp;
 
-    /// Encode loop
+    return iLength;
+}
+
+// ***************************************************************************
+// * Frame Parallel Functions
+// ***************************************************************************
+/// frame job of the pool, the frame is encoded by a context not in flight
+static void xEncFrameJob( void *pArg, UInt nFrame )
+{
+    X265_t *h = (X265_t *)pArg;
+    X265_t *pCtx;
+    UInt nCtx;
+    Int32 iLength;
+
+    // There are never more frames in flight than the contexts
+    xMutexLock( &h->mutexFrame );
+    assert( h->uiFrameCtxFree != 0 );
+    for( nCtx=0; !(h->uiFrameCtxFree & (1 << nCtx)); nCtx++ )
+        ;
+    h->uiFrameCtxFree &= ~(1 << nCtx);
+    xMutexUnlock( &h->mutexFrame );
+    pCtx = h->pFrameCtx[nCtx];
+
+    // The POC is known already, xEncEncode() increase it first
+    pCtx->eSliceType = h->eSliceType;
+    pCtx->iPoc       = h->iPoc + nFrame;
+    pCtx->iQP        = h->iQP;
+    iLength = xEncEncode( pCtx, &h->pFrameJobs[nFrame], pCtx->pucFrameOut, pCtx->uiFrameOutSize );
+    if( h->puiFrameJobLen != NULL )
+        h->puiFrameJobLen[nFrame] = iLength;
+
+    // Write out in the input order, the frames before this one are taken already so they are running
+    xMutexLock( &h->mutexFrame );
+    while( h->nFrameOut != nFrame ) {
+        xCondWait( &h->condFrame, &h->mutexFrame );
+    }
+    assert( h->uiFrameOutLen + iLength <= h->uiFrameOutSize );
+    memcpy( h->pucFrameOut + h->uiFrameOutLen, pCtx->pucFrameOut, iLength );
+    h->uiFrameOutLen += iLength;
+    h->nFrameOut++;
+    h->uiFrameCtxFree |= (1 << nCtx);
+    xCondBroadcast( &h->condFrame );
+    xMutexUnlock( &h->mutexFrame );
+}
+
+/// encode nFrames frames into pucOutBuf in the input order, return the total size
+/// with ucFrameThreads > 1 the frames are encoded concurrently, every picture must be an I slice
+/// the size of every frame go to puiFrameLen when it isn't NULL
+Int32 xEncEncodeFrames( X265_t *h, X265_Frame *pFrames, UInt nFrames, UInt8 *pucOutBuf, UInt32 uiBufSize, UInt32 *puiFrameLen )
+{
+    UInt32 uiLength = 0;
+    Int32  iLength;
+    UInt i;
+
+    if( h->ucFrameThreads <= 1 || nFrames <= 1 ) {
+        for( i=0; i<nFrames; i++ ) {
+            iLength = xEncEncode( h, &pFrames[i], pucOutBuf + uiLength, uiBufSize - uiLength );
+            if( puiFrameLen != NULL )
+                puiFrameLen[i] = iLength;
+            uiLength += iLength;
+        }
+        return uiLength;
+    }
+
+    // The frames depend on each other when there is inter
+    assert( h->eSliceType == SLICE_I );
+
+    h->pFrameJobs       = pFrames;
+    h->puiFrameJobLen   = puiFrameLen;
+    h->uiFrameCtxFree   = (1 << h->ucFrameThreads) - 1;
+    h->nFrameOut        = 0;
+    h->pucFrameOut      = pucOutBuf;
+    h->uiFrameOutSize   = uiBufSize;
+    h->uiFrameOutLen    = 0;
+    xPoolRun( h->pPool, xEncFrameJob, h, nFrames, h->ucFrameThreads );
+
+    h->iPoc += nFrames;
+    return h->uiFrameOutLen;
+}
+
+// ***************************************************************************
+// * Async Functions
+// ***************************************************************************
+/// hand the access unit over to pfnOutput or xEncReceive(), pucAU is NULL at the end of the stream
+/// return FALSE when the output queue is full and xEncFree() is waiting
+static UInt xEncAsyncDeliver( X265_t *h, const UInt8 *pucAU, UInt32 uiLength )
+{
+    X265_Queue *pOut = &h->queueOut;
+    UInt32     *puiLength;
+    UInt8      *pucSlot;
+
+    if( h->pfnOutput != NULL ) {
+        h->pfnOutput( h->pOutputArg, pucAU, uiLength );
+        return TRUE;
+    }
+
+    // The pipeline stall here while the receiver is behind, and the submitter stall on the input queue in turn
+    if( !xQueueWait( pOut, TRUE, &h->uiAsyncAbort ) )
+        return FALSE;
+    pucSlot = xQueueSlot( pOut, pOut->uiTail, &puiLength );
+    if( pucAU != NULL ) {
+        assert( uiLength != 0 && uiLength <= pOut->uiSlotSize );
+        memcpy( pucSlot, pucAU, uiLength );
+    }
+    *puiLength = (pucAU != NULL ? uiLength : 0);
+    xQueuePush( pOut );
+    return TRUE;
+}
+
+/// the pipeline thread, it encode the frames waiting in the input queue as one batch of xEncEncodeFrames()
+static void *xEncAsyncThread( void *pArg )
+{
+    X265_t         *h       = (X265_t *)pArg;
+    X265_Queue     *pIn     = &h->queueIn;
+    const UInt32    uiYSize = h->usWidth * h->usHeight;
+    X265_Frame      frames[MAX_FRAME_THREADS];
+    UInt32          auiLength[MAX_FRAME_THREADS];
+    UInt32         *puiLength;
+    UInt8          *pucSlot;
+    UInt32          uiOffset;
+    UInt            nFrames;
+    UInt            bEnd = FALSE;
+    UInt            i;
+
+    while( !bEnd ) {
+        if( !xQueueWait( pIn, FALSE, &h->uiAsyncAbort ) )
+            return NULL;
+
+        // The frames stay in their slots until the batch is done, the batch stop at the end of the stream
+        nFrames = MIN( xQueueCount( pIn ), MAX( h->ucFrameThreads, 1u ) );
+        for( i=0; i<nFrames; i++ ) {
+            pucSlot = xQueueSlot( pIn, pIn->uiHead + i, &puiLength );
+            if( *puiLength == 0 ) {
+                bEnd = TRUE;
+                break;
+            }
+            frames[i].pucY = pucSlot;
+            frames[i].pucU = pucSlot + uiYSize;
+            frames[i].pucV = pucSlot + uiYSize * 5 / 4;
+        }
+        nFrames = i;
+
+        xEncEncodeFrames( h, frames, nFrames, h->pucAsyncOut, h->uiAsyncOutSize, auiLength );
+        xQueuePop( pIn, nFrames + bEnd );
+
+        for( i=0, uiOffset=0; i<nFrames; i++ ) {
+            if( !xEncAsyncDeliver( h, h->pucAsyncOut + uiOffset, auiLength[i] ) )
+                return NULL;
+            uiOffset += auiLength[i];
+        }
+    }
+    xEncAsyncDeliver( h, NULL, 0 );
+    return NULL;
+}
+
+/// copy pFrame into the input queue of the pipeline, NULL is the end of the stream and must be the last one
+/// return 0, or -1 when the queue is full and !bWait
+/// one thread submit and one thread receive, xEncEncode() and xEncEncodeFrames() can't be used meanwhile
+Int32 xEncSubmit( X265_t *h, X265_Frame *pFrame, UInt bWait )
+{
+    X265_Queue     *pIn     = &h->queueIn;
+    const UInt32    uiYSize = h->usWidth * h->usHeight;
+    UInt32         *puiLength;
+    UInt8          *pucSlot;
+
+    assert( h->ucAsyncDepth != 0 );
+    if( xQueueCount( pIn ) >= pIn->nSlots ) {
+        if( !bWait || !xQueueWait( pIn, TRUE, &h->uiAsyncAbort ) )
+            return -1;
+    }
+
+    pucSlot = xQueueSlot( pIn, pIn->uiTail, &puiLength );
+    if( pFrame != NULL ) {
+        memcpy( pucSlot,                   pFrame->pucY, uiYSize     );
+        memcpy( pucSlot + uiYSize,         pFrame->pucU, uiYSize / 4 );
+        memcpy( pucSlot + uiYSize * 5 / 4, pFrame->pucV, uiYSize / 4 );
+    }
+    *puiLength = (pFrame != NULL ? uiYSize * 3 / 2 : 0);
+    xQueuePush( pIn );
+    return 0;
+}
+
+/// copy the next access unit into pucOutBuf and return its size
+/// return 0 when nothing is ready and !bWait, -1 after the end of the stream
+Int32 xEncReceive( X265_t *h, UInt8 *pucOutBuf, UInt32 uiBufSize, UInt bWait )
+{
+    X265_Queue *pOut = &h->queueOut;
+    UInt32     *puiLength;
+    UInt8      *pucSlot;
+    UInt32      uiLength;
+
+    assert( h->ucAsyncDepth != 0 && h->pfnOutput == NULL );
+    if( h->bAsyncEnd )
+        return -1;
+    if( xQueueCount( pOut ) == 0 ) {
+        if( !bWait || !xQueueWait( pOut, FALSE, &h->uiAsyncAbort ) )
+            return 0;
+    }
+
+    pucSlot  = xQueueSlot( pOut, pOut->uiHead, &puiLength );
+    uiLength = *puiLength;
+    if( uiLength == 0 ) {
+        h->bAsyncEnd = TRUE;
+        xQueuePop( pOut, 1 );
+        return -1;
+    }
+    assert( uiLength <= uiBufSize );
+    memcpy( pucOutBuf, pucSlot, uiLength );
+    xQueuePop( pOut, 1 );
+    return uiLength;
+}
+
+// ***************************************************************************
+// * WPP, Slice and Tile Functions
+// ***************************************************************************
+/// wait until uiCount CTUs of the row h are done
+void xEncWaitRow( X265_t *h, UInt32 uiCount )
+{
+    X265_t *pMain = h->pMain;
+
+    xMutexLock( &pMain->mutexRow );
+    while( h->uiRowDone < uiCount ) {
+        xCondWait( &pMain->condRow, &pMain->mutexRow );
+    }
+    xMutexUnlock( &pMain->mutexRow );
+}
+
+/// one more CTU of the row h is done
+void xEncPostRow( X265_t *h )
+{
+    X265_t *pMain = h->pMain;
+
+    xMutexLock( &pMain->mutexRow );
+    h->uiRowDone++;
+    xCondBroadcast( &pMain->condRow );
+    xMutexUnlock( &pMain->mutexRow );
+}
+
+/// nCUs more CTUs of the row nRow are done, the job finishing the next row to be hashed hash it and the complete rows after it
+void xEncHashRow( X265_t *h, UInt nRow, UInt nCUs )
+{
+    X265_t *pMain = h->pMain;
+    const UInt nMaxCuWidth = pMain->ucMaxCUWidth;
+    const UInt nCols       = pMain->usWidth  / nMaxCuWidth;
+    const UInt nRows       = pMain->usHeight / nMaxCuWidth;
+
+    xMutexLock( &pMain->mutexHash );
+    pMain->ausHashCUs[nRow] += nCUs;
+    if( !pMain->bHashBusy ) {
+        pMain->bHashBusy = TRUE;
+        while( pMain->nHashRow < nRows && pMain->ausHashCUs[pMain->nHashRow] == nCols ) {
+            const UInt nHashRow = pMain->nHashRow;
+
+            // The rows done meanwhile are hashed by this loop too
+            xMutexUnlock( &pMain->mutexHash );
+            xPictureHashRow( pMain, nHashRow * nMaxCuWidth, nMaxCuWidth );
+            xMutexLock( &pMain->mutexHash );
+            pMain->nHashRow++;
+        }
+        pMain->bHashBusy = FALSE;
+    }
+    xMutexUnlock( &pMain->mutexHash );
+}
+
+/// encode the row nRow into its substream, the emulation prevention is inserted here too
+static void xEncEncodeSubStream( X265_t *pMain, UInt nRow )
+{
+    X265_t *h = pMain->pRows[nRow];
+    const UInt nRows = pMain->usHeight / pMain->ucMaxCUWidth;
+    Int32 iLength;
+
+    xBitStreamInit( &h->bs, h->pucSubStream[0], h->uiSubStreamSize );
+    h->bs.bRawRBSP = TRUE;
     xEncCahceInit( h );
     xCabacInit( h );
     xCabacReset( &h->cabac );
-    for( y=0; y < uiHeight; y+=nMaxCuWidth ) {
-        h->uiCUY = y;
-        xEncCahceInitLine( h, y );
-        for( x=0; x < uiWidth; x+=nMaxCuWidth ) {
-            const UInt   bLastCU     = (y == uiHeight - nMaxCuWidth) && (x == uiWidth - nMaxCuWidth);
-            const UInt   nCUSize     = h->ucMaxCUWidth;
-            const UInt   nLog2CUSize = xLog2(nCUSize-1);
-            UInt32 uiBestSadY, uiBestSadC;
-            UInt   nBestModeY, nBestModeC;
-            UInt   nMode;
-
-            // Stage 0: Init internal
-            h->uiCUX = x;
 
-            #if (CHECK_TV)
-            tGetVector();
-            #endif
+    xEncEncodeRow( h, nRow * h->ucMaxCUWidth );
 
-            // Stage 1a: Load image to cache
-            xEncCacheLoadCU( h, x, y );
-            #if (CHECK_TV)
-            // Check Y
-            {
-                UInt x, y;
-                for( y=0; y<nCUSize; y++ ) {
-                    for( x=0; x<nCUSize; x++ ) {
-                        if( pCache->pucPixY[y * MAX_CU_SIZE + x] != tv_orig[y * MAX_CU_SIZE + x] ) {
-                            fprintf( stderr, "Orig Pixel Y Wrong, (%d,%d), %02X -> %02X\n", y, x, tv_orig[y * MAX_CU_SIZE + x], pCache->pucPixY[y * MAX_CU_SIZE + x] );
-                            abort();
-                        }
-                    }
-                }
-            }
-            // Check U and V
-            {
-                UInt x, y;
-                for( y=0; y<nCUSize/2; y++ ) {
-                    for( x=0; x<nCUSize/2; x++ ) {
-                        if( pCache->pucPixU[y * MAX_CU_SIZE/2 + x] != tv_origC[0][y * MAX_CU_SIZE/2 + x] ) {
-                            fprintf( stderr, "Orig Pixel U Wrong, (%d,%d), %02X -> %02X\n", y, x, tv_origC[0][y * MAX_CU_SIZE/2 + x], pCache->pucPixY[y * MAX_CU_SIZE/2 + x] );
-                            abort();
-                        }
-                        if( pCache->pucPixV[y * MAX_CU_SIZE/2 + x] != tv_origC[1][y * MAX_CU_SIZE/2 + x] ) {
-                            fprintf( stderr, "OrigC Pixel V Wrong, (%d,%d), %02X -> %02X\n", y, x, tv_origC[1][y * MAX_CU_SIZE/2 + x], pCache->pucPixY[y * MAX_CU_SIZE/2 + x] );
-                            abort();
-                        }
-                    }
-                }
-            }
-            #endif
+    if( nRow == nRows - 1 ) {
+        xCabacFlush( &h->cabac, &h->bs );
+        xWriteSliceEnd( h );
+    }
+    else {
+        xWriteSubStreamEnd( h );
+    }
+    iLength = xBitFlush( &h->bs );
+    assert( (UInt32)iLength <= h->uiSubStreamSize );
+    h->uiSubStreamLen = h->pPrim->xPutRBSP( h->pucSubStream[1], h->pucSubStream[0], iLength );
+}
+
+/// encode the slice nSlice into its RBSP, the emulation prevention is inserted here too
+static void xEncEncodeSlice( X265_t *pMain, UInt nSlice )
+{
+    X265_t *h = pMain->pSlices[nSlice];
+    const UInt nCols = h->usWidth / h->ucMaxCUWidth;
+    UInt nRow;
+    Int32 iLength;
+
+    xBitStreamInit( &h->bs, h->pucSubStream[0], h->uiSubStreamSize );
+    h->bs.bRawRBSP = TRUE;
+    xWriteSliceHeader( h );
+    xEncCahceInit( h );
+    xCabacInit( h );
+    xCabacReset( &h->cabac );
+
+    for( nRow = h->uiSliceBegin / nCols; nRow * nCols < h->uiSliceEnd; nRow++ ) {
+        xEncEncodeRow( h, nRow * h->ucMaxCUWidth );
+    }
+
+    xCabacFlush( &h->cabac, &h->bs );
+    xWriteSliceEnd( h );
+    iLength = xBitFlush( &h->bs );
+    assert( (UInt32)iLength <= h->uiSubStreamSize );
+    h->uiSubStreamLen = h->pPrim->xPutRBSP( h->pucSubStream[1], h->pucSubStream[0], iLength );
+}
 
-            // Stage 1b: Load Intra PU Reference Samples
-            // TODO: ASSUME one PU only
-            xEncIntraLoadRef( h, 0, 0, h->ucMaxCUWidth );
-
-            // Stage 2a: Decide Intra
-            // TODO: Support more size
-            uiBestSadY = MAX_SAD;
-            nBestModeY = 0;
-            for( nMode=0; nMode<35; nMode++ ) {
-                UInt32 uiSad;
-
-                #if (CHECK_TV)
-                memset( pucPredY, 0xCD, sizeof(pCache->pucPredY) );
-                #endif
-
-                xEncIntraPredLuma( h, nMode, nCUSize );
-
-                #if (CHECK_TV)
-                {
-                    UInt x, y;
-                    for( y=0; y<nCUSize; y++ ) {
-                        for( x=0; x<nCUSize; x++ ) {
-                            if( pucPredY[y * MAX_CU_SIZE + x] != tv_pred[nMode][y * MAX_CU_SIZE + x] ) {
-                                fprintf( stderr, "Intra Pred Y Wrong, Mode %d at (%d,%d), %02X -> %02X\n", nMode, y, x, tv_pred[nMode][y*nCUSize+x], pCache->pucPredY[y * MAX_CU_SIZE + x] );
-                                abort();
-                            }
-                        }
-                    }
-                }
-                #endif
-
-                if( nMode == pucMostModeY[0] )
-                    uiSad = 1 * lambda;
-                else if( nMode == pucMostModeY[1] || nMode == pucMostModeY[2] )
-                    uiSad = 2 * lambda;
-                else
-                    uiSad = 3 * lambda;
-                uiSad += xSadN[nLog2CUSize-2](
-                            nCUSize,
-                            pucPixY, MAX_CU_SIZE,
-                            pucPredY, MAX_CU_SIZE
-                        );
-
-                if( uiSad < uiBestSadY ) {
-                    uiBestSadY = uiSad;
-                    nBestModeY = nMode;
-                }
+/// encode the tile nTile into its substream, the contexts and the neighbours start over at every tile
+static void xEncEncodeTile( X265_t *pMain, UInt nTile )
+{
+    X265_t *h = pMain->pTiles[nTile];
+    UInt y;
+    Int32 iLength;
 
-                #if (CHECK_TV)
-                if( uiSad != tv_sad[nMode] ) {
-                    printf( " Sad %d -> %d Failed!\n", tv_sad[nMode], uiSad );
-                    abort();
-                }
-                #endif
-            }
-            #if (CHECK_TV)
-            if( nBestModeY != tv_bestmode ) {
-                printf( " BestMode %d -> %d Failed!\n", tv_bestmode, nBestModeY );
-                abort();
-            }
-            #endif
+    xBitStreamInit( &h->bs, h->pucSubStream[0], h->uiSubStreamSize );
+    h->bs.bRawRBSP = TRUE;
+    xEncCahceInit( h );
+    xCabacInit( h );
+    xCabacReset( &h->cabac );
 
-            // GetAllowedChromaMode
-            pucMostModeC[0] = PLANAR_IDX;
-            pucMostModeC[1] = VER_IDX;
-            pucMostModeC[2] = HOR_IDX;
-            pucMostModeC[3] = DC_IDX;
-            pucMostModeC[4] = LM_CHROMA_IDX;
-            pucMostModeC[5] = nBestModeY;
-            for( i=0;i<4; i++ ) {
-                if( pucMostModeC[i] == nBestModeY ) {
-                    pucMostModeC[i] = 34;
-                    break;
-                }
-            }
+    for( y=h->uiTileY0; y < h->uiTileY1; y+=h->ucMaxCUWidth ) {
+        xEncEncodeRow( h, y );
+    }
 
-            uiBestSadC = MAX_SAD;
-            for( nMode=0; nMode<NUM_CHROMA_MODE; nMode++ ) {
-                UInt32 uiSumSad;
-                UInt32 uiSad[2];
-                realModeC = pucMostModeC[nMode];
-
-                if ( realModeC == LM_CHROMA_IDX )
-                    continue;
-
-                #if (CHECK_TV)
-                memset( pCache->pucPredC, 0xCD, sizeof(pCache->pucPredC) );
-                #endif
-
-                xEncIntraPredChroma( h, realModeC, nCUSize >> 1 );
-
-                #if (CHECK_TV)
-                {
-                    UInt x, y;
-                    for( y=0; y<nCUSize/2; y++ ) {
-                        for( x=0; x<nCUSize/2; x++ ) {
-                            if( pucPredC[0][y * MAX_CU_SIZE/2 + x] != tv_predC[0][nMode][y * MAX_CU_SIZE/2 + x] ) {
-                                fprintf( stderr, "Intra Pred U Wrong, Mode %d at (%d,%d), %02X -> %02X\n", nMode, y, x, tv_predC[0][nMode][y*nCUSize+x], pCache->pucPredC[0][y * MAX_CU_SIZE/2 + x] );
-                                //abort();
-                                goto _exit;
-                            }
-                            if( pucPredC[1][y * MAX_CU_SIZE/2 + x] != tv_predC[1][nMode][y * MAX_CU_SIZE/2 + x] ) {
-                                fprintf( stderr, "Intra Pred V Wrong, Mode %d at (%d,%d), %02X -> %02X\n", nMode, y, x, tv_predC[1][nMode][y*nCUSize+x], pCache->pucPredC[1][y * MAX_CU_SIZE/2 + x] );
-                                //abort();
-                                goto _exit;
-                            }
-                        }
-                    }
-_exit:;
-                }
-                #endif
-                uiSad[0] = xSadN[nLog2CUSize-2-1](
-                            nCUSize / 2,
-                            pucPixC[0], MAX_CU_SIZE/2,
-                            pucPredC[0], MAX_CU_SIZE/2
-                        );
-
-                uiSad[1] = xSadN[nLog2CUSize-2-1](
-                            nCUSize / 2,
-                            pucPixC[1], MAX_CU_SIZE/2,
-                            pucPredC[1], MAX_CU_SIZE/2
-                        );
-
-                #if (CHECK_TV)
-                assert( uiSad[0] == tv_sadC[0][nMode] );
-                assert( uiSad[1] == tv_sadC[1][nMode] );
-                #endif
-
-                uiSumSad = uiSad[0] + uiSad[1];
-                if( uiSumSad < uiBestSadC ) {
-                    uiBestSadC = uiSumSad;
-                    nBestModeC = nMode;
-                }
-            }
-            realModeC = pucMostModeC[nBestModeC];
-            #if (CHECK_TV)
-            {
-                // Check Chroma Mode and Sad
-                assert( uiBestSadC == tv_BestSadC );
-                assert( (nBestModeC == NUM_CHROMA_MODE-1 && realModeC == tv_bestmode) || (pucMostModeC[nBestModeC] == tv_bestmodeC) );
-                tv_nModeC = nBestModeC;
-            }
-            #endif
+    if( nTile == pMain->nTiles - 1 ) {
+        xCabacFlush( &h->cabac, &h->bs );
+        xWriteSliceEnd( h );
+    }
+    else {
+        xWriteSubStreamEnd( h );
+    }
+    iLength = xBitFlush( &h->bs );
+    assert( (UInt32)iLength <= h->uiSubStreamSize );
+    h->uiSubStreamLen = h->pPrim->xPutRBSP( h->pucSubStream[1], h->pucSubStream[0], iLength );
+}
 
-            // Stage 3a: Encode CU
-            pCache->nBestModeY = nBestModeY;
-            pCache->nBestModeC = nBestModeC;
-            // Y
-            xEncIntraPredLuma( h, nBestModeY, nCUSize );
-            xSubDct( piTmp0,
-                     pucPixY,
-                     pucPredY, MAX_CU_SIZE,
-                     piTmp0, piTmp1,
-                     nCUSize, nCUSize, nBestModeY );
-            uiSumY = xQuant( piCoefY, piTmp0, MAX_CU_SIZE, nQP, nCUSize, nCUSize, SLICE_I );
-
-            // Cr and Cb
-            xEncIntraPredChroma( h, realModeC, nCUSize >> 1 );
-            for( i=0; i<2; i++ ) {
-                #if (CHECK_TV)
-                tv_nIdxC = i;
-                #endif
-                xSubDct( piTmp0,
-                         pucPixC[i],
-                         pucPredC[i], MAX_CU_SIZE/2,
-                         piTmp0, piTmp1,
-                         nCUSize/2, nCUSize/2, realModeC );
-                uiSumC[i] = xQuant( piCoefC[i], piTmp0, MAX_CU_SIZE/2, nQPC, nCUSize/2, nCUSize/2, SLICE_I );
-            }
-            pCbf[0] = (uiSumY    != 0);
-            pCbf[1] = (uiSumC[0] != 0);
-            pCbf[2] = (uiSumC[1] != 0);
-
-            // Stage 3b: Decode CU
-            if( uiSumY ) {
-                xDeQuant( piTmp0, piCoefY, MAX_CU_SIZE, nQP, nCUSize, nCUSize, SLICE_I );
-                xIDctAdd( pucRecY,
-                          piTmp0,
-                          pucPredY, MAX_CU_SIZE,
-                          piTmp1, piTmp0,
-                          nCUSize, nCUSize, nBestModeY );
-            }
-            else {
-                for( i=0; i<nCUSize; i++ ) {
-                    memcpy( &pucRecY[i*MAX_CU_SIZE], &pucPredY[i*MAX_CU_SIZE], nCUSize );
-                }
-            }
-            // Cr and Cb
-            for( i=0; i<2; i++ ) {
-                #if (CHECK_TV)
-                tv_nIdxC = i;
-                #endif
-                if( uiSumC[i] ) {
-                    xDeQuant( piTmp0, piCoefC[i], MAX_CU_SIZE/2, nQPC, nCUSize/2, nCUSize/2, SLICE_I );
-                    xIDctAdd( pucRecC[i],
-                              piTmp0,
-                              pucPredC[i], MAX_CU_SIZE/2,
-                              piTmp1, piTmp0,
-                              nCUSize/2, nCUSize/2, realModeC );
-                }
-                else {
-                    UInt k;
-                    for( k=0; k<nCUSize/2; k++ ) {
-                        memcpy( &pucRecC[i][k*MAX_CU_SIZE/2], &pucPredC[i][k*MAX_CU_SIZE/2], nCUSize/2 );
-                    }
-                }
-            }
+/// job of the WPP, the slices and the tiles, the jobs are taken in order so the row above is always running
+static void xEncJob( void *pArg, UInt nJob )
+{
+    X265_t *h = (X265_t *)pArg;
+
+    if( h->bUseWPP )
+        xEncEncodeSubStream( h, nJob );
+    else if( h->nTiles > 1 )
+        xEncEncodeTile( h, nJob );
+    else
+        xEncEncodeSlice( h, nJob );
+}
 
-            // Stage 4: Write CU
-            xWriteCU( h, 0, bLastCU );
+/// the frame state of the main handle for a row, slice or tile handle
+static void xEncSyncHandle( X265_t *pDst, const X265_t *h )
+{
+    pDst->eSliceType = h->eSliceType;
+    pDst->pFrameCur  = h->pFrameCur;
+    pDst->pFrameRec  = h->pFrameRec;
+    pDst->iPoc       = h->iPoc;
+    pDst->iQP        = h->iQP;
+}
 
-            // Stage 5a: Update reconstr
-            xEncCacheStoreCU( h, x, y );
+/// run nJobs rows, slices or tiles on the pool, the calling thread is one of the workers
+static void xEncRunJobs( X265_t *h, UInt nJobs )
+{
+    xPoolRun( h->pPool, xEncJob, h, nJobs, nJobs );
+}
 
-            // Stage 5b: Update context
-            xEncCacheUpdate( h, 0, 0, nCUSize, nCUSize );
-            pCache->uiOffset += nCUSize;
+/// encode every CTU row of the frame into its own substream
+void xEncEncodeWPP( X265_t *h )
+{
+    const UInt nRows = h->usHeight / h->ucMaxCUWidth;
+    UInt i;
 
-            #if (CHECK_TV)
-            printf( "CU(%2d,%2d) Passed!\n", y/h->ucMaxCUWidth, x/h->ucMaxCUWidth );
-            #endif
-        }
+    for( i=0; i<nRows; i++ ) {
+        xEncSyncHandle( h->pRows[i], h );
+        h->pRows[i]->uiRowDone = 0;
     }
-    xCabacFlush( pCabac, pBS );
-    xWriteSliceEnd( h );
+    xEncRunJobs( h, nRows );
+}
 
-    #ifdef CHECK_SEI
-    MD5Context ctx;
-    MD5Init( &ctx );
-    MD5Update( &ctx, h->pFrameRec->pucY, uiWidth*uiHeight*3/2 );
-    MD5Final( &ctx, &pucOutBuf[nOffsetSEI] );
-    #endif
+/// encode every slice of the frame into its own RBSP, the slices are independent
+void xEncEncodeSlices( X265_t *h )
+{
+    UInt i;
 
-    #ifdef WRITE_REC
-    // Save Restruct
-    {
-        static FILE *fpx=NULL;
-        if ( fpx == NULL )
-            fpx = fopen("OX.YUV", "wb");
-        assert( fpx != NULL );
-        fwrite(h->pFrameRec->pucY, 1, uiWidth*uiHeight*3/2, fpx);
-        fflush(fpx);
-        //fclose(fpx);
+    for( i=0; i<h->nSlices; i++ ) {
+        xEncSyncHandle( h->pSlices[i], h );
     }
-    #endif
+    memset( h->ausHashCUs, 0, sizeof(h->ausHashCUs) );
+    h->nHashRow  = 0;
+    h->bHashBusy = FALSE;
+    xEncRunJobs( h, h->nSlices );
+}
 
-    // Update Reference Frame Pointer
-    X265_Frame tmp = h->refn[MAX_REF_NUM];
-    for( i=MAX_REF_NUM; i>0; i-- ) {
-        h->refn[i] = h->refn[i-1];
-    }
-    h->refn[0] = tmp;
+/// encode every tile of the frame into its own substream, the tiles are independent
+void xEncEncodeTiles( X265_t *h )
+{
+    UInt i;
 
-    return xBitFlush( pBS );
+    for( i=0; i<h->nTiles; i++ ) {
+        xEncSyncHandle( h->pTiles[i], h );
+    }
+    memset( h->ausHashCUs, 0, sizeof(h->ausHashCUs) );
+    h->nHashRow  = 0;
+    h->bHashBusy = FALSE;
+    xEncRunJobs( h, h->nTiles );
 }
 
 // ***************************************************************************
@@ -984,6 +1743,7 @@ void xEncCahceInit( X265_t *h )
     X265_Cache *pCache  = &h->cache;
     memset( pCache, 0, sizeof(X265_Cache) );
     memset( pCache->pucTopModeY, MODE_INVALID, sizeof(pCache->pucTopModeY) );
+    memset( pCache->pucTopLeftModeY, MODE_INVALID, sizeof(pCache->pucTopLeftModeY) );
 }
 
 void xEncCahceInitLine( X265_t *h, UInt y )
@@ -1027,6 +1787,19 @@ void xEncCacheLoadCU( X265_t *h, UInt uiX, UInt uiY )
     }
 }
 
+/// copy the top line of the CTU at uiX and its top right from the cache of the row above, for the WPP
+void xEncCacheLoadTop( X265_t *h, const X265_t *pAbove, UInt uiX )
+{
+    X265_Cache       *pCache    = &h->cache;
+    const X265_Cache *pTop      = &pAbove->cache;
+    const UInt        nWidth    = MIN( 2 * h->ucMaxCUWidth, h->usWidth - uiX );
+
+    memcpy( &pCache->pucTopPixY[uiX], &pTop->pucTopPixY[uiX], nWidth );
+    memcpy( &pCache->pucTopPixU[uiX / 2], &pTop->pucTopPixU[uiX / 2], nWidth / 2 );
+    memcpy( &pCache->pucTopPixV[uiX / 2], &pTop->pucTopPixV[uiX / 2], nWidth / 2 );
+    memcpy( &pCache->pucTopModeY[uiX / MIN_CU_SIZE], &pTop->pucTopModeY[uiX / MIN_CU_SIZE], nWidth / MIN_CU_SIZE );
+}
+
 void xEncCacheStoreCU( X265_t *h, UInt uiX, UInt uiY )
 {
     X265_Cache  *pCache     = &h->cache;
@@ -1059,6 +1832,11 @@ void xEncCacheStoreCU( X265_t *h, UInt uiX, UInt uiY )
         pucDU  += uiWidth / 2;
         pucDV  += uiWidth / 2;
     }
+
+    // The CTU row is done, hash it while it is still in the cache, the rows of the WPP are done in order too
+    if( h->ucHashSEI != HASH_NONE && h->ucSliceMode == SLICE_MODE_NONE && h->nTiles == 1 && uiX + nCUWidth == uiWidth ) {
+        xPictureHashRow( h->pMain, uiY, nCUWidth );
+    }
 }
 
 void xEncCacheUpdate( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nWidth, UInt nHeight )
@@ -1074,6 +1852,7 @@ void xEncCacheUpdate( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nWidth, UInt nHeig
           UInt8 *pucTopLeftY    =  pCache->pucTopLeftY;
           UInt8 *pucTopLeftU    =  pCache->pucTopLeftU;
           UInt8 *pucTopLeftV    =  pCache->pucTopLeftV;
+          UInt8 *pucTopLeftModeY=  pCache->pucTopLeftModeY;
           UInt8 *pucTopModeY    = &pCache->pucTopModeY[(uiOffset + uiX) / MIN_CU_SIZE];
           UInt8 *pucLeftModeY   =  pCache->pucLeftModeY + (uiY / MIN_CU_SIZE);
     const UInt8 *pucRecY        =  pCache->pucRecY;
@@ -1088,6 +1867,7 @@ void xEncCacheUpdate( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nWidth, UInt nHeig
     // Update TopLeft
     for( x=0; x<nWidth; x+=MIN_CU_SIZE ) {
         pucTopLeftY[x/MIN_CU_SIZE] = pucTopPixY[x + MIN_CU_SIZE - 1];
+        pucTopLeftModeY[x/MIN_CU_SIZE] = pucTopModeY[x/MIN_CU_SIZE];
     }
     for( x=0; x<nWidth/2; x+=MIN_CU_SIZE ) {
         pucTopLeftU[x/MIN_CU_SIZE] = pucTopPixU[x + MIN_CU_SIZE - 1];
@@ -1132,8 +1912,7 @@ UInt xGetTopLeftIndex( UInt32 uiX, UInt32 uiY )
 
 void xPaddingRef( UInt8 *pucRef, const UInt8 bValid[5], const UInt nBlkOffset[6] )
 {
-    UInt    i, n;
-    UInt8   ucPadding;
+    UInt    n;
     const Int nValid = 5;
 
     // Padding from Right to Left
@@ -1141,10 +1920,7 @@ void xPaddingRef( UInt8 *pucRef, const UInt8 bValid[5], const UInt nBlkOffset[6]
         if( bValid[n] )
             break;
     }
-    ucPadding = pucRef[nBlkOffset[n]];
-    for( i=0; i<nBlkOffset[n]; i++ ) {
-        pucRef[i] = ucPadding;
-    }
+    memset( pucRef, pucRef[nBlkOffset[n]], nBlkOffset[n] );
 
     // Padding from Left to Right
     for( ; n<nValid; n++ ) {
@@ -1152,14 +1928,46 @@ void xPaddingRef( UInt8 *pucRef, const UInt8 bValid[5], const UInt nBlkOffset[6]
             assert( n > 0 );
             const UInt nBlkAddr = nBlkOffset[n];
             const UInt nBlkSize = nBlkOffset[n + 1] - nBlkOffset[n];
-            ucPadding = pucRef[nBlkAddr - 1];
-            for( i=0; i<nBlkSize; i++ ) {
-                pucRef[nBlkAddr + i] = ucPadding;
-            }
+            memset( &pucRef[nBlkAddr], pucRef[nBlkAddr - 1], nBlkSize );
         }
     }
 }
 
+/// pucDst[i] = pucSrc[nSize - 1 - i], the left neighbours are stored from bottom to top
+void xReverseRef( UInt8 *pucDst, const UInt8 *pucSrc, UInt nSize )
+{
+    UInt i;
+
+    for( i=0; i<nSize; i++ ) {
+        pucDst[i] = pucSrc[nSize - 1 - i];
+    }
+}
+
+/// smooth the 4*nSize+1 reference pixels with [1 2 1], the two end pixels are kept
+void xFilterRef( UInt8 *pucDst, UInt8 *pucSrc, UInt nSize )
+{
+    const UInt nLen = 4 * nSize;
+    UInt i;
+
+    pucDst[0   ] = pucSrc[0];
+    pucDst[nLen] = pucSrc[nLen];
+    for( i=1; i<nLen; i++ ) {
+        pucDst[i] = (pucSrc[i - 1] + 2 * pucSrc[i] + pucSrc[i + 1] + 2) >> 2;
+    }
+}
+
+/// return pucPixRef[bFilter], the filtered reference is only built the first time a mode need it
+UInt8 *xEncIntraGetRef( X265_t *h, UInt nSize, UInt bFilter )
+{
+    X265_Cache  *pCache = &h->cache;
+
+    if( bFilter && !pCache->bPixRefFiltered ) {
+        h->pPrim->xFilterRef( pCache->pucPixRef[1], pCache->pucPixRef[0], nSize );
+        pCache->bPixRefFiltered = TRUE;
+    }
+    return pCache->pucPixRef[bFilter];
+}
+
 void xEncIntraLoadRef( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nSize )
 {
     X265_Cache  *pCache         = &h->cache;
@@ -1177,7 +1985,6 @@ void xEncIntraLoadRef( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nSize )
     const UInt8 *pucTopModeY    = &pCache->pucTopModeY[(uiOffset + uiX) / MIN_CU_SIZE];
     const UInt8 *pucLeftModeY   =  pCache->pucLeftModeY + (uiY / MIN_CU_SIZE);
           UInt8 *pucRefY0       =  pCache->pucPixRef[0];
-          UInt8 *pucRefY1       =  pCache->pucPixRef[1];
           UInt8 *pucRefU        =  pCache->pucPixRefC[0];
           UInt8 *pucRefV        =  pCache->pucPixRefC[1];
           UInt8 *pucMostModeY   =  pCache->ucMostModeY;
@@ -1186,13 +1993,12 @@ void xEncIntraLoadRef( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nSize )
     /// T(op), B(ottom), L(eft), R(ight)
     const UInt   bT             = (pucTopModeY [uiX] != MODE_INVALID);
     const UInt   bL             = (pucLeftModeY[uiY] != MODE_INVALID);
-    const UInt   bLT            = bT && bL;
+    const UInt   bLT            = bT && bL && (pCache->pucTopLeftModeY[((uiX == 0 ? nSize : uiX) / MIN_CU_SIZE) - 1] != MODE_INVALID);
     const UInt   bTR            = (pucTopModeY [(uiX + nSize) / MIN_CU_SIZE] != MODE_INVALID);
     const UInt   bLB            = (pucLeftModeY[(uiY + nSize) / MIN_CU_SIZE] != MODE_INVALID);
     const UInt8  bValid[5]      = {bLB, bL, bLT, bT, bTR};
     const UInt   nBlkOffsetY[6] = {0, nSize,  2*nSize,  2*nSize +1, 3*nSize +1, 4*nSize +1};
     const UInt   nBlkOffsetC[6] = {0, nSizeC, 2*nSizeC, 2*nSizeC+1, 3*nSizeC+1, 4*nSizeC+1};
-    UInt i, n;
 
     // TODO: I ASSUME( CU = PU = TU ) here, do more!
     assert( (uiX == 0) && (uiY == 0) && (nSize == h->ucMaxCUWidth) );
@@ -1200,32 +2006,26 @@ void xEncIntraLoadRef( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nSize )
     // Save bValid flag for other functions
     memcpy( pCache->bValid, bValid, sizeof(bValid) );
 
+    // The filtered reference is built by xEncIntraGetRef()
+    pCache->bPixRefFiltered = FALSE;
+
     // Default to DC when all reference invalid
     if( (bT | bL | bLT | bTR | bLB) == 0 ) {
         memset( pucRefY0, 0x80, nSize  * 4 + 1 );
-        memset( pucRefY1, 0x80, nSize  * 4 + 1 );
         memset( pucRefU,  0x80, nSizeC * 4 + 1 );
         memset( pucRefV,  0x80, nSizeC * 4 + 1 );
     }
     else {
         // Copy the reconst pixel when valid
         if( bLB ) {
-            for( i=0; i<nSize; i++ ) {
-                pucRefY0[i + nBlkOffsetY[0]] = pucLeftPixY[nSize * 2 - 1 - i];
-            }
-            for( i=0; i<nSizeC; i++ ) {
-                pucRefU[i + nBlkOffsetC[0]] = pucLeftPixU[nSizeC * 2 - 1 - i];
-                pucRefV[i + nBlkOffsetC[0]] = pucLeftPixV[nSizeC * 2 - 1 - i];
-            }
+            h->pPrim->xReverseRef( &pucRefY0[nBlkOffsetY[0]], &pucLeftPixY[nSize ], nSize  );
+            h->pPrim->xReverseRef( &pucRefU [nBlkOffsetC[0]], &pucLeftPixU[nSizeC], nSizeC );
+            h->pPrim->xReverseRef( &pucRefV [nBlkOffsetC[0]], &pucLeftPixV[nSizeC], nSizeC );
         }
         if( bL ) {
-            for( i=0; i<nSize; i++ ) {
-                pucRefY0[i + nBlkOffsetY[1]] = pucLeftPixY[nSize - 1 - i];
-            }
-            for( i=0; i<nSizeC; i++ ) {
-                pucRefU[i + nBlkOffsetC[1]] = pucLeftPixU[nSizeC - 1 - i];
-                pucRefV[i + nBlkOffsetC[1]] = pucLeftPixV[nSizeC - 1 - i];
-            }
+            h->pPrim->xReverseRef( &pucRefY0[nBlkOffsetY[1]], &pucLeftPixY[0], nSize  );
+            h->pPrim->xReverseRef( &pucRefU [nBlkOffsetC[1]], &pucLeftPixU[0], nSizeC );
+            h->pPrim->xReverseRef( &pucRefV [nBlkOffsetC[1]], &pucLeftPixV[0], nSizeC );
         }
         if( bLT ) {
             UInt offsetY = ((uiX == 0 ? nSize  : uiX) / MIN_CU_SIZE) - 1;
@@ -1235,34 +2035,19 @@ void xEncIntraLoadRef( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nSize )
             pucRefV[nBlkOffsetC[2]] = pucTopLeftV[ offsetC ];
         }
         if( bT ) {
-            for( i=0; i<nSize; i++ ) {
-                pucRefY0[i + nBlkOffsetY[3]] = pucTopPixY[i + 0 * nSize];
-            }
-            for( i=0; i<nSizeC; i++ ) {
-                pucRefU[i + nBlkOffsetC[3]] = pucTopPixU[i + 0 * nSizeC];
-                pucRefV[i + nBlkOffsetC[3]] = pucTopPixV[i + 0 * nSizeC];
-            }
+            memcpy( &pucRefY0[nBlkOffsetY[3]], &pucTopPixY[0 * nSize ], nSize  );
+            memcpy( &pucRefU [nBlkOffsetC[3]], &pucTopPixU[0 * nSizeC], nSizeC );
+            memcpy( &pucRefV [nBlkOffsetC[3]], &pucTopPixV[0 * nSizeC], nSizeC );
         }
         if( bTR ) {
-            for( i=0; i<nSize; i++ ) {
-                pucRefY0[i + nBlkOffsetY[4]] = pucTopPixY[i + 1 * nSize];
-            }
-            for( i=0; i<nSizeC; i++ ) {
-                pucRefU[i + nBlkOffsetC[4]] = pucTopPixU[i + 1 * nSizeC];
-                pucRefV[i + nBlkOffsetC[4]] = pucTopPixV[i + 1 * nSizeC];
-            }
+            memcpy( &pucRefY0[nBlkOffsetY[4]], &pucTopPixY[1 * nSize ], nSize  );
+            memcpy( &pucRefU [nBlkOffsetC[4]], &pucTopPixU[1 * nSizeC], nSizeC );
+            memcpy( &pucRefV [nBlkOffsetC[4]], &pucTopPixV[1 * nSizeC], nSizeC );
         }
 
         xPaddingRef( pucRefY0, bValid, nBlkOffsetY );
         xPaddingRef( pucRefU,  bValid, nBlkOffsetC );
         xPaddingRef( pucRefV,  bValid, nBlkOffsetC );
-
-        // Filter with [1 2 1]
-        pucRefY1[0      ] = pucRefY0[0];
-        pucRefY1[4*nSize] = pucRefY0[4*nSize];
-        for( i=1; i<4*nSize; i++ ) {
-            pucRefY1[i] = (pucRefY0[i - 1] + 2 * pucRefY0[i] + pucRefY0[i + 1] + 2) >> 2;
-        }
     }
 
     // Most Mode
@@ -1296,6 +2081,7 @@ void xEncIntraLoadRef( X265_t *h, UInt32 uiX, UInt32 uiY, UInt nSize )
 #if (CHECK_TV)
     assert( nSize == tv_size );
 
+    UInt i, n;
     int bPassed = TRUE;
     for( n=0; n<2; n++ ) {
         // Check Left
@@ -1443,6 +2229,54 @@ void xPredIntraDc(
     }
 }
 
+/// project the side reference of a negative angle mode to pucRefMain[-nSize] to pucRefMain[-1]
+void xPredIntraAngProject(
+    UInt8   *pucRef,
+    UInt8   *pucRefMain,
+    Int      nSize,
+    UInt     nMode
+)
+{
+    UInt   bModeHor          = (nMode < 18);
+    Int    nIntraPredAngle  = g_aucIntraPredAngle[nMode];
+    Int    nInvAngle        = g_aucInvAngle[nMode];
+    UInt8 *pucTopLeft       = pucRef + 2 * nSize;
+    Int    iSum             = 128;
+    Int    x;
+
+    // (8-48) or (8-51)
+    for( x=-1; x>(nSize*nIntraPredAngle)>>5; x-- ) {
+        iSum += nInvAngle;
+        // Fix my inv left buffer index
+        Int nOffset = bModeHor ? (iSum >> 8) : -(iSum >> 8);
+        pucRefMain[x] = pucTopLeft[ nOffset ];
+    }
+}
+
+/// build the main reference of the angular mode, pucRefMain[-nSize] to pucRefMain[2*nSize] may be written
+/// pucRefMain[0] to pucRefMain[2*nSize] are the same for every mode of one direction
+void xPredIntraAngRef(
+    UInt8   *pucRef,
+    UInt8   *pucRefMain,
+    Int      nSize,
+    UInt     nMode
+)
+{
+    UInt   bModeHor          = (nMode < 18);
+    Int    nIntraPredAngle  = g_aucIntraPredAngle[nMode];
+    UInt8 *pucTopLeft       = pucRef + 2 * nSize;
+    Int    x;
+
+    // (8-47) and (8-50), (8-49) and (8-52)
+    for( x=0; x<2*nSize+1; x++ ) {
+        pucRefMain[x] = bModeHor ? pucTopLeft[-x] : pucTopLeft[x];
+    }
+
+    if( nIntraPredAngle < 0 ) {
+        xPredIntraAngProject( pucRef, pucRefMain, nSize, nMode );
+    }
+}
+
 void xPredIntraAng(
     UInt8   *pucRef,
     UInt8   *pucDst,
@@ -1454,35 +2288,15 @@ void xPredIntraAng(
 {
     UInt   bModeHor          = (nMode < 18);
     Int    nIntraPredAngle  = g_aucIntraPredAngle[nMode];
-    Int    nInvAngle        = g_aucInvAngle[nMode];
-    UInt8 *pucLeft          = pucRef + 2 * nSize - 1;
-    UInt8 *pucTop           = pucRef + 2 * nSize + 1;
     UInt8 *pucTopLeft       = pucRef + 2 * nSize;
-    UInt8  ucRefBuf[2*MAX_CU_SIZE+1];
-    UInt8 *pucRefMain       = ucRefBuf + ( (nIntraPredAngle < 0) ? MAX_CU_SIZE : 0 );
+    UInt8  ucRefBuf[3*MAX_CU_SIZE+1];
+    UInt8 *pucRefMain       = ucRefBuf + MAX_CU_SIZE;
+    // The horizontal mode is predicted on the transposed block, so write the transposed position directly
+    const Int nStepK        = bModeHor ? 1 : nDstStride;
+    const Int nStepX        = bModeHor ? nDstStride : 1;
     Int    x, k;
 
-    // (8-47) and (8-50)
-    for( x=0; x<nSize+1; x++ ) {
-        pucRefMain[x] = bModeHor ? pucTopLeft[-x] : pucTopLeft[x];
-    }
-
-    if( nIntraPredAngle < 0 ) {
-        Int iSum = 128;
-        // (8-48) or (8-51)
-        for( x=-1; x>(nSize*nIntraPredAngle)>>5; x-- ) {
-            iSum += nInvAngle;
-            // Fix my inv left buffer index
-            Int nOffset = bModeHor ? (iSum >> 8) : -(iSum >> 8);
-            pucRefMain[x] = pucTopLeft[ nOffset ];
-        }
-    }
-    else {
-        // (8-49) or (8-52)
-        for( x=nSize+1; x<2*nSize+1; x++ ) {
-            pucRefMain[x] = bModeHor ? pucTopLeft[-x] : pucTopLeft[x];
-        }
-    }
+    xPredIntraAngRef( pucRef, pucRefMain, nSize, nMode );
 
     // 8.4.3.1.6
     Int deltaPos=0;
@@ -1496,14 +2310,14 @@ void xPredIntraAng(
         if( iFact ) {
             // Do linear filtering
             for( x=0; x<nSize; x++ ) {
-                refMainIndex           = x+iIdx+1;
-                pucDst[k*nDstStride+x] = ( ((32-iFact)*pucRefMain[refMainIndex]+iFact*pucRefMain[refMainIndex+1]+16) >> 5 );
+                refMainIndex                = x+iIdx+1;
+                pucDst[k*nStepK + x*nStepX] = ( ((32-iFact)*pucRefMain[refMainIndex]+iFact*pucRefMain[refMainIndex+1]+16) >> 5 );
             }
         }
         else {
             // Just copy the integer samples
             for( x=0; x<nSize; x++) {
-                pucDst[k*nDstStride+x] = pucRefMain[iIdx+1+x];
+                pucDst[k*nStepK + x*nStepX] = pucRefMain[iIdx+1+x];
             }
         }
     }
@@ -1514,33 +2328,92 @@ void xPredIntraAng(
     {
         Int offset = bModeHor ? 1 : -1;
         for( x=0; x<nSize; x++ ) {
-            pucDst[x*nDstStride] = Clip ( pucDst[x*nDstStride] + (( pucTopLeft[(x+1)*offset] - pucTopLeft[0] ) >> 1) );
+            pucDst[x*nStepK] = Clip ( pucDst[x*nStepK] + (( pucTopLeft[(x+1)*offset] - pucTopLeft[0] ) >> 1) );
         }
     }
+}
 
-    // Matrix Transpose if this is the horizontal mode
-    if( bModeHor ) {
-      UInt8 tmp;
-      for (k=0;k<nSize-1;k++)
-      {
-        for (x=k+1;x<nSize;x++)
-        {
-          tmp                 = pucDst[k*nDstStride+x];
-          pucDst[k*nDstStride+x] = pucDst[x*nDstStride+k];
-          pucDst[x*nDstStride+k] = tmp;
+/// predict the angular block from a prepared main reference and return its SAD to pucSrc,
+/// the horizontal modes are left transposed, so pucSrc must be transposed too
+/// stop once the SAD reach uiMaxSad, the edge filter of the zero angle mode is not done
+UInt32 xPredIntraAngSad(
+    UInt8   *pucRefMain,
+    UInt8   *pucDst,
+    UInt8   *pucSrc,
+    Int      nStride,
+    Int      nSize,
+    Int      nIntraPredAngle,
+    UInt32   uiMaxSad
+)
+{
+    Int    deltaPos = 0;
+    UInt32 uiSad    = 0;
+    Int    x, k;
+
+    for( k=0; k<nSize; k++ ) {
+        deltaPos += nIntraPredAngle;
+        Int iIdx  = deltaPos >> 5;  // (8-53)
+        Int iFact = deltaPos & 31;  // (8-54)
+
+        for( x=0; x<nSize; x++ ) {
+            Int P = ( ((32-iFact)*pucRefMain[x+iIdx+1]+iFact*pucRefMain[x+iIdx+2]+16) >> 5 );
+            pucDst[k*nStride+x] = P;
+            uiSad += abs( P - pucSrc[k*nStride+x] );
         }
-      }
+        if( uiSad >= uiMaxSad )
+            break;
     }
+    return uiSad;
 }
 
-void xPredIntraLM(
-    UInt8   *pucRefC,
-    UInt8   *pucRefM_L,
-    UInt8   *pucRefM_T,
-    UInt8   *pucPredLM,
+/// build the downsampled luma neighbours of the LM mode, pucRefLM has the same layout as the chroma reference
+void xPredIntraLMRef(
+    UInt8   *pucRefY,
+    UInt8   *pucRefLM,
+    Int      nSize
+)
+{
+    UInt8 *pucRefY_L  = pucRefY  + 4 * nSize - 1;
+    UInt8 *pucRefY_T  = pucRefY  + 4 * nSize + 1;
+    UInt8 *pucRefLM_L = pucRefLM + 2 * nSize - 1;
+    UInt8 *pucRefLM_T = pucRefLM + 2 * nSize + 1;
+    Int i;
+
+    // pucRefY_T[-1] is the top-left pixel
+    for( i=0; i<nSize; i++ ) {
+        pucRefLM_L[-i] = ( pucRefY_L[-2*i] + pucRefY_L[-2*i-1] ) >> 1;
+        pucRefLM_T[ i] = ( pucRefY_T[2*i-1] + 2 * pucRefY_T[2*i] + pucRefY_T[2*i+1] + 2 ) >> 2;
+    }
+}
+
+/// downsample the reconstructed luma to the chroma grid, average of the two rows of the even column
+void xDownSampleLM(
     UInt8   *pucDst,
+    UInt     nDstStride,
+    UInt8   *pucSrc,
+    UInt     nSrcStride,
     UInt     nSize
 )
+{
+    UInt x, y;
+
+    for( y=0; y<nSize; y++ ) {
+        for( x=0; x<nSize; x++ ) {
+            pucDst[y*nDstStride+x] = ( pucSrc[2*y*nSrcStride+2*x] + pucSrc[(2*y+1)*nSrcStride+2*x] ) >> 1;
+        }
+    }
+}
+
+/// derive the linear model from the neighbour sums, return the shift of the model, pred = ((PredLM * a) >> shift) + b
+Int xPredIntraLMParam(
+    Int32    L,
+    Int32    C,
+    Int32    LL,
+    Int32    LC,
+    UInt     nSize,
+    Int32   *pA,
+    Int32   *pB
+)
 {
     // Table 8-7 C Specification of lmDiv
     static const UInt16 lmDiv[64] = {
@@ -1554,24 +2427,9 @@ void xPredIntraLM(
           575,   565,   555,  546,  537,  529,  520,  512,
 
     };
-    const UInt nLog2Size = xLog2( nSize - 1 );
-    UInt8 *pucRefC_L = pucRefC + 2 * nSize - 1;
-    UInt8 *pucRefC_T = pucRefC + 2 * nSize + 1;
-    Int i;
-    Int32 L=0, C=0, LL=0, LC=0;
-
     // (8-58) k3 = MAX(0, 8 + xLog2( nSize - 1 ) - 14) = 0;
     UInt k2 = xLog2(2*nSize - 1);   // (8-66)
 
-    for( i=0; i<(Int)nSize; i++ ) {
-        UInt32 L0 = ( pucRefM_L[ i] + pucRefM_T[i] );
-        UInt32 C0 = ( pucRefC_L[-i] + pucRefC_T[i] );
-        L  += L0;   // (8-62)
-        C  += C0;   // (8-63)
-        LL += (pucRefM_L[i] * pucRefM_L[ i]) + (pucRefM_T[i] * pucRefM_T[i]);    // (8-64)
-        LC += (pucRefM_L[i] * pucRefC_L[-i]) + (pucRefM_T[i] * pucRefC_T[i]);    // (8-65)
-    }
-
     Int a1 = ( LC << k2 ) - L * C;
     Int a2 = ( LL << k2 ) - L * L;
 
@@ -1604,7 +2462,39 @@ void xPredIntraLM(
         nShift -= (9-n);
     }
     b = (  C - ( ( a * L ) >> nShift ) + ( 1 << ( k2 - 1 ) ) ) >> k2;
-    
+
+    *pA = a;
+    *pB = b;
+    return nShift;
+}
+
+void xPredIntraLM(
+    UInt8   *pucRefC,
+    UInt8   *pucRefLM,
+    UInt8   *pucPredLM,
+    UInt8   *pucDst,
+    UInt     nSize
+)
+{
+    UInt8 *pucRefC_L  = pucRefC  + 2 * nSize - 1;
+    UInt8 *pucRefC_T  = pucRefC  + 2 * nSize + 1;
+    UInt8 *pucRefM_L  = pucRefLM + 2 * nSize - 1;
+    UInt8 *pucRefM_T  = pucRefLM + 2 * nSize + 1;
+    Int i;
+    Int32 L=0, C=0, LL=0, LC=0;
+    Int32 a, b;
+
+    for( i=0; i<(Int)nSize; i++ ) {
+        UInt32 L0 = ( pucRefM_L[-i] + pucRefM_T[i] );
+        UInt32 C0 = ( pucRefC_L[-i] + pucRefC_T[i] );
+        L  += L0;   // (8-62)
+        C  += C0;   // (8-63)
+        LL += (pucRefM_L[-i] * pucRefM_L[-i]) + (pucRefM_T[i] * pucRefM_T[i]);    // (8-64)
+        LC += (pucRefM_L[-i] * pucRefC_L[-i]) + (pucRefM_T[i] * pucRefC_T[i]);    // (8-65)
+    }
+
+    const Int nShift = xPredIntraLMParam( L, C, LL, LC, nSize, &a, &b );
+
     UInt x, y;
     for( y=0; y<nSize; y++ ) {
         for( x=0; x<nSize; x++ ) {
@@ -1614,16 +2504,14 @@ void xPredIntraLM(
     }
 }
 
-void xEncIntraPredLuma( X265_t *h, UInt nMode, UInt nSize )
+void xEncIntraPredLuma( X265_t *h, UInt nMode, UInt nSize, UInt8 *pucDstY )
 {
-    X265_Cache  *pCache     = &h->cache;
     UInt        nLog2Size   = xLog2(nSize - 1);
     UInt        bFilter     = g_aucIntraFilterType[nLog2Size-2][nMode];
-    UInt8       *pucRefY    = pCache->pucPixRef[bFilter];
-    UInt8       *pucDstY    = pCache->pucPredY;
+    UInt8       *pucRefY    = xEncIntraGetRef( h, nSize, bFilter );
 
     if( nMode == PLANAR_IDX ) {
-        xPredIntraPlanar(
+        h->pPrim->xPredIntraPlanar(
             pucRefY,
             pucDstY,
             MAX_CU_SIZE,
@@ -1631,7 +2519,7 @@ void xEncIntraPredLuma( X265_t *h, UInt nMode, UInt nSize )
         );
     }
     else if( nMode == DC_IDX ) {
-        xPredIntraDc(
+        h->pPrim->xPredIntraDc(
             pucRefY,
             pucDstY,
             MAX_CU_SIZE,
@@ -1640,7 +2528,7 @@ void xEncIntraPredLuma( X265_t *h, UInt nMode, UInt nSize )
         );
     }
     else {
-        xPredIntraAng(
+        h->pPrim->xPredIntraAng(
             pucRefY,
             pucDstY,
             MAX_CU_SIZE,
@@ -1656,13 +2544,13 @@ void xEncIntraPredChroma( X265_t *h, UInt nMode, UInt nSize )
     X265_Cache  *pCache     = &h->cache;
 
     if( nMode == PLANAR_IDX ) {
-        xPredIntraPlanar(
+        h->pPrim->xPredIntraPlanar(
             pCache->pucPixRefC[0],
             pCache->pucPredC[0],
             MAX_CU_SIZE / 2,
             nSize
         );
-        xPredIntraPlanar(
+        h->pPrim->xPredIntraPlanar(
             pCache->pucPixRefC[1],
             pCache->pucPredC[1],
             MAX_CU_SIZE / 2,
@@ -1670,14 +2558,14 @@ void xEncIntraPredChroma( X265_t *h, UInt nMode, UInt nSize )
         );
     }
     else if( nMode == DC_IDX ) {
-        xPredIntraDc(
+        h->pPrim->xPredIntraDc(
             pCache->pucPixRefC[0],
             pCache->pucPredC[0],
             MAX_CU_SIZE / 2,
             nSize,
             FALSE
         );
-        xPredIntraDc(
+        h->pPrim->xPredIntraDc(
             pCache->pucPixRefC[1],
             pCache->pucPredC[1],
             MAX_CU_SIZE / 2,
@@ -1685,8 +2573,24 @@ void xEncIntraPredChroma( X265_t *h, UInt nMode, UInt nSize )
             FALSE
         );
     }
+    else if( nMode == LM_CHROMA_IDX ) {
+        h->pPrim->xPredIntraLM(
+            pCache->pucPixRefC[0],
+            pCache->pucPixRefLM,
+            pCache->pucPredC[2],
+            pCache->pucPredC[0],
+            nSize
+        );
+        h->pPrim->xPredIntraLM(
+            pCache->pucPixRefC[1],
+            pCache->pucPixRefLM,
+            pCache->pucPredC[2],
+            pCache->pucPredC[1],
+            nSize
+        );
+    }
     else {
-        xPredIntraAng(
+        h->pPrim->xPredIntraAng(
             pCache->pucPixRefC[0],
             pCache->pucPredC[0],
             MAX_CU_SIZE / 2,
@@ -1694,7 +2598,7 @@ void xEncIntraPredChroma( X265_t *h, UInt nMode, UInt nSize )
             nMode,
             FALSE
             );
-        xPredIntraAng(
+        h->pPrim->xPredIntraAng(
             pCache->pucPixRefC[1],
             pCache->pucPredC[1],
             MAX_CU_SIZE / 2,
@@ -1705,3 +2609,129 @@ void xEncIntraPredChroma( X265_t *h, UInt nMode, UInt nSize )
     }
 }
 
+/// search the best luma mode by SAD or SATD plus the MPM bias, the prediction of the best mode is left in pucPredY
+UInt xEncIntraSearchLuma( X265_t *h, UInt nSize, UInt32 *puiBestSad )
+{
+    X265_Cache  *pCache         = &h->cache;
+    const UInt   nLog2Size      = xLog2( nSize - 1 );
+    xSad        *pxCost         = (h->bUseSATD ? h->pPrim->xSatdN : h->pPrim->xSadN)[nLog2Size-2];
+    const Int32  lambda         = h->iQP;
+    UInt8       *pucPixY        = pCache->pucPixY;
+    UInt8       *pucPredY       = pCache->pucPredY;
+    UInt8       *pucMostModeY   = pCache->ucMostModeY;
+    UInt8        aucPixYT[MAX_CU_SIZE*MAX_CU_SIZE];
+    UInt8        aucPred[2][MAX_CU_SIZE*MAX_CU_SIZE];
+    // [bModeHor][bFilter], the SIMD predictor read up to 16 pixels past 2*nSize
+    UInt8        aucRefBuf[2][2][4*MAX_CU_SIZE];
+    UInt8        bRefReady[2][2] = { {FALSE, FALSE}, {FALSE, FALSE} };
+    UInt         nCur           = 0;    // aucPred[nCur] is the mode under test, aucPred[nCur^1] the best one
+    UInt32       uiBestSad      = MAX_SAD;
+    UInt         nBestMode      = 0;
+    UInt         bBestTrans     = FALSE;
+    UInt         nMode;
+    UInt         y;
+
+    // The horizontal modes are costed against the transposed source, so they are predicted as the vertical ones
+    h->pPrim->xTranspose( aucPixYT, pucPixY, MAX_CU_SIZE, nSize );
+
+    for( nMode=0; nMode<35; nMode++ ) {
+        const UInt  bFilter     = g_aucIntraFilterType[nLog2Size-2][nMode];
+        const Int   nAngle      = g_aucIntraPredAngle[nMode];
+        const UInt  bModeHor    = (nMode < 18);
+        // Planar, DC and the zero angle modes with edge filter use the normal predictor
+        const UInt  bFused      = (nMode > DC_IDX) && (nAngle != 0);
+        UInt8      *pucPred     = aucPred[nCur];
+        UInt32      uiBias;
+        UInt32      uiSad;
+
+        if( nMode == pucMostModeY[0] )
+            uiBias = 1 * lambda;
+        else if( nMode == pucMostModeY[1] || nMode == pucMostModeY[2] )
+            uiBias = 2 * lambda;
+        else
+            uiBias = 3 * lambda;
+
+        #if (CHECK_TV)
+        // Every mode is checked with the test vector
+        const UInt32 uiMaxSad = MAX_SAD;
+        memset( pucPred, 0xCD, sizeof(aucPred[0]) );
+        #else
+        // A mode only win by a smaller cost, so give up once it can't, the SAD of a row say nothing about the SATD
+        if( uiBias >= uiBestSad )
+            continue;
+        const UInt32 uiMaxSad = h->bUseSATD ? MAX_SAD : uiBestSad - uiBias;
+        #endif
+
+        if( bFused ) {
+            UInt8 *pucRefMain = aucRefBuf[bModeHor][bFilter] + MAX_CU_SIZE;
+            if( !bRefReady[bModeHor][bFilter] ) {
+                xPredIntraAngRef( xEncIntraGetRef( h, nSize, bFilter ), pucRefMain, nSize, nMode );
+                bRefReady[bModeHor][bFilter] = TRUE;
+            }
+            else if( nAngle < 0 ) {
+                xPredIntraAngProject( xEncIntraGetRef( h, nSize, bFilter ), pucRefMain, nSize, nMode );
+            }
+            uiSad = h->pPrim->xPredIntraAngSad( pucRefMain,
+                                                   pucPred,
+                                                   (bModeHor ? aucPixYT : pucPixY),
+                                                   MAX_CU_SIZE,
+                                                   nSize,
+                                                   nAngle,
+                                                   uiMaxSad );
+            // The SATD is the same on the transposed pair
+            if( h->bUseSATD ) {
+                uiSad = pxCost( nSize, (bModeHor ? aucPixYT : pucPixY), MAX_CU_SIZE, pucPred, MAX_CU_SIZE );
+            }
+        }
+        else {
+            xEncIntraPredLuma( h, nMode, nSize, pucPred );
+            uiSad = pxCost(
+                        nSize,
+                        pucPixY, MAX_CU_SIZE,
+                        pucPred, MAX_CU_SIZE
+                    );
+        }
+        uiSad += uiBias;
+
+        #if (CHECK_TV)
+        {
+            const UInt bTrans = bFused && bModeHor;
+            UInt x;
+            for( y=0; y<nSize; y++ ) {
+                for( x=0; x<nSize; x++ ) {
+                    UInt8 ucPred = bTrans ? pucPred[x * MAX_CU_SIZE + y] : pucPred[y * MAX_CU_SIZE + x];
+                    if( ucPred != tv_pred[nMode][y * MAX_CU_SIZE + x] ) {
+                        fprintf( stderr, "Intra Pred Y Wrong, Mode %d at (%d,%d), %02X -> %02X\n", nMode, y, x, tv_pred[nMode][y*nSize+x], ucPred );
+                        abort();
+                    }
+                }
+            }
+            if( uiSad != tv_sad[nMode] ) {
+                printf( " Sad %d -> %d Failed!\n", tv_sad[nMode], uiSad );
+                abort();
+            }
+        }
+        #endif
+
+        if( uiSad < uiBestSad ) {
+            uiBestSad  = uiSad;
+            nBestMode  = nMode;
+            bBestTrans = bFused && bModeHor;
+            nCur ^= 1;
+        }
+    }
+
+    // Keep the prediction of the best mode
+    UInt8 *pucBest = aucPred[nCur ^ 1];
+    if( bBestTrans ) {
+        h->pPrim->xTranspose( pucPredY, pucBest, MAX_CU_SIZE, nSize );
+    }
+    else {
+        for( y=0; y<nSize; y++ ) {
+            memcpy( &pucPredY[y * MAX_CU_SIZE], &pucBest[y * MAX_CU_SIZE], nSize );
+        }
+    }
+
+    *puiBestSad = uiBestSad;
+    return nBestMode;
+}
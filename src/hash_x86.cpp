@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * hash_x86.cpp: Picture hash for x86 SIMD
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#include "x265.h"
+
+#if ARCH_X86
+#include <immintrin.h>
+
+// ***************************************************************************
+// * CRC
+// ***************************************************************************
+// After a byte reverse, 16 bytes are a polynomial of 128 bits in the bit order of pclmulqdq, the first bit at the top.
+// A block A = H*x^64 + L folded over the 16*N bytes after it is H*(x^(128N+64) mod P) ^ L*(x^128N mod P),
+// it is below 80 bits and has the same CRC, so the last block is reduced by the table of xCrc16().
+X265_TARGET("sse4.2,pclmul")
+static __m128i xCrcFold_sse42( const __m128i A, const __m128i K, const __m128i B )
+{
+    return _mm_xor_si128( _mm_xor_si128( _mm_clmulepi64_si128( A, K, 0x11 ), _mm_clmulepi64_si128( A, K, 0x00 ) ), B );
+}
+
+X265_TARGET("sse4.2,pclmul")
+UInt32 xCrc16_sse42( UInt32 uiCrc, const UInt8 *pucSrc, UInt32 uiLength )
+{
+    const __m128i rev = _mm_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 );
+    const __m128i K1  = _mm_set_epi64x( 0x650B, 0xAEFC );   // x^192 and x^128 mod 0x11021
+    const __m128i K4  = _mm_set_epi64x( 0x8832, 0x13FC );   // x^576 and x^512 mod 0x11021
+    ALIGNED(16) UInt8 aucLast[16];
+    __m128i A0, A1, A2, A3;
+    UInt32 i;
+
+    if( uiLength < 64 )
+        return xCrc16( uiCrc, pucSrc, uiLength );
+
+    // The register is added to the first 16 bits, 4 blocks are folded over the next 64 bytes in parallel
+    A0 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[ 0] ), rev );
+    A1 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[16] ), rev );
+    A2 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[32] ), rev );
+    A3 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[48] ), rev );
+    A0 = _mm_xor_si128( A0, _mm_slli_si128( _mm_cvtsi32_si128( uiCrc ), 14 ) );
+    for( i=64; i+64<=uiLength; i+=64 ) {
+        A0 = xCrcFold_sse42( A0, K4, _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[i+ 0] ), rev ) );
+        A1 = xCrcFold_sse42( A1, K4, _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[i+16] ), rev ) );
+        A2 = xCrcFold_sse42( A2, K4, _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[i+32] ), rev ) );
+        A3 = xCrcFold_sse42( A3, K4, _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[i+48] ), rev ) );
+    }
+
+    // Down to one block, then the blocks of 16 bytes left
+    A1 = xCrcFold_sse42( A0, K1, A1 );
+    A2 = xCrcFold_sse42( A1, K1, A2 );
+    A3 = xCrcFold_sse42( A2, K1, A3 );
+    for( ; i+16<=uiLength; i+=16 ) {
+        A3 = xCrcFold_sse42( A3, K1, _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&pucSrc[i] ), rev ) );
+    }
+
+    _mm_store_si128( (__m128i *)aucLast, _mm_shuffle_epi8( A3, rev ) );
+    uiCrc = xCrc16( 0, aucLast, 16 );
+    return xCrc16( uiCrc, &pucSrc[i], uiLength - i );
+}
+
+// ***************************************************************************
+// * Checksum
+// ***************************************************************************
+// For x0 aligned to 16, (x & 0xFF) ^ (x >> 8) of x0 to x0+15 is ((x0 & 0xFF) | i) ^ (x0 >> 8),
+// so the mask of 16 pixels is one or and one xor, psadbw sum the bytes.
+X265_TARGET("sse2")
+UInt32 xChecksum_sse2( UInt32 uiSum, const UInt8 *pucSrc, UInt nStride, UInt nWidth, UInt nY0, UInt nHeight )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i iota = _mm_setr_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 );
+    const UInt    nWidth16 = nWidth & ~15;
+    __m128i sum = zero;
+    UInt x, y;
+
+    for( y=nY0; y<nY0+nHeight; y++ ) {
+        const UInt8 ucMaskY = (y & 0xFF) ^ (y >> 8);
+        for( x=0; x<nWidth16; x+=16 ) {
+            const __m128i M = _mm_xor_si128( _mm_or_si128( _mm_set1_epi8( (char)(x & 0xFF) ), iota ),
+                                             _mm_set1_epi8( (char)(ucMaskY ^ (x >> 8)) ) );
+            const __m128i P = _mm_loadu_si128( (const __m128i *)&pucSrc[x] );
+            sum = _mm_add_epi64( sum, _mm_sad_epu8( _mm_xor_si128( P, M ), zero ) );
+        }
+        for( ; x<nWidth; x++ ) {
+            uiSum += pucSrc[x] ^ (UInt8)(ucMaskY ^ (x & 0xFF) ^ (x >> 8));
+        }
+        pucSrc += nStride;
+    }
+    sum = _mm_add_epi64( sum, _mm_srli_si128( sum, 8 ) );
+    return uiSum + (UInt32)_mm_cvtsi128_si32( sum );
+}
+
+#endif /* ARCH_X86 */
@@ -0,0 +1,636 @@
+/*****************************************************************************
+ * intra_x86.cpp: Intra prediction functions for x86 SIMD
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#include "x265.h"
+
+#if ARCH_X86
+#include <immintrin.h>
+
+// ***************************************************************************
+// * Internal Functions
+// ***************************************************************************
+/// store the first nSize (4, 8 or 16) pixels of R
+X265_TARGET("sse2")
+static ALWAYS_INLINE void xStoreRow_sse2( UInt8 *pDst, __m128i R, Int nSize )
+{
+    if( nSize == 4 )
+        *(Int32 *)pDst = _mm_cvtsi128_si32( R );
+    else if( nSize == 8 )
+        _mm_storel_epi64( (__m128i *)pDst, R );
+    else
+        _mm_storeu_si128( (__m128i *)pDst, R );
+}
+
+/// load nSize (4, 8 or 16) pixels, the upper bytes are zero
+X265_TARGET("sse2")
+static ALWAYS_INLINE __m128i xLoadRow_sse2( const UInt8 *pSrc, Int nSize )
+{
+    if( nSize == 4 )
+        return _mm_cvtsi32_si128( *(const Int32 *)pSrc );
+    else if( nSize == 8 )
+        return _mm_loadl_epi64( (const __m128i *)pSrc );
+    return _mm_loadu_si128( (const __m128i *)pSrc );
+}
+
+/// ((32-iFact)*A + iFact*B + 16) >> 5, the weight pair (32-iFact, iFact) per pixel in W0 (pixel 0-7) and W1 (pixel 8-15)
+X265_TARGET("ssse3")
+static ALWAYS_INLINE __m128i xAngFilter_ssse3( __m128i A, __m128i B, __m128i W0, __m128i W1 )
+{
+    const __m128i c16 = _mm_set1_epi16( 16 );
+    __m128i L = _mm_maddubs_epi16( _mm_unpacklo_epi8( A, B ), W0 );
+    __m128i H = _mm_maddubs_epi16( _mm_unpackhi_epi8( A, B ), W1 );
+    L = _mm_srli_epi16( _mm_add_epi16( L, c16 ), 5 );
+    H = _mm_srli_epi16( _mm_add_epi16( H, c16 ), 5 );
+    return _mm_packus_epi16( L, H );
+}
+
+X265_TARGET("avx2")
+static ALWAYS_INLINE __m256i xAngFilter_avx2( __m256i A, __m256i B, __m256i W0, __m256i W1 )
+{
+    const __m256i c16 = _mm256_set1_epi16( 16 );
+    __m256i L = _mm256_maddubs_epi16( _mm256_unpacklo_epi8( A, B ), W0 );
+    __m256i H = _mm256_maddubs_epi16( _mm256_unpackhi_epi8( A, B ), W1 );
+    L = _mm256_srli_epi16( _mm256_add_epi16( L, c16 ), 5 );
+    H = _mm256_srli_epi16( _mm256_add_epi16( H, c16 ), 5 );
+    return _mm256_packus_epi16( L, H );
+}
+
+/// per column reference offset and weights of a horizontal mode, columns nCol to nCol+15 of the output
+/// return the smallest iIdx, the shuffle index of each column is relative to it
+static Int xAngHorColumns( Int nIntraPredAngle, Int nSize, Int nCol, UInt8 *pucIdx, UInt8 *pucWeight )
+{
+    const Int nCols = MIN( nSize - nCol, 16 );
+    const Int nMinIdx = (((nIntraPredAngle < 0 ? nCol + nCols : nCol + 1)) * nIntraPredAngle) >> 5;
+    Int x;
+
+    for( x=0; x<16; x++ ) {
+        Int deltaPos = (nCol + x + 1) * nIntraPredAngle;
+        if( x < nCols ) {
+            pucIdx[x]         = (deltaPos >> 5) - nMinIdx;
+            pucWeight[2*x+0]  = 32 - (deltaPos & 31);
+            pucWeight[2*x+1]  = (deltaPos & 31);
+        }
+        else {
+            pucIdx[x]         = 0;
+            pucWeight[2*x+0]  = 0;
+            pucWeight[2*x+1]  = 0;
+        }
+    }
+    return nMinIdx;
+}
+
+/// Filter if this is IntraPredAngle zero mode, the block is in the final orientation
+static void xAngEdgeFilter( UInt8 *pucRef, UInt8 *pucDst, Int nDstStride, Int nSize, UInt bModeHor )
+{
+    UInt8 *pucTopLeft = pucRef + 2 * nSize;
+    const Int nStep   = bModeHor ? 1 : nDstStride;
+    const Int offset  = bModeHor ? 1 : -1;
+    Int x;
+
+    for( x=0; x<nSize; x++ ) {
+        pucDst[x*nStep] = Clip( pucDst[x*nStep] + (( pucTopLeft[(x+1)*offset] - pucTopLeft[0] ) >> 1) );
+    }
+}
+
+// ***************************************************************************
+// * Reference Samples
+// ***************************************************************************
+/// reverse the 16 bytes of X
+X265_TARGET("sse2")
+static ALWAYS_INLINE __m128i xReverse16_sse2( __m128i X )
+{
+    X = _mm_shuffle_epi32( X, 0x1B );
+    X = _mm_shufflelo_epi16( X, 0xB1 );
+    X = _mm_shufflehi_epi16( X, 0xB1 );
+    return _mm_or_si128( _mm_slli_epi16( X, 8 ), _mm_srli_epi16( X, 8 ) );
+}
+
+X265_TARGET("sse2")
+void xReverseRef_sse2(
+    UInt8       *pucDst,
+    const UInt8 *pucSrc,
+    UInt         nSize
+)
+{
+    UInt i;
+
+    if( nSize == 4 ) {
+        *(Int32 *)pucDst = _mm_cvtsi128_si32( _mm_srli_si128( xReverse16_sse2( xLoadRow_sse2( pucSrc, 4 ) ), 12 ) );
+    }
+    else if( nSize == 8 ) {
+        _mm_storel_epi64( (__m128i *)pucDst, _mm_srli_si128( xReverse16_sse2( xLoadRow_sse2( pucSrc, 8 ) ), 8 ) );
+    }
+    else {
+        for( i=0; i<nSize; i+=16 ) {
+            const __m128i X = _mm_loadu_si128( (const __m128i *)&pucSrc[nSize - 16 - i] );
+            _mm_storeu_si128( (__m128i *)&pucDst[i], xReverse16_sse2( X ) );
+        }
+    }
+}
+
+// (A + 2*B + C + 2) >> 2 == avg( avg(A, C) - ((A ^ C) & 1), B ), the first byte
+// of the first block see garbage and is restored with the end pixels.
+X265_TARGET("sse2")
+void xFilterRef_sse2(
+    UInt8   *pucDst,
+    UInt8   *pucSrc,
+    UInt     nSize
+)
+{
+    const UInt nLen = 4 * nSize;
+    const __m128i c1 = _mm_set1_epi8( 1 );
+    UInt i;
+
+    for( i=0; i<nLen; i+=16 ) {
+        const __m128i B = _mm_loadu_si128( (const __m128i *)&pucSrc[i    ] );
+        const __m128i C = _mm_loadu_si128( (const __m128i *)&pucSrc[i + 1] );
+        const __m128i A = i ? _mm_loadu_si128( (const __m128i *)&pucSrc[i - 1] ) : _mm_slli_si128( B, 1 );
+        __m128i T = _mm_sub_epi8( _mm_avg_epu8( A, C ), _mm_and_si128( _mm_xor_si128( A, C ), c1 ) );
+        _mm_storeu_si128( (__m128i *)&pucDst[i], _mm_avg_epu8( T, B ) );
+    }
+    pucDst[0   ] = pucSrc[0];
+    pucDst[nLen] = pucSrc[nLen];
+}
+
+// ***************************************************************************
+// * Planar and DC
+// ***************************************************************************
+X265_TARGET("sse2")
+void xPredIntraPlanar_sse2(
+    UInt8   *pucRef,
+    UInt8   *pucDst,
+    Int      nDstStride,
+    UInt     nSize
+)
+{
+    const Int nLog2Size = xLog2( nSize - 1 );
+    UInt8 *pucLeft      = pucRef + 2 * nSize - 1;
+    UInt8 *pucTop       = pucRef + 2 * nSize + 1;
+    const Int bottomLeft = pucLeft[-(Int)nSize];
+    const Int topRight   = pucTop[nSize];
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i vShift = _mm_cvtsi32_si128( nLog2Size + 1 );
+    __m128i aRow[4], aStep[4], aCol[4];
+    UInt i, c;
+
+    // (nSize-1-y)*top[x] + (y+1)*bottomLeft, update by (bottomLeft - top[x]) every row
+    for( c=0; c<nSize; c+=8 ) {
+        __m128i T = _mm_unpacklo_epi8( xLoadRow_sse2( &pucTop[c], MIN( nSize, 8 ) ), zero );
+        aStep[c/8] = _mm_sub_epi16( _mm_set1_epi16( bottomLeft ), T );
+        aRow [c/8] = _mm_add_epi16( _mm_mullo_epi16( T, _mm_set1_epi16( nSize - 1 ) ), _mm_set1_epi16( bottomLeft ) );
+        aCol [c/8] = _mm_setr_epi16( c+1, c+2, c+3, c+4, c+5, c+6, c+7, c+8 );
+    }
+
+    for( i=0; i<nSize; i++ ) {
+        const Int left = pucLeft[-(Int)i];
+        // (nSize-1-x)*left[y] + (x+1)*topRight + nSize
+        const __m128i vDiff = _mm_set1_epi16( topRight - left );
+        const __m128i vBase = _mm_set1_epi16( (left << nLog2Size) + nSize );
+        __m128i R[4];
+
+        for( c=0; c<nSize; c+=8 ) {
+            __m128i H = _mm_add_epi16( _mm_mullo_epi16( aCol[c/8], vDiff ), vBase );
+            R[c/8] = _mm_srl_epi16( _mm_add_epi16( aRow[c/8], H ), vShift );
+            aRow[c/8] = _mm_add_epi16( aRow[c/8], aStep[c/8] );
+        }
+        if( nSize <= 8 ) {
+            xStoreRow_sse2( &pucDst[i * nDstStride], _mm_packus_epi16( R[0], R[0] ), nSize );
+        }
+        else {
+            for( c=0; c<nSize; c+=16 ) {
+                _mm_storeu_si128( (__m128i *)&pucDst[i * nDstStride + c], _mm_packus_epi16( R[c/8], R[c/8+1] ) );
+            }
+        }
+    }
+}
+
+X265_TARGET("sse2")
+void xPredIntraDc_sse2(
+    UInt8   *pucRef,
+    UInt8   *pucDst,
+    Int      nDstStride,
+    UInt     nSize,
+    UInt     bLuma
+)
+{
+    UInt8 *pucLeft  = pucRef + 2 * nSize - 1;
+    UInt8 *pucTop   = pucRef + 2 * nSize + 1;
+    const __m128i zero = _mm_setzero_si128();
+    const Int nLoad = MIN( nSize, 16 );
+    __m128i sum = _mm_setzero_si128();
+    UInt i, c;
+
+    // The left column is pucRef[nSize] to pucRef[2*nSize-1], the order is not care for sum
+    for( c=0; c<nSize; c+=16 ) {
+        sum = _mm_add_epi32( sum, _mm_sad_epu8( xLoadRow_sse2( &pucTop[c], nLoad ), zero ) );
+        sum = _mm_add_epi32( sum, _mm_sad_epu8( xLoadRow_sse2( &pucRef[nSize + c], nLoad ), zero ) );
+    }
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+    const UInt nDcVal = (_mm_cvtsi128_si32( sum ) + nSize) / (nSize + nSize);
+
+    // Fill DC Val
+    const __m128i vDc = _mm_set1_epi8( nDcVal );
+    for( i=0; i<nSize; i++ ) {
+        for( c=0; c<nSize; c+=16 ) {
+            xStoreRow_sse2( &pucDst[i * nDstStride + c], vDc, nLoad );
+        }
+    }
+
+    // DC Filtering ( 8.4.3.1.5 )
+    if( bLuma ) {
+        const __m128i vDc3 = _mm_set1_epi16( 3 * nDcVal + 2 );
+        for( c=0; c<nSize; c+=16 ) {
+            __m128i T = xLoadRow_sse2( &pucTop[c], nLoad );
+            __m128i L = _mm_srli_epi16( _mm_add_epi16( _mm_unpacklo_epi8( T, zero ), vDc3 ), 2 );
+            __m128i H = _mm_srli_epi16( _mm_add_epi16( _mm_unpackhi_epi8( T, zero ), vDc3 ), 2 );
+            xStoreRow_sse2( &pucDst[c], _mm_packus_epi16( L, H ), nLoad );
+        }
+        pucDst[0] = ( pucTop[0] + pucLeft[0] + 2 * nDcVal + 2 ) >> 2;
+        for( i=1; i<nSize; i++ ) {
+            pucDst[i*nDstStride] = ( pucLeft[-(Int)i] + 3 * nDcVal + 2 ) >> 2;
+        }
+    }
+}
+
+// ***************************************************************************
+// * Angular
+// ***************************************************************************
+// The horizontal modes are predicted in the final orientation. The output row y
+// take pucRefMain[iIdx(x) + 1 + y] for column x, so every row is a pshufb of the
+// reference window at offset y with the same per column index.
+X265_TARGET("ssse3")
+void xPredIntraAng_ssse3(
+    UInt8   *pucRef,
+    UInt8   *pucDst,
+    Int      nDstStride,
+     Int     nSize,
+    UInt     nMode,
+    UInt     bLuma
+)
+{
+    const UInt bModeHor         = (nMode < 18);
+    const Int  nIntraPredAngle  = g_aucIntraPredAngle[nMode];
+    // The loads of 16 pixels may read past 2*nSize, those pixels are never used
+    UInt8  ucRefBuf[4*MAX_CU_SIZE];
+    UInt8 *pucRefMain           = ucRefBuf + MAX_CU_SIZE;
+    const Int nLoad             = MIN( nSize, 16 );
+    Int    c, k;
+
+    xPredIntraAngRef( pucRef, pucRefMain, nSize, nMode );
+
+    if( !bModeHor ) {
+        Int deltaPos = 0;
+        for( k=0; k<nSize; k++ ) {
+            deltaPos += nIntraPredAngle;
+            const Int iIdx  = deltaPos >> 5;
+            const Int iFact = deltaPos & 31;
+            const __m128i W = _mm_set1_epi16( (iFact << 8) | (32 - iFact) );
+            for( c=0; c<nSize; c+=16 ) {
+                __m128i A = _mm_loadu_si128( (const __m128i *)&pucRefMain[iIdx + 1 + c] );
+                __m128i B = _mm_loadu_si128( (const __m128i *)&pucRefMain[iIdx + 2 + c] );
+                xStoreRow_sse2( &pucDst[k * nDstStride + c], xAngFilter_ssse3( A, B, W, W ), nLoad );
+            }
+        }
+    }
+    else {
+        for( c=0; c<nSize; c+=16 ) {
+            UInt8 aucIdx[16], aucWeight[32];
+            const Int nMinIdx = xAngHorColumns( nIntraPredAngle, nSize, c, aucIdx, aucWeight );
+            const __m128i vIdx = _mm_loadu_si128( (const __m128i *)aucIdx );
+            const __m128i W0   = _mm_loadu_si128( (const __m128i *)&aucWeight[ 0] );
+            const __m128i W1   = _mm_loadu_si128( (const __m128i *)&aucWeight[16] );
+            const UInt8 *P     = &pucRefMain[nMinIdx + 1];
+
+            for( k=0; k<nSize; k++ ) {
+                __m128i A = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&P[k + 0] ), vIdx );
+                __m128i B = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)&P[k + 1] ), vIdx );
+                xStoreRow_sse2( &pucDst[k * nDstStride + c], xAngFilter_ssse3( A, B, W0, W1 ), nLoad );
+            }
+        }
+    }
+
+    if( bLuma && (nIntraPredAngle == 0) ) {
+        xAngEdgeFilter( pucRef, pucDst, nDstStride, nSize, bModeHor );
+    }
+}
+
+// Two 16 pixels segments per register, both halves of a row for 32x32, two rows for 16x16
+X265_TARGET("avx2")
+void xPredIntraAng_avx2(
+    UInt8   *pucRef,
+    UInt8   *pucDst,
+    Int      nDstStride,
+     Int     nSize,
+    UInt     nMode,
+    UInt     bLuma
+)
+{
+    if( nSize < 16 ) {
+        xPredIntraAng_ssse3( pucRef, pucDst, nDstStride, nSize, nMode, bLuma );
+        return;
+    }
+
+    const UInt bModeHor         = (nMode < 18);
+    const Int  nIntraPredAngle  = g_aucIntraPredAngle[nMode];
+    UInt8  ucRefBuf[4*MAX_CU_SIZE];
+    UInt8 *pucRefMain           = ucRefBuf + MAX_CU_SIZE;
+    const Int nRowStep          = (nSize == 16 ? 2 : 1);
+    Int    k;
+
+    xPredIntraAngRef( pucRef, pucRefMain, nSize, nMode );
+
+    if( !bModeHor ) {
+        for( k=0; k<nSize; k+=nRowStep ) {
+            // Segment 0 is (row k, column 0), segment 1 is (row k, column 16) or (row k+1, column 0)
+            const Int deltaPos0 = (k + 1) * nIntraPredAngle;
+            const Int deltaPos1 = (k + nRowStep) * nIntraPredAngle;
+            const Int iOff0     = (deltaPos0 >> 5) + 1;
+            const Int iOff1     = (deltaPos1 >> 5) + 1 + (nSize == 32 ? 16 : 0);
+            const Int iFact0    = deltaPos0 & 31;
+            const Int iFact1    = deltaPos1 & 31;
+            const __m256i W = _mm256_setr_m128i( _mm_set1_epi16( (iFact0 << 8) | (32 - iFact0) ),
+                                                 _mm_set1_epi16( (iFact1 << 8) | (32 - iFact1) ) );
+            __m256i A = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff0] ),
+                                           _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff1] ) );
+            __m256i B = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff0 + 1] ),
+                                           _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff1 + 1] ) );
+            __m256i R = xAngFilter_avx2( A, B, W, W );
+            if( nSize == 32 ) {
+                _mm256_storeu_si256( (__m256i *)&pucDst[k * nDstStride], R );
+            }
+            else {
+                _mm_storeu_si128( (__m128i *)&pucDst[(k + 0) * nDstStride], _mm256_castsi256_si128( R ) );
+                _mm_storeu_si128( (__m128i *)&pucDst[(k + 1) * nDstStride], _mm256_extracti128_si256( R, 1 ) );
+            }
+        }
+    }
+    else {
+        UInt8 aucIdx[2][16], aucWeight[2][32];
+        Int nMinIdx0, nMinIdx1;
+        __m256i vIdx, W0, W1;
+
+        nMinIdx0 = xAngHorColumns( nIntraPredAngle, nSize, 0, aucIdx[0], aucWeight[0] );
+        if( nSize == 32 ) {
+            nMinIdx1 = xAngHorColumns( nIntraPredAngle, nSize, 16, aucIdx[1], aucWeight[1] );
+        }
+        else {
+            // The same columns on the next row
+            nMinIdx1 = nMinIdx0 + 1;
+            memcpy( aucIdx[1], aucIdx[0], sizeof(aucIdx[0]) );
+            memcpy( aucWeight[1], aucWeight[0], sizeof(aucWeight[0]) );
+        }
+        vIdx = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)aucIdx[0] ), _mm_loadu_si128( (const __m128i *)aucIdx[1] ) );
+        W0   = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&aucWeight[0][ 0] ), _mm_loadu_si128( (const __m128i *)&aucWeight[1][ 0] ) );
+        W1   = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&aucWeight[0][16] ), _mm_loadu_si128( (const __m128i *)&aucWeight[1][16] ) );
+
+        const UInt8 *P0 = &pucRefMain[nMinIdx0 + 1];
+        const UInt8 *P1 = &pucRefMain[nMinIdx1 + 1];
+        for( k=0; k<nSize; k+=nRowStep ) {
+            __m256i A = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&P0[k    ] ), _mm_loadu_si128( (const __m128i *)&P1[k    ] ) );
+            __m256i B = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&P0[k + 1] ), _mm_loadu_si128( (const __m128i *)&P1[k + 1] ) );
+            __m256i R = xAngFilter_avx2( _mm256_shuffle_epi8( A, vIdx ), _mm256_shuffle_epi8( B, vIdx ), W0, W1 );
+            if( nSize == 32 ) {
+                _mm256_storeu_si256( (__m256i *)&pucDst[k * nDstStride], R );
+            }
+            else {
+                _mm_storeu_si128( (__m128i *)&pucDst[(k + 0) * nDstStride], _mm256_castsi256_si128( R ) );
+                _mm_storeu_si128( (__m128i *)&pucDst[(k + 1) * nDstStride], _mm256_extracti128_si256( R, 1 ) );
+            }
+        }
+    }
+
+    if( bLuma && (nIntraPredAngle == 0) ) {
+        xAngEdgeFilter( pucRef, pucDst, nDstStride, nSize, bModeHor );
+    }
+}
+
+// ***************************************************************************
+// * Fused Angular Predict and SAD
+// ***************************************************************************
+X265_TARGET("ssse3")
+UInt32 xPredIntraAngSad_ssse3(
+    UInt8   *pucRefMain,
+    UInt8   *pucDst,
+    UInt8   *pucSrc,
+    Int      nStride,
+    Int      nSize,
+    Int      nIntraPredAngle,
+    UInt32   uiMaxSad
+)
+{
+    const Int nLoad     = MIN( nSize, 16 );
+    // Only the first nSize pixels of the 16 are compared
+    const __m128i vMask = (nSize == 4) ? _mm_setr_epi32( -1, 0, 0, 0 )
+                        : (nSize == 8) ? _mm_setr_epi32( -1, -1, 0, 0 )
+                        :                _mm_set1_epi32( -1 );
+    __m128i sum  = _mm_setzero_si128();
+    Int deltaPos = 0;
+    Int c, k;
+
+    for( k=0; k<nSize; k++ ) {
+        deltaPos += nIntraPredAngle;
+        const Int iIdx  = deltaPos >> 5;
+        const Int iFact = deltaPos & 31;
+        const __m128i W = _mm_set1_epi16( (iFact << 8) | (32 - iFact) );
+        for( c=0; c<nSize; c+=16 ) {
+            __m128i A = _mm_loadu_si128( (const __m128i *)&pucRefMain[iIdx + 1 + c] );
+            __m128i B = _mm_loadu_si128( (const __m128i *)&pucRefMain[iIdx + 2 + c] );
+            __m128i R = _mm_and_si128( xAngFilter_ssse3( A, B, W, W ), vMask );
+            xStoreRow_sse2( &pucDst[k * nStride + c], R, nLoad );
+            sum = _mm_add_epi32( sum, _mm_sad_epu8( R, xLoadRow_sse2( &pucSrc[k * nStride + c], nLoad ) ) );
+        }
+        // Check the early exit every 4 rows
+        if( (k & 3) == 3 ) {
+            UInt32 uiSad = _mm_cvtsi128_si32( _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) ) );
+            if( uiSad >= uiMaxSad )
+                return uiSad;
+        }
+    }
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+    return _mm_cvtsi128_si32( sum );
+}
+
+X265_TARGET("avx2")
+UInt32 xPredIntraAngSad_avx2(
+    UInt8   *pucRefMain,
+    UInt8   *pucDst,
+    UInt8   *pucSrc,
+    Int      nStride,
+    Int      nSize,
+    Int      nIntraPredAngle,
+    UInt32   uiMaxSad
+)
+{
+    if( nSize < 16 ) {
+        return xPredIntraAngSad_ssse3( pucRefMain, pucDst, pucSrc, nStride, nSize, nIntraPredAngle, uiMaxSad );
+    }
+
+    // Two 16 pixels segments per register, as xPredIntraAng_avx2
+    const Int nRowStep = (nSize == 16 ? 2 : 1);
+    __m256i sum = _mm256_setzero_si256();
+    Int k;
+
+    for( k=0; k<nSize; k+=nRowStep ) {
+        const Int deltaPos0 = (k + 1) * nIntraPredAngle;
+        const Int deltaPos1 = (k + nRowStep) * nIntraPredAngle;
+        const Int iOff0     = (deltaPos0 >> 5) + 1;
+        const Int iOff1     = (deltaPos1 >> 5) + 1 + (nSize == 32 ? 16 : 0);
+        const Int iFact0    = deltaPos0 & 31;
+        const Int iFact1    = deltaPos1 & 31;
+        const __m256i W = _mm256_setr_m128i( _mm_set1_epi16( (iFact0 << 8) | (32 - iFact0) ),
+                                             _mm_set1_epi16( (iFact1 << 8) | (32 - iFact1) ) );
+        __m256i A = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff0] ),
+                                       _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff1] ) );
+        __m256i B = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff0 + 1] ),
+                                       _mm_loadu_si128( (const __m128i *)&pucRefMain[iOff1 + 1] ) );
+        __m256i R = xAngFilter_avx2( A, B, W, W );
+        __m256i S;
+        if( nSize == 32 ) {
+            _mm256_storeu_si256( (__m256i *)&pucDst[k * nStride], R );
+            S = _mm256_loadu_si256( (const __m256i *)&pucSrc[k * nStride] );
+        }
+        else {
+            _mm_storeu_si128( (__m128i *)&pucDst[(k + 0) * nStride], _mm256_castsi256_si128( R ) );
+            _mm_storeu_si128( (__m128i *)&pucDst[(k + 1) * nStride], _mm256_extracti128_si256( R, 1 ) );
+            S = _mm256_setr_m128i( _mm_loadu_si128( (const __m128i *)&pucSrc[(k + 0) * nStride] ),
+                                   _mm_loadu_si128( (const __m128i *)&pucSrc[(k + 1) * nStride] ) );
+        }
+        sum = _mm256_add_epi32( sum, _mm256_sad_epu8( R, S ) );
+
+        // Check the early exit every 4 rows
+        if( ((k + nRowStep) & 3) == 0 ) {
+            __m128i T = _mm_add_epi32( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) );
+            UInt32 uiSad = _mm_cvtsi128_si32( _mm_add_epi32( T, _mm_srli_si128( T, 8 ) ) );
+            if( uiSad >= uiMaxSad )
+                return uiSad;
+        }
+    }
+    __m128i T = _mm_add_epi32( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) );
+    return _mm_cvtsi128_si32( _mm_add_epi32( T, _mm_srli_si128( T, 8 ) ) );
+}
+
+// ***************************************************************************
+// * LM Chroma
+// ***************************************************************************
+X265_TARGET("sse2")
+void xDownSampleLM_sse2(
+    UInt8   *pucDst,
+    UInt     nDstStride,
+    UInt8   *pucSrc,
+    UInt     nSrcStride,
+    UInt     nSize
+)
+{
+    const __m128i mask = _mm_set1_epi16( 0x00FF );
+    UInt y;
+
+    for( y=0; y<nSize; y++ ) {
+        const UInt8 *P0 = &pucSrc[(2*y+0) * nSrcStride];
+        const UInt8 *P1 = &pucSrc[(2*y+1) * nSrcStride];
+        __m128i L, H = _mm_setzero_si128();
+
+        // even columns of the two rows as words, the luma row is 2*nSize wide
+        L = _mm_add_epi16( _mm_and_si128( xLoadRow_sse2( P0, MIN(2*nSize, 16) ), mask ),
+                           _mm_and_si128( xLoadRow_sse2( P1, MIN(2*nSize, 16) ), mask ) );
+        if( nSize == 16 ) {
+            H = _mm_add_epi16( _mm_and_si128( _mm_loadu_si128( (const __m128i *)&P0[16] ), mask ),
+                               _mm_and_si128( _mm_loadu_si128( (const __m128i *)&P1[16] ), mask ) );
+        }
+        L = _mm_srli_epi16( L, 1 );
+        H = _mm_srli_epi16( H, 1 );
+        xStoreRow_sse2( &pucDst[y * nDstStride], _mm_packus_epi16( L, H ), nSize );
+    }
+}
+
+/// horizontal sum of the 4 dwords
+X265_TARGET("sse2")
+static ALWAYS_INLINE Int32 xHAdd32x4_sse2( __m128i S )
+{
+    S = _mm_add_epi32( S, _mm_srli_si128( S, 8 ) );
+    S = _mm_add_epi32( S, _mm_srli_si128( S, 4 ) );
+    return _mm_cvtsi128_si32( S );
+}
+
+// The left neighbours are pucRef[nSize] (bottom) to pucRef[2*nSize-1] (top) in both
+// the chroma and the LM reference, so the pairs of LC line up without a reverse.
+// |a| < 64 after xPredIntraLMParam(), PredLM * a fit in a word.
+X265_TARGET("sse2")
+void xPredIntraLM_sse2(
+    UInt8   *pucRefC,
+    UInt8   *pucRefLM,
+    UInt8   *pucPredLM,
+    UInt8   *pucDst,
+    UInt     nSize
+)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ML = xLoadRow_sse2( &pucRefLM[nSize        ], nSize );
+    const __m128i MT = xLoadRow_sse2( &pucRefLM[2 * nSize + 1], nSize );
+    const __m128i CL = xLoadRow_sse2( &pucRefC [nSize        ], nSize );
+    const __m128i CT = xLoadRow_sse2( &pucRefC [2 * nSize + 1], nSize );
+    __m128i SL, SC, SLL, SLC;
+    __m128i M0, M1, C0, C1;
+    Int32 a, b;
+    UInt y;
+
+    // L and C
+    SL = _mm_add_epi64( _mm_sad_epu8( ML, zero ), _mm_sad_epu8( MT, zero ) );
+    SC = _mm_add_epi64( _mm_sad_epu8( CL, zero ), _mm_sad_epu8( CT, zero ) );
+    SL = _mm_add_epi32( SL, _mm_srli_si128( SL, 8 ) );
+    SC = _mm_add_epi32( SC, _mm_srli_si128( SC, 8 ) );
+
+    // LL and LC
+    M0  = _mm_unpacklo_epi8( ML, zero );
+    M1  = _mm_unpackhi_epi8( ML, zero );
+    C0  = _mm_unpacklo_epi8( CL, zero );
+    C1  = _mm_unpackhi_epi8( CL, zero );
+    SLL = _mm_add_epi32( _mm_madd_epi16( M0, M0 ), _mm_madd_epi16( M1, M1 ) );
+    SLC = _mm_add_epi32( _mm_madd_epi16( M0, C0 ), _mm_madd_epi16( M1, C1 ) );
+    M0  = _mm_unpacklo_epi8( MT, zero );
+    M1  = _mm_unpackhi_epi8( MT, zero );
+    C0  = _mm_unpacklo_epi8( CT, zero );
+    C1  = _mm_unpackhi_epi8( CT, zero );
+    SLL = _mm_add_epi32( SLL, _mm_add_epi32( _mm_madd_epi16( M0, M0 ), _mm_madd_epi16( M1, M1 ) ) );
+    SLC = _mm_add_epi32( SLC, _mm_add_epi32( _mm_madd_epi16( M0, C0 ), _mm_madd_epi16( M1, C1 ) ) );
+
+    const Int nShift = xPredIntraLMParam( _mm_cvtsi128_si32( SL ),
+                                          _mm_cvtsi128_si32( SC ),
+                                          xHAdd32x4_sse2( SLL ),
+                                          xHAdd32x4_sse2( SLC ),
+                                          nSize, &a, &b );
+    const __m128i vA     = _mm_set1_epi16( (Int16)a );
+    const __m128i vB     = _mm_set1_epi16( (Int16)b );
+    const __m128i vShift = _mm_cvtsi32_si128( nShift );
+
+    for( y=0; y<nSize; y++ ) {
+        const __m128i P = xLoadRow_sse2( &pucPredLM[y * MAX_CU_SIZE/2], nSize );
+        __m128i L = _mm_mullo_epi16( _mm_unpacklo_epi8( P, zero ), vA );
+        __m128i H = _mm_mullo_epi16( _mm_unpackhi_epi8( P, zero ), vA );
+        L = _mm_add_epi16( _mm_sra_epi16( L, vShift ), vB );
+        H = _mm_add_epi16( _mm_sra_epi16( H, vShift ), vB );
+        xStoreRow_sse2( &pucDst[y * MAX_CU_SIZE/2], _mm_packus_epi16( L, H ), nSize );
+    }
+}
+
+#endif /* ARCH_X86 */
@@ -22,7 +22,7 @@
  * For more information, contact us at chenm003@163.com.
  *****************************************************************************/
 
-#include "md5.h"
+#include "x265.h"
 
 #ifndef ARCH_BIG_ENDIAN
 #define byteReverse(buf, len)   /* Nothing */
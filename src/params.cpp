@@ -44,6 +44,19 @@ void xDefaultParams(X265_t *h)
     h->ucBitsForPOC                 =  8;
     h->ucMaxNumMergeCand            = MRG_MAX_NUM_CANDS_SIGNALED;
     h->ucTSIG                       =  5;
+    h->ucCpuLevel                   = CPU_LEVEL_AUTO;
+    h->ucThreads                    =  0;
+    h->ucFrameThreads               =  0;
+    h->pPool                        = NULL;
+    h->ucAsyncDepth                 =  0;
+    h->pfnOutput                    = NULL;
+    h->pOutputArg                   = NULL;
+    h->ucSliceMode                  = SLICE_MODE_NONE;
+    h->usSliceArg                   =  0;
+    h->ucTileCols                   =  1;
+    h->ucTileRows                   =  1;
+    memset( h->aucTileColWidth,  0, sizeof(h->aucTileColWidth) );
+    memset( h->aucTileRowHeight, 0, sizeof(h->aucTileRowHeight) );
 
     // Feature
     h->bUseNewRefSetting            = FALSE;
@@ -53,6 +66,16 @@ void xDefaultParams(X265_t *h)
     h->bLoopFilterDisable           = TRUE;
     h->bSignHideFlag                = FALSE;
     h->bEnableTMVPFlag              = TRUE;
+    h->bUseSATD                     = FALSE;
+    h->bUseRawRBSP                  = TRUE;
+#ifdef CHECK_SEI
+    h->ucHashSEI                    = HASH_MD5;
+#else
+    h->ucHashSEI                    = HASH_NONE;
+#endif
+    h->bUseWPP                      = FALSE;
+    h->bTileUniform                 = TRUE;
+    h->bThreadAffinity              = FALSE;
 }
 
 int confirmPara(int bflag, const char* message)
@@ -75,6 +98,43 @@ int xCheckParams( X265_t *h )
     xConfirmPara( h->ucMaxNumRefFrames > MAX_REF_NUM, "Currently, x265 can not support so many reference");
     xConfirmPara( h->ucMaxCUWidth < 16, "Maximum partition width size should be larger than or equal to 16");
     xConfirmPara( h->ucQuadtreeTULog2MaxSize != 5, "Maximum transform width size should be equal to 32" );
+    xConfirmPara( h->ucCpuLevel > CPU_LEVEL_AVX2 && h->ucCpuLevel != CPU_LEVEL_AUTO, "Unknown CPU level" );
+    xConfirmPara( h->ucHashSEI > HASH_CHECKSUM, "Unknown picture hash method" );
+    xConfirmPara( h->ucSliceMode > SLICE_MODE_ROWS, "Unknown slice mode" );
+    xConfirmPara( h->ucSliceMode != SLICE_MODE_NONE && h->usSliceArg == 0, "Slice size should be larger than 0" );
+    xConfirmPara( h->ucSliceMode != SLICE_MODE_NONE && h->bUseWPP, "WPP can not be used with multiple slices" );
+    if( h->ucSliceMode != SLICE_MODE_NONE && h->usSliceArg != 0 && h->ucMaxCUWidth != 0 ) {
+        const UInt32 nCols      = h->usWidth  / h->ucMaxCUWidth;
+        const UInt32 nCUs       = nCols * (h->usHeight / h->ucMaxCUWidth);
+        const UInt32 nSliceCUs  = h->usSliceArg * (h->ucSliceMode == SLICE_MODE_ROWS ? nCols : 1);
+        xConfirmPara( (nCUs + nSliceCUs - 1) / nSliceCUs > MAX_SLICES, "Too many slices per picture" );
+    }
+    xConfirmPara( h->ucFrameThreads > MAX_FRAME_THREADS, "Too many frame threads" );
+    xConfirmPara( h->ucTileCols == 0 || h->ucTileCols > MAX_TILE_COLS, "Tile columns should be in 1 to 20" );
+    xConfirmPara( h->ucTileRows == 0 || h->ucTileRows > MAX_TILE_ROWS, "Tile rows should be in 1 to 22" );
+    xConfirmPara( h->ucTileCols * h->ucTileRows > 1 && h->bUseWPP, "WPP can not be used with tiles" );
+    xConfirmPara( h->ucTileCols * h->ucTileRows > 1 && h->ucSliceMode != SLICE_MODE_NONE, "Multiple slices can not be used with tiles" );
+    if( h->ucTileCols <= MAX_TILE_COLS && h->ucTileRows <= MAX_TILE_ROWS && h->ucMaxCUWidth != 0 ) {
+        const UInt32 nCols      = h->usWidth  / h->ucMaxCUWidth;
+        const UInt32 nRows      = h->usHeight / h->ucMaxCUWidth;
+        UInt32 nSum;
+        UInt i;
+
+        xConfirmPara( h->ucTileCols > nCols, "Tile columns should not be more than the CTU columns" );
+        xConfirmPara( h->ucTileRows > nRows, "Tile rows should not be more than the CTU rows" );
+        if( !h->bTileUniform ) {
+            for( i=0, nSum=0; i+1 < h->ucTileCols; i++ ) {
+                xConfirmPara( h->aucTileColWidth[i] == 0, "Tile column width should be larger than 0" );
+                nSum += h->aucTileColWidth[i];
+            }
+            xConfirmPara( h->ucTileCols > 1 && nSum >= nCols, "Tile columns are wider than the picture" );
+            for( i=0, nSum=0; i+1 < h->ucTileRows; i++ ) {
+                xConfirmPara( h->aucTileRowHeight[i] == 0, "Tile row height should be larger than 0" );
+                nSum += h->aucTileRowHeight[i];
+            }
+            xConfirmPara( h->ucTileRows > 1 && nSum >= nRows, "Tile rows are higher than the picture" );
+        }
+    }
 
 #undef xConfirmPara
     if (check_failed)
@@ -92,14 +92,149 @@ UInt32 xSad4xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UI
     return uiSad;
 }
 
-xSad *xSadN[MAX_CU_DEPTH+1] = {
-    xSad4xN,    /*  4 x N */
-    xSad8xN,    /*  8 x N */
-    xSad16xN,   /* 16 x N */
-    xSad32xN,   /* 32 x N */
-    xSad64xN,   /* 64 x N */
-};
+// ***************************************************************************
+// * SATD Functions
+// ***************************************************************************
+/// sum of the absolute 4x4 Hadamard transformed difference, (x + 1) >> 1 as HM
+static UInt32 xSatd4x4( const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    Int32 D[16], M[16];
+    UInt32 uiSatd = 0;
+    Int i;
+
+    for( i=0; i<4; i++ ) {
+        D[i*4+0] = pSrc[i * nStrideSrc + 0] - pRef[i * nStrideRef + 0];
+        D[i*4+1] = pSrc[i * nStrideSrc + 1] - pRef[i * nStrideRef + 1];
+        D[i*4+2] = pSrc[i * nStrideSrc + 2] - pRef[i * nStrideRef + 2];
+        D[i*4+3] = pSrc[i * nStrideSrc + 3] - pRef[i * nStrideRef + 3];
+    }
+
+    // Horizontal
+    for( i=0; i<4; i++ ) {
+        Int32 a0 = D[i*4+0] + D[i*4+1];
+        Int32 a1 = D[i*4+0] - D[i*4+1];
+        Int32 a2 = D[i*4+2] + D[i*4+3];
+        Int32 a3 = D[i*4+2] - D[i*4+3];
+        M[i*4+0] = a0 + a2;
+        M[i*4+1] = a1 + a3;
+        M[i*4+2] = a0 - a2;
+        M[i*4+3] = a1 - a3;
+    }
+
+    // Vertical
+    for( i=0; i<4; i++ ) {
+        Int32 a0 = M[0*4+i] + M[1*4+i];
+        Int32 a1 = M[0*4+i] - M[1*4+i];
+        Int32 a2 = M[2*4+i] + M[3*4+i];
+        Int32 a3 = M[2*4+i] - M[3*4+i];
+        uiSatd += abs( a0 + a2 ) + abs( a1 + a3 ) + abs( a0 - a2 ) + abs( a1 - a3 );
+    }
+    return (uiSatd + 1) >> 1;
+}
+
+/// sum of the absolute 8x8 Hadamard transformed difference, (x + 2) >> 2 as HM
+static UInt32 xSatd8x8( const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    Int32 M[64];
+    UInt32 uiSatd = 0;
+    Int i, j, k;
+
+    for( i=0; i<8; i++ ) {
+        for( j=0; j<8; j++ ) {
+            M[i*8+j] = pSrc[i * nStrideSrc + j] - pRef[i * nStrideRef + j];
+        }
+    }
+
+    // Horizontal and then vertical butterflies, the order of the output is not care
+    for( k=1; k<8; k<<=1 ) {
+        for( i=0; i<8; i++ ) {
+            for( j=0; j<8; j++ ) {
+                if( !(j & k) ) {
+                    Int32 a = M[i*8+j];
+                    Int32 b = M[i*8+j+k];
+                    M[i*8+j  ] = a + b;
+                    M[i*8+j+k] = a - b;
+                }
+            }
+        }
+    }
+    for( k=1; k<8; k<<=1 ) {
+        for( i=0; i<8; i++ ) {
+            if( !(i & k) ) {
+                for( j=0; j<8; j++ ) {
+                    Int32 a = M[(i  )*8+j];
+                    Int32 b = M[(i+k)*8+j];
+                    M[(i  )*8+j] = a + b;
+                    M[(i+k)*8+j] = a - b;
+                }
+            }
+        }
+    }
+
+    for( i=0; i<64; i++ ) {
+        uiSatd += abs( M[i] );
+    }
+    return (uiSatd + 2) >> 2;
+}
+
+UInt32 xSatd4xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    UInt32 uiSatd = 0;
+    UInt y;
+
+    for( y=0; y<N; y+=4 ) {
+        uiSatd += xSatd4x4( &pSrc[y * nStrideSrc], nStrideSrc, &pRef[y * nStrideRef], nStrideRef );
+    }
+    return uiSatd;
+}
+
+/// the width is 8 to 64, every 8x8 block is done by xSatd8x8
+static UInt32 xSatdWxN( const UInt W, const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    UInt32 uiSatd = 0;
+    UInt x, y;
+
+    for( y=0; y<N; y+=8 ) {
+        for( x=0; x<W; x+=8 ) {
+            uiSatd += xSatd8x8( &pSrc[y * nStrideSrc + x], nStrideSrc, &pRef[y * nStrideRef + x], nStrideRef );
+        }
+    }
+    return uiSatd;
+}
+
+UInt32 xSatd8xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN( 8, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+UInt32 xSatd16xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN( 16, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+UInt32 xSatd32xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN( 32, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+UInt32 xSatd64xN( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN( 64, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
 
+// ***************************************************************************
+// * Transpose Functions
+// ***************************************************************************
+void xTranspose( UInt8 *pDst, UInt8 *pSrc, UInt nStride, UInt nSize )
+{
+    UInt x, y;
+
+    for( y=0; y<nSize; y++ ) {
+        for( x=0; x<nSize; x++ ) {
+            pDst[x * nStride + y] = pSrc[y * nStride + x];
+        }
+    }
+}
 
 // ***************************************************************************
 // * DCT Functions
@@ -317,73 +452,85 @@ void xDCT32( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
  *  \param pDst   output data (transpose transform coefficients)
  *  \param nLines transform lines
  *  \param nShift specifies right shift after 1D transform
+ *  \param nCoeffs number of input rows may be nonzero, the remaining rows are not read
  */
-void xInvDCT4( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+void xInvDCT4( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
 {
-    int i;
+    int i, j;
     int rnd = 1<<(nShift-1);
 
     for( i=0; i<nLines; i++ ) {
+        Int32 S[4];
+
+        /* The rows from nCoeffs are all zero, skip them */
+        for( j=0; j<4; j++ ) {
+            S[j] = (j < nCoeffs) ? pSrc[j*nStride+i] : 0;
+        }
+
         /* Utilizing symmetry properties to the maximum to minimize the number of multiplications */
-        Int32 O0 = g_aiT4[1*4+0]*pSrc[1*nStride+i] + g_aiT4[3*4+0]*pSrc[3*nStride+i];
-        Int32 O1 = g_aiT4[1*4+1]*pSrc[1*nStride+i] + g_aiT4[3*4+1]*pSrc[3*nStride+i];
-        Int32 E0 = g_aiT4[0*4+0]*pSrc[0*nStride+i] + g_aiT4[2*4+0]*pSrc[2*nStride+i];
-        Int32 E1 = g_aiT4[0*4+1]*pSrc[0*nStride+i] + g_aiT4[2*4+1]*pSrc[2*nStride+i];
+        Int32 O0 = g_aiT4[1*4+0]*S[1] + g_aiT4[3*4+0]*S[3];
+        Int32 O1 = g_aiT4[1*4+1]*S[1] + g_aiT4[3*4+1]*S[3];
+        Int32 E0 = g_aiT4[0*4+0]*S[0] + g_aiT4[2*4+0]*S[2];
+        Int32 E1 = g_aiT4[0*4+1]*S[0] + g_aiT4[2*4+1]*S[2];
 
         /* Combining even and odd terms at each hierarchy levels to calculate the final spatial domain vector */
-        pDst[i*nStride+0] = (E0 + O0 + rnd) >> nShift;
-        pDst[i*nStride+1] = (E1 + O1 + rnd) >> nShift;
-        pDst[i*nStride+2] = (E1 - O1 + rnd) >> nShift;
-        pDst[i*nStride+3] = (E0 - O0 + rnd) >> nShift;
-
-        pDst[i*nStride+0] = Clip3( -32768, 32767, pDst[i*nStride+0] );
-        pDst[i*nStride+1] = Clip3( -32768, 32767, pDst[i*nStride+1] );
-        pDst[i*nStride+2] = Clip3( -32768, 32767, pDst[i*nStride+2] );
-        pDst[i*nStride+3] = Clip3( -32768, 32767, pDst[i*nStride+3] );
+        pDst[i*nStride+0] = Clip3( -32768, 32767, (E0 + O0 + rnd) >> nShift );
+        pDst[i*nStride+1] = Clip3( -32768, 32767, (E1 + O1 + rnd) >> nShift );
+        pDst[i*nStride+2] = Clip3( -32768, 32767, (E1 - O1 + rnd) >> nShift );
+        pDst[i*nStride+3] = Clip3( -32768, 32767, (E0 - O0 + rnd) >> nShift );
     }
 }
 
-void xInvDST4( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+void xInvDST4( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
 {
-    int i;
+    int i, j;
     int rnd = 1 << (nShift-1);
 
-    for( i=0; i<4; i++ ) {
+    for( i=0; i<nLines; i++ ) {
+        Int32 S[4];
+
+        /* The rows from nCoeffs are all zero, skip them */
+        for( j=0; j<4; j++ ) {
+            S[j] = (j < nCoeffs) ? pSrc[j*nStride+i] : 0;
+        }
+
         // Intermediate Variables
-        Int32 c0 = pSrc[0*nStride+i] + pSrc[2*nStride+i];
-        Int32 c1 = pSrc[2*nStride+i] + pSrc[3*nStride+i];
-        Int32 c2 = pSrc[0*nStride+i] - pSrc[3*nStride+i];
-        Int32 c3 = 74* pSrc[1*nStride+i];
-        Int32 c4 = pSrc[0*nStride+i] - pSrc[2*nStride+i] + pSrc[3*nStride+i];
-
-        pDst[i*nStride+0] = ( 29 * c0 + 55 * c1 + c3 + rnd ) >> nShift;
-        pDst[i*nStride+1] = ( 55 * c2 - 29 * c1 + c3 + rnd ) >> nShift;
-        pDst[i*nStride+2] = ( 74 * c4                + rnd ) >> nShift;
-        pDst[i*nStride+3] = ( 55 * c0 + 29 * c2 - c3 + rnd ) >> nShift;
-
-        pDst[i*nStride+0] = Clip3( -32768, 32767, pDst[i*nStride+0] );
-        pDst[i*nStride+1] = Clip3( -32768, 32767, pDst[i*nStride+1] );
-        pDst[i*nStride+2] = Clip3( -32768, 32767, pDst[i*nStride+2] );
-        pDst[i*nStride+3] = Clip3( -32768, 32767, pDst[i*nStride+3] );
+        Int32 c0 = S[0] + S[2];
+        Int32 c1 = S[2] + S[3];
+        Int32 c2 = S[0] - S[3];
+        Int32 c3 = 74* S[1];
+        Int32 c4 = S[0] - S[2] + S[3];
+
+        pDst[i*nStride+0] = Clip3( -32768, 32767, ( 29 * c0 + 55 * c1 + c3 + rnd ) >> nShift );
+        pDst[i*nStride+1] = Clip3( -32768, 32767, ( 55 * c2 - 29 * c1 + c3 + rnd ) >> nShift );
+        pDst[i*nStride+2] = Clip3( -32768, 32767, ( 74 * c4                + rnd ) >> nShift );
+        pDst[i*nStride+3] = Clip3( -32768, 32767, ( 55 * c0 + 29 * c2 - c3 + rnd ) >> nShift );
   }
 }
 
-void xInvDCT8( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+void xInvDCT8( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
 {
-    int i;
+    int i, j;
     int rnd = 1<<(nShift-1);
 
     for( i=0; i<nLines; i++ ) {
+        Int32 S[8];
+
+        /* The rows from nCoeffs are all zero, skip them */
+        for( j=0; j<8; j++ ) {
+            S[j] = (j < nCoeffs) ? pSrc[j*nStride+i] : 0;
+        }
+
         /* Utilizing symmetry properties to the maximum to minimize the number of multiplications */
-        Int32 O0 = g_aiT8[1*8+0]*pSrc[1*nStride+i] + g_aiT8[3*8+0]*pSrc[3*nStride+i] + g_aiT8[5*8+0]*pSrc[5*nStride+i] + g_aiT8[7*8+0]*pSrc[7*nStride+i];
-        Int32 O1 = g_aiT8[1*8+1]*pSrc[1*nStride+i] + g_aiT8[3*8+1]*pSrc[3*nStride+i] + g_aiT8[5*8+1]*pSrc[5*nStride+i] + g_aiT8[7*8+1]*pSrc[7*nStride+i];
-        Int32 O2 = g_aiT8[1*8+2]*pSrc[1*nStride+i] + g_aiT8[3*8+2]*pSrc[3*nStride+i] + g_aiT8[5*8+2]*pSrc[5*nStride+i] + g_aiT8[7*8+2]*pSrc[7*nStride+i];
-        Int32 O3 = g_aiT8[1*8+3]*pSrc[1*nStride+i] + g_aiT8[3*8+3]*pSrc[3*nStride+i] + g_aiT8[5*8+3]*pSrc[5*nStride+i] + g_aiT8[7*8+3]*pSrc[7*nStride+i];
+        Int32 O0 = g_aiT8[1*8+0]*S[1] + g_aiT8[3*8+0]*S[3] + g_aiT8[5*8+0]*S[5] + g_aiT8[7*8+0]*S[7];
+        Int32 O1 = g_aiT8[1*8+1]*S[1] + g_aiT8[3*8+1]*S[3] + g_aiT8[5*8+1]*S[5] + g_aiT8[7*8+1]*S[7];
+        Int32 O2 = g_aiT8[1*8+2]*S[1] + g_aiT8[3*8+2]*S[3] + g_aiT8[5*8+2]*S[5] + g_aiT8[7*8+2]*S[7];
+        Int32 O3 = g_aiT8[1*8+3]*S[1] + g_aiT8[3*8+3]*S[3] + g_aiT8[5*8+3]*S[5] + g_aiT8[7*8+3]*S[7];
 
-        Int32 EO0 = g_aiT8[2*8+0]*pSrc[2*nStride+i] + g_aiT8[6*8+0]*pSrc[6*nStride+i];
-        Int32 EO1 = g_aiT8[2*8+1]*pSrc[2*nStride+i] + g_aiT8[6*8+1]*pSrc[6*nStride+i];
-        Int32 EE0 = g_aiT8[0*8+0]*pSrc[0*nStride+i] + g_aiT8[4*8+0]*pSrc[4*nStride+i];
-        Int32 EE1 = g_aiT8[0*8+1]*pSrc[0*nStride+i] + g_aiT8[4*8+1]*pSrc[4*nStride+i];
+        Int32 EO0 = g_aiT8[2*8+0]*S[2] + g_aiT8[6*8+0]*S[6];
+        Int32 EO1 = g_aiT8[2*8+1]*S[2] + g_aiT8[6*8+1]*S[6];
+        Int32 EE0 = g_aiT8[0*8+0]*S[0] + g_aiT8[4*8+0]*S[4];
+        Int32 EE1 = g_aiT8[0*8+1]*S[0] + g_aiT8[4*8+1]*S[4];
 
         /* Combining even and odd terms at each hierarchy levels to calculate the final spatial domain vector */
         Int32 E0 = EE0 + EO0;
@@ -391,58 +538,57 @@ void xInvDCT8( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
         Int32 E1 = EE1 + EO1;
         Int32 E2 = EE1 - EO1;
 
-        pDst[i*nStride+0] = (E0 + O0 + rnd) >> nShift;
-        pDst[i*nStride+1] = (E1 + O1 + rnd) >> nShift;
-        pDst[i*nStride+2] = (E2 + O2 + rnd) >> nShift;
-        pDst[i*nStride+3] = (E3 + O3 + rnd) >> nShift;
-        pDst[i*nStride+4] = (E3 - O3 + rnd) >> nShift;
-        pDst[i*nStride+5] = (E2 - O2 + rnd) >> nShift;
-        pDst[i*nStride+6] = (E1 - O1 + rnd) >> nShift;
-        pDst[i*nStride+7] = (E0 - O0 + rnd) >> nShift;
-        pDst[i*nStride+0] = Clip3( -32768, 32767, pDst[i*nStride+0] );
-        pDst[i*nStride+1] = Clip3( -32768, 32767, pDst[i*nStride+1] );
-        pDst[i*nStride+2] = Clip3( -32768, 32767, pDst[i*nStride+2] );
-        pDst[i*nStride+3] = Clip3( -32768, 32767, pDst[i*nStride+3] );
-        pDst[i*nStride+4] = Clip3( -32768, 32767, pDst[i*nStride+4] );
-        pDst[i*nStride+5] = Clip3( -32768, 32767, pDst[i*nStride+5] );
-        pDst[i*nStride+6] = Clip3( -32768, 32767, pDst[i*nStride+6] );
-        pDst[i*nStride+7] = Clip3( -32768, 32767, pDst[i*nStride+7] );
+        pDst[i*nStride+0] = Clip3( -32768, 32767, (E0 + O0 + rnd) >> nShift );
+        pDst[i*nStride+1] = Clip3( -32768, 32767, (E1 + O1 + rnd) >> nShift );
+        pDst[i*nStride+2] = Clip3( -32768, 32767, (E2 + O2 + rnd) >> nShift );
+        pDst[i*nStride+3] = Clip3( -32768, 32767, (E3 + O3 + rnd) >> nShift );
+        pDst[i*nStride+4] = Clip3( -32768, 32767, (E3 - O3 + rnd) >> nShift );
+        pDst[i*nStride+5] = Clip3( -32768, 32767, (E2 - O2 + rnd) >> nShift );
+        pDst[i*nStride+6] = Clip3( -32768, 32767, (E1 - O1 + rnd) >> nShift );
+        pDst[i*nStride+7] = Clip3( -32768, 32767, (E0 - O0 + rnd) >> nShift );
     }
 }
 
-void xInvDCT16( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+void xInvDCT16( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
 {
-    int i;
+    int i, j;
     int rnd = 1<<(nShift-1);
 
     for( i=0; i<nLines; i++ ) {
+        Int32 S[16];
+
+        /* The rows from nCoeffs are all zero, skip them */
+        for( j=0; j<16; j++ ) {
+            S[j] = (j < nCoeffs) ? pSrc[j*nStride+i] : 0;
+        }
+
         /* Utilizing symmetry properties to the maximum to minimize the number of multiplications */
-        Int32 O0 =   g_aiT16[ 1*16+0]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+0]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+0]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+0]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+0]*pSrc[ 9*nStride+i] + g_aiT16[11*16+0]*pSrc[11*nStride+i] + g_aiT16[13*16+0]*pSrc[13*nStride+i] + g_aiT16[15*16+0]*pSrc[15*nStride+i];
-        Int32 O1 =   g_aiT16[ 1*16+1]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+1]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+1]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+1]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+1]*pSrc[ 9*nStride+i] + g_aiT16[11*16+1]*pSrc[11*nStride+i] + g_aiT16[13*16+1]*pSrc[13*nStride+i] + g_aiT16[15*16+1]*pSrc[15*nStride+i];
-        Int32 O2 =   g_aiT16[ 1*16+2]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+2]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+2]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+2]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+2]*pSrc[ 9*nStride+i] + g_aiT16[11*16+2]*pSrc[11*nStride+i] + g_aiT16[13*16+2]*pSrc[13*nStride+i] + g_aiT16[15*16+2]*pSrc[15*nStride+i];
-        Int32 O3 =   g_aiT16[ 1*16+3]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+3]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+3]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+3]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+3]*pSrc[ 9*nStride+i] + g_aiT16[11*16+3]*pSrc[11*nStride+i] + g_aiT16[13*16+3]*pSrc[13*nStride+i] + g_aiT16[15*16+3]*pSrc[15*nStride+i];
-        Int32 O4 =   g_aiT16[ 1*16+4]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+4]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+4]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+4]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+4]*pSrc[ 9*nStride+i] + g_aiT16[11*16+4]*pSrc[11*nStride+i] + g_aiT16[13*16+4]*pSrc[13*nStride+i] + g_aiT16[15*16+4]*pSrc[15*nStride+i];
-        Int32 O5 =   g_aiT16[ 1*16+5]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+5]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+5]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+5]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+5]*pSrc[ 9*nStride+i] + g_aiT16[11*16+5]*pSrc[11*nStride+i] + g_aiT16[13*16+5]*pSrc[13*nStride+i] + g_aiT16[15*16+5]*pSrc[15*nStride+i];
-        Int32 O6 =   g_aiT16[ 1*16+6]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+6]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+6]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+6]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+6]*pSrc[ 9*nStride+i] + g_aiT16[11*16+6]*pSrc[11*nStride+i] + g_aiT16[13*16+6]*pSrc[13*nStride+i] + g_aiT16[15*16+6]*pSrc[15*nStride+i];
-        Int32 O7 =   g_aiT16[ 1*16+7]*pSrc[ 1*nStride+i] + g_aiT16[ 3*16+7]*pSrc[ 3*nStride+i] + g_aiT16[ 5*16+7]*pSrc[ 5*nStride+i] + g_aiT16[ 7*16+7]*pSrc[ 7*nStride+i]
-                   + g_aiT16[ 9*16+7]*pSrc[ 9*nStride+i] + g_aiT16[11*16+7]*pSrc[11*nStride+i] + g_aiT16[13*16+7]*pSrc[13*nStride+i] + g_aiT16[15*16+7]*pSrc[15*nStride+i];
-
-        Int32 EO0 = g_aiT16[ 2*16+0]*pSrc[ 2*nStride+i] + g_aiT16[ 6*16+0]*pSrc[ 6*nStride+i] + g_aiT16[10*16+0]*pSrc[10*nStride+i] + g_aiT16[14*16+0]*pSrc[14*nStride+i];
-        Int32 EO1 = g_aiT16[ 2*16+1]*pSrc[ 2*nStride+i] + g_aiT16[ 6*16+1]*pSrc[ 6*nStride+i] + g_aiT16[10*16+1]*pSrc[10*nStride+i] + g_aiT16[14*16+1]*pSrc[14*nStride+i];
-        Int32 EO2 = g_aiT16[ 2*16+2]*pSrc[ 2*nStride+i] + g_aiT16[ 6*16+2]*pSrc[ 6*nStride+i] + g_aiT16[10*16+2]*pSrc[10*nStride+i] + g_aiT16[14*16+2]*pSrc[14*nStride+i];
-        Int32 EO3 = g_aiT16[ 2*16+3]*pSrc[ 2*nStride+i] + g_aiT16[ 6*16+3]*pSrc[ 6*nStride+i] + g_aiT16[10*16+3]*pSrc[10*nStride+i] + g_aiT16[14*16+3]*pSrc[14*nStride+i];
-
-        Int32 EEO0 = g_aiT16[4*16+0]*pSrc[4*nStride+i] + g_aiT16[12*16+0]*pSrc[12*nStride+i];
-        Int32 EEO1 = g_aiT16[4*16+1]*pSrc[4*nStride+i] + g_aiT16[12*16+1]*pSrc[12*nStride+i];
-        Int32 EEE0 = g_aiT16[0*16+0]*pSrc[0*nStride+i] + g_aiT16[ 8*16+0]*pSrc[ 8*nStride+i];
-        Int32 EEE1 = g_aiT16[0*16+1]*pSrc[0*nStride+i] + g_aiT16[ 8*16+1]*pSrc[ 8*nStride+i];
+        Int32 O0 =   g_aiT16[ 1*16+0]*S[ 1] + g_aiT16[ 3*16+0]*S[ 3] + g_aiT16[ 5*16+0]*S[ 5] + g_aiT16[ 7*16+0]*S[ 7]
+                   + g_aiT16[ 9*16+0]*S[ 9] + g_aiT16[11*16+0]*S[11] + g_aiT16[13*16+0]*S[13] + g_aiT16[15*16+0]*S[15];
+        Int32 O1 =   g_aiT16[ 1*16+1]*S[ 1] + g_aiT16[ 3*16+1]*S[ 3] + g_aiT16[ 5*16+1]*S[ 5] + g_aiT16[ 7*16+1]*S[ 7]
+                   + g_aiT16[ 9*16+1]*S[ 9] + g_aiT16[11*16+1]*S[11] + g_aiT16[13*16+1]*S[13] + g_aiT16[15*16+1]*S[15];
+        Int32 O2 =   g_aiT16[ 1*16+2]*S[ 1] + g_aiT16[ 3*16+2]*S[ 3] + g_aiT16[ 5*16+2]*S[ 5] + g_aiT16[ 7*16+2]*S[ 7]
+                   + g_aiT16[ 9*16+2]*S[ 9] + g_aiT16[11*16+2]*S[11] + g_aiT16[13*16+2]*S[13] + g_aiT16[15*16+2]*S[15];
+        Int32 O3 =   g_aiT16[ 1*16+3]*S[ 1] + g_aiT16[ 3*16+3]*S[ 3] + g_aiT16[ 5*16+3]*S[ 5] + g_aiT16[ 7*16+3]*S[ 7]
+                   + g_aiT16[ 9*16+3]*S[ 9] + g_aiT16[11*16+3]*S[11] + g_aiT16[13*16+3]*S[13] + g_aiT16[15*16+3]*S[15];
+        Int32 O4 =   g_aiT16[ 1*16+4]*S[ 1] + g_aiT16[ 3*16+4]*S[ 3] + g_aiT16[ 5*16+4]*S[ 5] + g_aiT16[ 7*16+4]*S[ 7]
+                   + g_aiT16[ 9*16+4]*S[ 9] + g_aiT16[11*16+4]*S[11] + g_aiT16[13*16+4]*S[13] + g_aiT16[15*16+4]*S[15];
+        Int32 O5 =   g_aiT16[ 1*16+5]*S[ 1] + g_aiT16[ 3*16+5]*S[ 3] + g_aiT16[ 5*16+5]*S[ 5] + g_aiT16[ 7*16+5]*S[ 7]
+                   + g_aiT16[ 9*16+5]*S[ 9] + g_aiT16[11*16+5]*S[11] + g_aiT16[13*16+5]*S[13] + g_aiT16[15*16+5]*S[15];
+        Int32 O6 =   g_aiT16[ 1*16+6]*S[ 1] + g_aiT16[ 3*16+6]*S[ 3] + g_aiT16[ 5*16+6]*S[ 5] + g_aiT16[ 7*16+6]*S[ 7]
+                   + g_aiT16[ 9*16+6]*S[ 9] + g_aiT16[11*16+6]*S[11] + g_aiT16[13*16+6]*S[13] + g_aiT16[15*16+6]*S[15];
+        Int32 O7 =   g_aiT16[ 1*16+7]*S[ 1] + g_aiT16[ 3*16+7]*S[ 3] + g_aiT16[ 5*16+7]*S[ 5] + g_aiT16[ 7*16+7]*S[ 7]
+                   + g_aiT16[ 9*16+7]*S[ 9] + g_aiT16[11*16+7]*S[11] + g_aiT16[13*16+7]*S[13] + g_aiT16[15*16+7]*S[15];
+
+        Int32 EO0 = g_aiT16[ 2*16+0]*S[ 2] + g_aiT16[ 6*16+0]*S[ 6] + g_aiT16[10*16+0]*S[10] + g_aiT16[14*16+0]*S[14];
+        Int32 EO1 = g_aiT16[ 2*16+1]*S[ 2] + g_aiT16[ 6*16+1]*S[ 6] + g_aiT16[10*16+1]*S[10] + g_aiT16[14*16+1]*S[14];
+        Int32 EO2 = g_aiT16[ 2*16+2]*S[ 2] + g_aiT16[ 6*16+2]*S[ 6] + g_aiT16[10*16+2]*S[10] + g_aiT16[14*16+2]*S[14];
+        Int32 EO3 = g_aiT16[ 2*16+3]*S[ 2] + g_aiT16[ 6*16+3]*S[ 6] + g_aiT16[10*16+3]*S[10] + g_aiT16[14*16+3]*S[14];
+
+        Int32 EEO0 = g_aiT16[4*16+0]*S[ 4] + g_aiT16[12*16+0]*S[12];
+        Int32 EEO1 = g_aiT16[4*16+1]*S[ 4] + g_aiT16[12*16+1]*S[12];
+        Int32 EEE0 = g_aiT16[0*16+0]*S[ 0] + g_aiT16[ 8*16+0]*S[ 8];
+        Int32 EEE1 = g_aiT16[0*16+1]*S[ 0] + g_aiT16[ 8*16+1]*S[ 8];
 
         /* Combining even and odd terms at each hierarchy levels to calculate the final spatial domain vector */
         Int32 EE0 = EEE0 + EEO0;
@@ -459,39 +605,22 @@ void xInvDCT16( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
         Int32 E3 = EE3 + EO3;
         Int32 E4 = EE3 - EO3;
 
-        pDst[i*nStride+ 0] = (E0 + O0 + rnd) >> nShift;
-        pDst[i*nStride+15] = (E0 - O0 + rnd) >> nShift;
-        pDst[i*nStride+ 1] = (E1 + O1 + rnd) >> nShift;
-        pDst[i*nStride+14] = (E1 - O1 + rnd) >> nShift;
-        pDst[i*nStride+ 2] = (E2 + O2 + rnd) >> nShift;
-        pDst[i*nStride+13] = (E2 - O2 + rnd) >> nShift;
-        pDst[i*nStride+ 3] = (E3 + O3 + rnd) >> nShift;
-        pDst[i*nStride+12] = (E3 - O3 + rnd) >> nShift;
-        pDst[i*nStride+ 4] = (E4 + O4 + rnd) >> nShift;
-        pDst[i*nStride+11] = (E4 - O4 + rnd) >> nShift;
-        pDst[i*nStride+ 5] = (E5 + O5 + rnd) >> nShift;
-        pDst[i*nStride+10] = (E5 - O5 + rnd) >> nShift;
-        pDst[i*nStride+ 6] = (E6 + O6 + rnd) >> nShift;
-        pDst[i*nStride+ 9] = (E6 - O6 + rnd) >> nShift;
-        pDst[i*nStride+ 7] = (E7 + O7 + rnd) >> nShift;
-        pDst[i*nStride+ 8] = (E7 - O7 + rnd) >> nShift;
-
-        pDst[i*nStride+ 0] = Clip3( -32768, 32767, pDst[i*nStride+ 0] );
-        pDst[i*nStride+ 1] = Clip3( -32768, 32767, pDst[i*nStride+ 1] );
-        pDst[i*nStride+ 2] = Clip3( -32768, 32767, pDst[i*nStride+ 2] );
-        pDst[i*nStride+ 3] = Clip3( -32768, 32767, pDst[i*nStride+ 3] );
-        pDst[i*nStride+ 4] = Clip3( -32768, 32767, pDst[i*nStride+ 4] );
-        pDst[i*nStride+ 5] = Clip3( -32768, 32767, pDst[i*nStride+ 5] );
-        pDst[i*nStride+ 6] = Clip3( -32768, 32767, pDst[i*nStride+ 6] );
-        pDst[i*nStride+ 7] = Clip3( -32768, 32767, pDst[i*nStride+ 7] );
-        pDst[i*nStride+ 8] = Clip3( -32768, 32767, pDst[i*nStride+ 8] );
-        pDst[i*nStride+ 9] = Clip3( -32768, 32767, pDst[i*nStride+ 9] );
-        pDst[i*nStride+10] = Clip3( -32768, 32767, pDst[i*nStride+10] );
-        pDst[i*nStride+11] = Clip3( -32768, 32767, pDst[i*nStride+11] );
-        pDst[i*nStride+12] = Clip3( -32768, 32767, pDst[i*nStride+12] );
-        pDst[i*nStride+13] = Clip3( -32768, 32767, pDst[i*nStride+13] );
-        pDst[i*nStride+14] = Clip3( -32768, 32767, pDst[i*nStride+14] );
-        pDst[i*nStride+15] = Clip3( -32768, 32767, pDst[i*nStride+15] );
+        pDst[i*nStride+ 0] = Clip3( -32768, 32767, (E0 + O0 + rnd) >> nShift );
+        pDst[i*nStride+15] = Clip3( -32768, 32767, (E0 - O0 + rnd) >> nShift );
+        pDst[i*nStride+ 1] = Clip3( -32768, 32767, (E1 + O1 + rnd) >> nShift );
+        pDst[i*nStride+14] = Clip3( -32768, 32767, (E1 - O1 + rnd) >> nShift );
+        pDst[i*nStride+ 2] = Clip3( -32768, 32767, (E2 + O2 + rnd) >> nShift );
+        pDst[i*nStride+13] = Clip3( -32768, 32767, (E2 - O2 + rnd) >> nShift );
+        pDst[i*nStride+ 3] = Clip3( -32768, 32767, (E3 + O3 + rnd) >> nShift );
+        pDst[i*nStride+12] = Clip3( -32768, 32767, (E3 - O3 + rnd) >> nShift );
+        pDst[i*nStride+ 4] = Clip3( -32768, 32767, (E4 + O4 + rnd) >> nShift );
+        pDst[i*nStride+11] = Clip3( -32768, 32767, (E4 - O4 + rnd) >> nShift );
+        pDst[i*nStride+ 5] = Clip3( -32768, 32767, (E5 + O5 + rnd) >> nShift );
+        pDst[i*nStride+10] = Clip3( -32768, 32767, (E5 - O5 + rnd) >> nShift );
+        pDst[i*nStride+ 6] = Clip3( -32768, 32767, (E6 + O6 + rnd) >> nShift );
+        pDst[i*nStride+ 9] = Clip3( -32768, 32767, (E6 - O6 + rnd) >> nShift );
+        pDst[i*nStride+ 7] = Clip3( -32768, 32767, (E7 + O7 + rnd) >> nShift );
+        pDst[i*nStride+ 8] = Clip3( -32768, 32767, (E7 - O7 + rnd) >> nShift );
     }
 }
 
@@ -500,44 +629,52 @@ void xInvDCT16( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
  *  \param pDst   output data (transpose transform coefficients)
  *  \param nLines transform lines
  *  \param nShift specifies right shift after 1D transform
+ *  \param nCoeffs number of input rows may be nonzero, the remaining rows are not read
  */
-void xInvDCT32( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
+void xInvDCT32( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift, Int nCoeffs )
 {
-    int i,k;
+    int i,j,k;
     Int32 E[16],O[16];
     Int32 EE[8],EO[8];
     Int32 EEE[4],EEO[4];
     Int32 EEEE[2],EEEO[2];
     int rnd = 1<<(nShift-1);
 
-    for( i=0; i<32; i++ ) {
+    for( i=0; i<nLines; i++ ) {
+        Int32 S[32];
+
+        /* The rows from nCoeffs are all zero, skip them */
+        for( j=0; j<32; j++ ) {
+            S[j] = (j < nCoeffs) ? pSrc[j*nStride+i] : 0;
+        }
+
         /* Utilizing symmetry properties to the maximum to minimize the number of multiplications */
         for( k=0; k<16; k++ ) {
-            O[k] =   g_aiT32[ 1*32+k]*pSrc[ 1*nStride+i] + g_aiT32[ 3*32+k]*pSrc[ 3*nStride+i]
-                   + g_aiT32[ 5*32+k]*pSrc[ 5*nStride+i] + g_aiT32[ 7*32+k]*pSrc[ 7*nStride+i]
-                   + g_aiT32[ 9*32+k]*pSrc[ 9*nStride+i] + g_aiT32[11*32+k]*pSrc[11*nStride+i]
-                   + g_aiT32[13*32+k]*pSrc[13*nStride+i] + g_aiT32[15*32+k]*pSrc[15*nStride+i]
-                   + g_aiT32[17*32+k]*pSrc[17*nStride+i] + g_aiT32[19*32+k]*pSrc[19*nStride+i]
-                   + g_aiT32[21*32+k]*pSrc[21*nStride+i] + g_aiT32[23*32+k]*pSrc[23*nStride+i]
-                   + g_aiT32[25*32+k]*pSrc[25*nStride+i] + g_aiT32[27*32+k]*pSrc[27*nStride+i]
-                   + g_aiT32[29*32+k]*pSrc[29*nStride+i] + g_aiT32[31*32+k]*pSrc[31*nStride+i];
+            O[k] =   g_aiT32[ 1*32+k]*S[ 1] + g_aiT32[ 3*32+k]*S[ 3]
+                   + g_aiT32[ 5*32+k]*S[ 5] + g_aiT32[ 7*32+k]*S[ 7]
+                   + g_aiT32[ 9*32+k]*S[ 9] + g_aiT32[11*32+k]*S[11]
+                   + g_aiT32[13*32+k]*S[13] + g_aiT32[15*32+k]*S[15]
+                   + g_aiT32[17*32+k]*S[17] + g_aiT32[19*32+k]*S[19]
+                   + g_aiT32[21*32+k]*S[21] + g_aiT32[23*32+k]*S[23]
+                   + g_aiT32[25*32+k]*S[25] + g_aiT32[27*32+k]*S[27]
+                   + g_aiT32[29*32+k]*S[29] + g_aiT32[31*32+k]*S[31];
         }
 
         for( k=0; k<8; k++ ) {
-            EO[k] =   g_aiT32[ 2*32+k]*pSrc[ 2*nStride+i] + g_aiT32[ 6*32+k]*pSrc[ 6*nStride+i]
-                    + g_aiT32[10*32+k]*pSrc[10*nStride+i] + g_aiT32[14*32+k]*pSrc[14*nStride+i]
-                    + g_aiT32[18*32+k]*pSrc[18*nStride+i] + g_aiT32[22*32+k]*pSrc[22*nStride+i]
-                    + g_aiT32[26*32+k]*pSrc[26*nStride+i] + g_aiT32[30*32+k]*pSrc[30*nStride+i];
+            EO[k] =   g_aiT32[ 2*32+k]*S[ 2] + g_aiT32[ 6*32+k]*S[ 6]
+                    + g_aiT32[10*32+k]*S[10] + g_aiT32[14*32+k]*S[14]
+                    + g_aiT32[18*32+k]*S[18] + g_aiT32[22*32+k]*S[22]
+                    + g_aiT32[26*32+k]*S[26] + g_aiT32[30*32+k]*S[30];
         }
 
         for( k=0; k<4; k++ ) {
-            EEO[k] =   g_aiT32[ 4*32+k]*pSrc[ 4*nStride+i] + g_aiT32[12*32+k]*pSrc[12*nStride+i]
-                     + g_aiT32[20*32+k]*pSrc[20*nStride+i] + g_aiT32[28*32+k]*pSrc[28*nStride+i];
+            EEO[k] =   g_aiT32[ 4*32+k]*S[ 4] + g_aiT32[12*32+k]*S[12]
+                     + g_aiT32[20*32+k]*S[20] + g_aiT32[28*32+k]*S[28];
         }
-        EEEO[0] = g_aiT32[8*32+0]*pSrc[8*nStride+i] + g_aiT32[24*32+0]*pSrc[24*nStride+i];
-        EEEO[1] = g_aiT32[8*32+1]*pSrc[8*nStride+i] + g_aiT32[24*32+1]*pSrc[24*nStride+i];
-        EEEE[0] = g_aiT32[0*32+0]*pSrc[0*nStride+i] + g_aiT32[16*32+0]*pSrc[16*nStride+i];
-        EEEE[1] = g_aiT32[0*32+1]*pSrc[0*nStride+i] + g_aiT32[16*32+1]*pSrc[16*nStride+i];
+        EEEO[0] = g_aiT32[8*32+0]*S[ 8] + g_aiT32[24*32+0]*S[24];
+        EEEO[1] = g_aiT32[8*32+1]*S[ 8] + g_aiT32[24*32+1]*S[24];
+        EEEE[0] = g_aiT32[0*32+0]*S[ 0] + g_aiT32[16*32+0]*S[16];
+        EEEE[1] = g_aiT32[0*32+1]*S[ 0] + g_aiT32[16*32+1]*S[16];
 
         /* Combining even and odd terms at each hierarchy levels to calculate the final spatial domain vector */
         EEE[0] = EEEE[0] + EEEO[0];
@@ -560,38 +697,62 @@ void xInvDCT32( Int16 *pDst, Int16 *pSrc, UInt nStride, Int nLines, Int nShift )
         }
 
         for( k=0; k<16; k++ ) {
-            pDst[i*nStride+k   ] = (E[k   ] + O[k   ] + rnd) >> nShift;
-            pDst[i*nStride+k+16] = (E[15-k] - O[15-k] + rnd) >> nShift;
-            pDst[i*nStride+k   ] = Clip3( -32768, 32767, pDst[i*nStride+k   ]);
-            pDst[i*nStride+k+16] = Clip3( -32768, 32767, pDst[i*nStride+k+16]);
+            pDst[i*nStride+k   ] = Clip3( -32768, 32767, (E[k   ] + O[k   ] + rnd) >> nShift );
+            pDst[i*nStride+k+16] = Clip3( -32768, 32767, (E[15-k] - O[15-k] + rnd) >> nShift );
         }
     }
 }
 
-xDCT *xDctN[MAX_CU_DEPTH+1] = {
-    xDST4,
-    xDCT4,
-    xDCT8,
-    xDCT16,
-    xDCT32
-};
-
-xDCT *xInvDctN[MAX_CU_DEPTH+1] = {
-    xInvDST4,
-    xInvDCT4,
-    xInvDCT8,
-    xInvDCT16,
-    xInvDCT32
-};
-
 
 // ***************************************************************************
 // * Interface Functions
 // ***************************************************************************
-UInt32 xQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType )
+/// fill the X265_CoeffInfo from the nonzero bitmap of every row (bit x of puiRowSig[y] for coeff (x, y))
+void xCoeffInfoFromRows( X265_CoeffInfo *pInfo, const UInt32 *puiRowSig, UInt nSize )
+{
+    const UInt nNumCG = nSize >> 2;
+    UInt32 uiSigRow = 0;
+    UInt32 uiSigCol = 0;
+    UInt64 uiSigCG  = 0;
+    UInt   nNumSig  = 0;
+    UInt x, y;
+
+    for( y=0; y<nSize; y++ ) {
+        UInt32 v = puiRowSig[y];
+        uiSigRow |= (v != 0) << y;
+        uiSigCol |= v;
+
+        // Bit count
+        v = v - ((v >> 1) & 0x55555555);
+        v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+        nNumSig += (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+    }
+
+    for( y=0; y<nNumCG; y++ ) {
+        const UInt32 uiSig4 = puiRowSig[4*y+0] | puiRowSig[4*y+1] | puiRowSig[4*y+2] | puiRowSig[4*y+3];
+        for( x=0; x<nNumCG; x++ ) {
+            if( (uiSig4 >> (4*x)) & 0xF ) {
+                uiSigCG |= (UInt64)1 << (y * nNumCG + x);
+            }
+        }
+    }
+
+    pInfo->nNumSig  = nNumSig;
+    pInfo->nLastX   = uiSigCol ? xLog2( uiSigCol ) - 1 : 0;
+    pInfo->nLastY   = uiSigRow ? xLog2( uiSigRow ) - 1 : 0;
+    pInfo->uiSigRow = uiSigRow;
+    pInfo->uiSigCol = uiSigCol;
+    pInfo->uiSigCG  = uiSigCG;
+    memcpy( pInfo->auiRowSig, puiRowSig, nSize * sizeof(UInt32) );
+    pInfo->auiRowSig[nSize + 0] = 0;
+    pInfo->auiRowSig[nSize + 1] = 0;
+}
+
+UInt32 xQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType, X265_CoeffInfo *pInfo )
 {
     int x, y;
     UInt32 uiAcSum = 0;
+    UInt32 auiRowSig[MAX_CU_SIZE];
     const UInt nQpDiv6 = nQP / 6;
     const UInt nQpMod6 = nQP % 6;
     UInt uiLog2TrSize = xLog2( iWidth - 1);
@@ -602,6 +763,7 @@ UInt32 xQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int
     Int32 iRnd = (eSType == SLICE_I ? 171 : 85) << (iQBits-9);
 
     for( y=0; y < iHeight; y++ ) {
+        auiRowSig[y] = 0;
         for( x=0; x < iWidth; x++ ) {
             Int iLevel;
             Int  iSign;
@@ -611,11 +773,12 @@ UInt32 xQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int
 
             iLevel = ( abs(iLevel) * uiQ + iRnd ) >> iQBits;
             uiAcSum += iLevel;
+            auiRowSig[y] |= (iLevel != 0) << x;
             iLevel *= iSign;        
-            pDst[nBlockPos] = iLevel;
-            pDst[nBlockPos] = Clip3(-32768, 32767, pDst[nBlockPos]);
+            pDst[nBlockPos] = Clip3(-32768, 32767, iLevel);
         }
     }
+    xCoeffInfoFromRows( pInfo, auiRowSig, iHeight );
     #if (CHECK_TV)
     {
         Int16 *P = (nStride == MAX_CU_SIZE) ? tv_quant : tv_quantC[tv_nIdxC][tv_nModeC];
@@ -665,6 +828,10 @@ void xDeQuant( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int
     #endif
 }
 
+/// xSubDct() and xIDctAdd() are only in the table of CPU_LEVEL_C, so they use the C transforms
+static xDCT  *const s_apfnDct[MAX_CU_DEPTH+1]    = { xDST4,    xDCT4,    xDCT8,    xDCT16,    xDCT32    };
+static xIDCT *const s_apfnInvDct[MAX_CU_DEPTH+1] = { xInvDST4, xInvDCT4, xInvDCT8, xInvDCT16, xInvDCT32 };
+
 void xSubDct(
     Int16 *pDst,
     UInt8 *pSrc,
@@ -703,8 +870,8 @@ void xSubDct(
     }
     #endif
 
-    xDctN[nLog2Width  - 1 - bUseDstHor]( piTmp1, piTmp0, nStride, iHeight, nLog2Width -1 );
-    xDctN[nLog2Height - 1 - bUseDstVer]( pDst,   piTmp1, nStride, iWidth,  nLog2Height+6 );
+    s_apfnDct[nLog2Width  - 1 - bUseDstHor]( piTmp1, piTmp0, nStride, iHeight, nLog2Width -1 );
+    s_apfnDct[nLog2Height - 1 - bUseDstVer]( pDst,   piTmp1, nStride, iWidth,  nLog2Height+6 );
 
     #if (CHECK_TV)
     {
@@ -726,7 +893,8 @@ void xIDctAdd(
     Int16 *pSrc,
     UInt8 *pRef, UInt nStride,
     Int16 *piTmp0, Int16 *piTmp1,
-    Int iWidth, Int iHeight, UInt nMode
+    Int iWidth, Int iHeight, UInt nMode,
+    Int nLastX, Int nLastY
 )
 {
     const Int nLog2Width  = xLog2( iWidth - 1 );
@@ -736,8 +904,10 @@ void xIDctAdd(
     const Int bUseDstVer  = bUseDst && (!nMode || (nMode>=2  && nMode <= 25));
     int i, j;
 
-    xInvDctN[nLog2Width  - 1 - bUseDstHor]( piTmp0, pSrc,   nStride, iHeight, SHIFT_INV_1ST );
-    xInvDctN[nLog2Height - 1 - bUseDstVer]( piTmp1, piTmp0, nStride, iWidth,  SHIFT_INV_2ND );
+    // Coeffs outside of (nLastX, nLastY) are zero, so the 1st pass only need nLastX+1 lines of
+    // nLastY+1 inputs, and the 2nd pass only read the nLastX+1 lines it made
+    s_apfnInvDct[nLog2Width  - 1 - bUseDstHor]( piTmp0, pSrc,   nStride, nLastX+1, SHIFT_INV_1ST, nLastY+1 );
+    s_apfnInvDct[nLog2Height - 1 - bUseDstVer]( piTmp1, piTmp0, nStride, iWidth,   SHIFT_INV_2ND, nLastX+1 );
 
     #if (CHECK_TV)
     {
@@ -0,0 +1,579 @@
+/*****************************************************************************
+ * pixel_x86.cpp: Pixel operator functions for x86 SIMD
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#include "x265.h"
+
+#if ARCH_X86
+#include <immintrin.h>
+
+// ***************************************************************************
+// * SAD Functions
+// ***************************************************************************
+X265_TARGET("sse2")
+UInt32 xSad4xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m128i sum = _mm_setzero_si128();
+    UInt y;
+
+    for( y=0; y+1<N; y+=2 ) {
+        __m128i s0 = _mm_cvtsi32_si128( *(const Int32 *)&pSrc[(y+0) * nStrideSrc] );
+        __m128i s1 = _mm_cvtsi32_si128( *(const Int32 *)&pSrc[(y+1) * nStrideSrc] );
+        __m128i r0 = _mm_cvtsi32_si128( *(const Int32 *)&pRef[(y+0) * nStrideRef] );
+        __m128i r1 = _mm_cvtsi32_si128( *(const Int32 *)&pRef[(y+1) * nStrideRef] );
+        sum = _mm_add_epi32( sum, _mm_sad_epu8( _mm_unpacklo_epi32( s0, s1 ), _mm_unpacklo_epi32( r0, r1 ) ) );
+    }
+    if( y < N ) {
+        __m128i s0 = _mm_cvtsi32_si128( *(const Int32 *)&pSrc[y * nStrideSrc] );
+        __m128i r0 = _mm_cvtsi32_si128( *(const Int32 *)&pRef[y * nStrideRef] );
+        sum = _mm_add_epi32( sum, _mm_sad_epu8( s0, r0 ) );
+    }
+    return _mm_cvtsi128_si32( sum );
+}
+
+X265_TARGET("sse2")
+UInt32 xSad8xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m128i sum = _mm_setzero_si128();
+    UInt y;
+
+    for( y=0; y+1<N; y+=2 ) {
+        __m128i s0 = _mm_loadl_epi64( (const __m128i *)&pSrc[(y+0) * nStrideSrc] );
+        __m128i s1 = _mm_loadl_epi64( (const __m128i *)&pSrc[(y+1) * nStrideSrc] );
+        __m128i r0 = _mm_loadl_epi64( (const __m128i *)&pRef[(y+0) * nStrideRef] );
+        __m128i r1 = _mm_loadl_epi64( (const __m128i *)&pRef[(y+1) * nStrideRef] );
+        sum = _mm_add_epi32( sum, _mm_sad_epu8( _mm_unpacklo_epi64( s0, s1 ), _mm_unpacklo_epi64( r0, r1 ) ) );
+    }
+    if( y < N ) {
+        __m128i s0 = _mm_loadl_epi64( (const __m128i *)&pSrc[y * nStrideSrc] );
+        __m128i r0 = _mm_loadl_epi64( (const __m128i *)&pRef[y * nStrideRef] );
+        sum = _mm_add_epi32( sum, _mm_sad_epu8( s0, r0 ) );
+    }
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+    return _mm_cvtsi128_si32( sum );
+}
+
+X265_TARGET("sse2")
+UInt32 xSad16xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m128i sum = _mm_setzero_si128();
+    UInt y;
+
+    for( y=0; y<N; y++ ) {
+        __m128i s0 = _mm_loadu_si128( (const __m128i *)&pSrc[y * nStrideSrc] );
+        __m128i r0 = _mm_loadu_si128( (const __m128i *)&pRef[y * nStrideRef] );
+        sum = _mm_add_epi32( sum, _mm_sad_epu8( s0, r0 ) );
+    }
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+    return _mm_cvtsi128_si32( sum );
+}
+
+X265_TARGET("sse2")
+UInt32 xSad32xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m128i sum = _mm_setzero_si128();
+    UInt y;
+
+    for( y=0; y<N; y++ ) {
+        const UInt8 *S = &pSrc[y * nStrideSrc];
+        const UInt8 *R = &pRef[y * nStrideRef];
+        __m128i d0 = _mm_sad_epu8( _mm_loadu_si128( (const __m128i *)(S +  0) ), _mm_loadu_si128( (const __m128i *)(R +  0) ) );
+        __m128i d1 = _mm_sad_epu8( _mm_loadu_si128( (const __m128i *)(S + 16) ), _mm_loadu_si128( (const __m128i *)(R + 16) ) );
+        sum = _mm_add_epi32( sum, _mm_add_epi32( d0, d1 ) );
+    }
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+    return _mm_cvtsi128_si32( sum );
+}
+
+X265_TARGET("sse2")
+UInt32 xSad64xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m128i sum = _mm_setzero_si128();
+    UInt y;
+
+    for( y=0; y<N; y++ ) {
+        const UInt8 *S = &pSrc[y * nStrideSrc];
+        const UInt8 *R = &pRef[y * nStrideRef];
+        __m128i d0 = _mm_sad_epu8( _mm_loadu_si128( (const __m128i *)(S +  0) ), _mm_loadu_si128( (const __m128i *)(R +  0) ) );
+        __m128i d1 = _mm_sad_epu8( _mm_loadu_si128( (const __m128i *)(S + 16) ), _mm_loadu_si128( (const __m128i *)(R + 16) ) );
+        __m128i d2 = _mm_sad_epu8( _mm_loadu_si128( (const __m128i *)(S + 32) ), _mm_loadu_si128( (const __m128i *)(R + 32) ) );
+        __m128i d3 = _mm_sad_epu8( _mm_loadu_si128( (const __m128i *)(S + 48) ), _mm_loadu_si128( (const __m128i *)(R + 48) ) );
+        sum = _mm_add_epi32( sum, _mm_add_epi32( _mm_add_epi32( d0, d1 ), _mm_add_epi32( d2, d3 ) ) );
+    }
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+    return _mm_cvtsi128_si32( sum );
+}
+
+X265_TARGET("avx2")
+static UInt32 xHAddSad_avx2( __m256i sum )
+{
+    __m128i tmp = _mm_add_epi32( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) );
+    tmp = _mm_add_epi32( tmp, _mm_srli_si128( tmp, 8 ) );
+    return _mm_cvtsi128_si32( tmp );
+}
+
+X265_TARGET("avx2")
+UInt32 xSad16xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m256i sum = _mm256_setzero_si256();
+    UInt y;
+
+    // Two rows per register
+    for( y=0; y+1<N; y+=2 ) {
+        __m256i s0 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)&pSrc[(y+0) * nStrideSrc] ) ),
+                                              _mm_loadu_si128( (const __m128i *)&pSrc[(y+1) * nStrideSrc] ), 1 );
+        __m256i r0 = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)&pRef[(y+0) * nStrideRef] ) ),
+                                              _mm_loadu_si128( (const __m128i *)&pRef[(y+1) * nStrideRef] ), 1 );
+        sum = _mm256_add_epi32( sum, _mm256_sad_epu8( s0, r0 ) );
+    }
+    UInt32 uiSad = xHAddSad_avx2( sum );
+    if( y < N ) {
+        __m128i d0 = _mm_sad_epu8( _mm_loadu_si128( (const __m128i *)&pSrc[y * nStrideSrc] ),
+                                   _mm_loadu_si128( (const __m128i *)&pRef[y * nStrideRef] ) );
+        d0 = _mm_add_epi32( d0, _mm_srli_si128( d0, 8 ) );
+        uiSad += _mm_cvtsi128_si32( d0 );
+    }
+    return uiSad;
+}
+
+X265_TARGET("avx2")
+UInt32 xSad32xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m256i sum = _mm256_setzero_si256();
+    UInt y;
+
+    for( y=0; y<N; y++ ) {
+        __m256i s0 = _mm256_loadu_si256( (const __m256i *)&pSrc[y * nStrideSrc] );
+        __m256i r0 = _mm256_loadu_si256( (const __m256i *)&pRef[y * nStrideRef] );
+        sum = _mm256_add_epi32( sum, _mm256_sad_epu8( s0, r0 ) );
+    }
+    return xHAddSad_avx2( sum );
+}
+
+X265_TARGET("avx2")
+UInt32 xSad64xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m256i sum = _mm256_setzero_si256();
+    UInt y;
+
+    for( y=0; y<N; y++ ) {
+        const UInt8 *S = &pSrc[y * nStrideSrc];
+        const UInt8 *R = &pRef[y * nStrideRef];
+        __m256i d0 = _mm256_sad_epu8( _mm256_loadu_si256( (const __m256i *)(S +  0) ), _mm256_loadu_si256( (const __m256i *)(R +  0) ) );
+        __m256i d1 = _mm256_sad_epu8( _mm256_loadu_si256( (const __m256i *)(S + 32) ), _mm256_loadu_si256( (const __m256i *)(R + 32) ) );
+        sum = _mm256_add_epi32( sum, _mm256_add_epi32( d0, d1 ) );
+    }
+    return xHAddSad_avx2( sum );
+}
+
+// ***************************************************************************
+// * SATD Functions
+// ***************************************************************************
+X265_TARGET("sse2")
+static ALWAYS_INLINE __m128i xAbs16_sse2( __m128i x )
+{
+    return _mm_max_epi16( x, _mm_sub_epi16( _mm_setzero_si128(), x ) );
+}
+
+X265_TARGET("sse2")
+static ALWAYS_INLINE UInt32 xHAdd32_sse2( __m128i x )
+{
+    x = _mm_add_epi32( x, _mm_srli_si128( x, 8 ) );
+    x = _mm_add_epi32( x, _mm_srli_si128( x, 4 ) );
+    return _mm_cvtsi128_si32( x );
+}
+
+/// one butterfly stage between the register pairs (i, i+k)
+#define HADAMARD_STAGE( R, k, ADD, SUB ) \
+    for( i=0; i<8; i++ ) { \
+        if( !(i & (k)) ) { \
+            T = R[i]; \
+            R[i    ] = ADD( T, R[i+(k)] ); \
+            R[i+(k)] = SUB( T, R[i+(k)] ); \
+        } \
+    }
+
+X265_TARGET("sse2")
+static UInt32 xSatd8x8_sse2( const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i D[8], A[8], T;
+    Int i;
+
+    for( i=0; i<8; i++ ) {
+        D[i] = _mm_sub_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)&pSrc[i * nStrideSrc] ), zero ),
+                              _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)&pRef[i * nStrideRef] ), zero ) );
+    }
+
+    // Vertical
+    HADAMARD_STAGE( D, 1, _mm_add_epi16, _mm_sub_epi16 );
+    HADAMARD_STAGE( D, 2, _mm_add_epi16, _mm_sub_epi16 );
+    HADAMARD_STAGE( D, 4, _mm_add_epi16, _mm_sub_epi16 );
+
+    // Transpose
+    for( i=0; i<4; i++ ) {
+        A[2*i+0] = _mm_unpacklo_epi16( D[2*i], D[2*i+1] );
+        A[2*i+1] = _mm_unpackhi_epi16( D[2*i], D[2*i+1] );
+    }
+    D[0] = _mm_unpacklo_epi32( A[0], A[2] );
+    D[1] = _mm_unpackhi_epi32( A[0], A[2] );
+    D[2] = _mm_unpacklo_epi32( A[1], A[3] );
+    D[3] = _mm_unpackhi_epi32( A[1], A[3] );
+    D[4] = _mm_unpacklo_epi32( A[4], A[6] );
+    D[5] = _mm_unpackhi_epi32( A[4], A[6] );
+    D[6] = _mm_unpacklo_epi32( A[5], A[7] );
+    D[7] = _mm_unpackhi_epi32( A[5], A[7] );
+    A[0] = _mm_unpacklo_epi64( D[0], D[4] );
+    A[1] = _mm_unpackhi_epi64( D[0], D[4] );
+    A[2] = _mm_unpacklo_epi64( D[1], D[5] );
+    A[3] = _mm_unpackhi_epi64( D[1], D[5] );
+    A[4] = _mm_unpacklo_epi64( D[2], D[6] );
+    A[5] = _mm_unpackhi_epi64( D[2], D[6] );
+    A[6] = _mm_unpacklo_epi64( D[3], D[7] );
+    A[7] = _mm_unpackhi_epi64( D[3], D[7] );
+
+    // Horizontal
+    HADAMARD_STAGE( A, 1, _mm_add_epi16, _mm_sub_epi16 );
+    HADAMARD_STAGE( A, 2, _mm_add_epi16, _mm_sub_epi16 );
+    HADAMARD_STAGE( A, 4, _mm_add_epi16, _mm_sub_epi16 );
+
+    // The max is 8*8*255, the sum of two can't overflow
+    T = _mm_setzero_si128();
+    for( i=0; i<8; i+=2 ) {
+        T = _mm_add_epi32( T, _mm_madd_epi16( _mm_add_epi16( xAbs16_sse2( A[i] ), xAbs16_sse2( A[i+1] ) ), _mm_set1_epi16( 1 ) ) );
+    }
+    return (xHAdd32_sse2( T ) + 2) >> 2;
+}
+
+X265_TARGET("sse2")
+UInt32 xSatd4xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    const __m128i zero = _mm_setzero_si128();
+    UInt32 uiSatd = 0;
+    UInt y;
+
+    for( y=0; y<N; y+=4 ) {
+        __m128i D[4], S, T, U, V;
+        Int i;
+        for( i=0; i<4; i++ ) {
+            D[i] = _mm_sub_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( *(const Int32 *)&pSrc[(y+i) * nStrideSrc] ), zero ),
+                                  _mm_unpacklo_epi8( _mm_cvtsi32_si128( *(const Int32 *)&pRef[(y+i) * nStrideRef] ), zero ) );
+        }
+        // Vertical
+        S = _mm_add_epi16( D[0], D[1] );
+        T = _mm_sub_epi16( D[0], D[1] );
+        U = _mm_add_epi16( D[2], D[3] );
+        V = _mm_sub_epi16( D[2], D[3] );
+        D[0] = _mm_add_epi16( S, U );
+        D[1] = _mm_add_epi16( T, V );
+        D[2] = _mm_sub_epi16( S, U );
+        D[3] = _mm_sub_epi16( T, V );
+
+        // Transpose, two columns per register
+        S = _mm_unpacklo_epi16( D[0], D[1] );
+        T = _mm_unpacklo_epi16( D[2], D[3] );
+        U = _mm_unpacklo_epi32( S, T );     // column 0 | column 1
+        V = _mm_unpackhi_epi32( S, T );     // column 2 | column 3
+
+        // Horizontal, (0, 2) and (1, 3) first
+        S = _mm_add_epi16( U, V );
+        T = _mm_sub_epi16( U, V );
+        U = _mm_unpacklo_epi64( S, T );
+        V = _mm_unpackhi_epi64( S, T );
+        S = _mm_add_epi16( xAbs16_sse2( _mm_add_epi16( U, V ) ), xAbs16_sse2( _mm_sub_epi16( U, V ) ) );
+
+        uiSatd += (xHAdd32_sse2( _mm_madd_epi16( S, _mm_set1_epi16( 1 ) ) ) + 1) >> 1;
+    }
+    return uiSatd;
+}
+
+X265_TARGET("sse2")
+static UInt32 xSatdWxN_sse2( const UInt W, const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    UInt32 uiSatd = 0;
+    UInt x, y;
+
+    for( y=0; y<N; y+=8 ) {
+        for( x=0; x<W; x+=8 ) {
+            uiSatd += xSatd8x8_sse2( &pSrc[y * nStrideSrc + x], nStrideSrc, &pRef[y * nStrideRef + x], nStrideRef );
+        }
+    }
+    return uiSatd;
+}
+
+X265_TARGET("sse2")
+UInt32 xSatd8xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN_sse2( 8, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+X265_TARGET("sse2")
+UInt32 xSatd16xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN_sse2( 16, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+X265_TARGET("sse2")
+UInt32 xSatd32xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN_sse2( 32, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+X265_TARGET("sse2")
+UInt32 xSatd64xN_sse2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN_sse2( 64, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+/// two 8x8 blocks side by side, one per 128 bits lane
+X265_TARGET("avx2")
+static UInt32 xSatd16x8_avx2( const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    __m256i D[8], A[8], T;
+    Int i;
+
+    for( i=0; i<8; i++ ) {
+        D[i] = _mm256_sub_epi16( _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i *)&pSrc[i * nStrideSrc] ) ),
+                                 _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i *)&pRef[i * nStrideRef] ) ) );
+    }
+
+    // Vertical
+    HADAMARD_STAGE( D, 1, _mm256_add_epi16, _mm256_sub_epi16 );
+    HADAMARD_STAGE( D, 2, _mm256_add_epi16, _mm256_sub_epi16 );
+    HADAMARD_STAGE( D, 4, _mm256_add_epi16, _mm256_sub_epi16 );
+
+    // Transpose inside every lane
+    for( i=0; i<4; i++ ) {
+        A[2*i+0] = _mm256_unpacklo_epi16( D[2*i], D[2*i+1] );
+        A[2*i+1] = _mm256_unpackhi_epi16( D[2*i], D[2*i+1] );
+    }
+    D[0] = _mm256_unpacklo_epi32( A[0], A[2] );
+    D[1] = _mm256_unpackhi_epi32( A[0], A[2] );
+    D[2] = _mm256_unpacklo_epi32( A[1], A[3] );
+    D[3] = _mm256_unpackhi_epi32( A[1], A[3] );
+    D[4] = _mm256_unpacklo_epi32( A[4], A[6] );
+    D[5] = _mm256_unpackhi_epi32( A[4], A[6] );
+    D[6] = _mm256_unpacklo_epi32( A[5], A[7] );
+    D[7] = _mm256_unpackhi_epi32( A[5], A[7] );
+    A[0] = _mm256_unpacklo_epi64( D[0], D[4] );
+    A[1] = _mm256_unpackhi_epi64( D[0], D[4] );
+    A[2] = _mm256_unpacklo_epi64( D[1], D[5] );
+    A[3] = _mm256_unpackhi_epi64( D[1], D[5] );
+    A[4] = _mm256_unpacklo_epi64( D[2], D[6] );
+    A[5] = _mm256_unpackhi_epi64( D[2], D[6] );
+    A[6] = _mm256_unpacklo_epi64( D[3], D[7] );
+    A[7] = _mm256_unpackhi_epi64( D[3], D[7] );
+
+    // Horizontal
+    HADAMARD_STAGE( A, 1, _mm256_add_epi16, _mm256_sub_epi16 );
+    HADAMARD_STAGE( A, 2, _mm256_add_epi16, _mm256_sub_epi16 );
+    HADAMARD_STAGE( A, 4, _mm256_add_epi16, _mm256_sub_epi16 );
+
+    T = _mm256_setzero_si256();
+    for( i=0; i<8; i+=2 ) {
+        T = _mm256_add_epi32( T, _mm256_madd_epi16( _mm256_add_epi16( _mm256_abs_epi16( A[i] ), _mm256_abs_epi16( A[i+1] ) ), _mm256_set1_epi16( 1 ) ) );
+    }
+
+    // Every 8x8 block is rounded by itself
+    __m128i L = _mm256_castsi256_si128( T );
+    __m128i H = _mm256_extracti128_si256( T, 1 );
+    L = _mm_add_epi32( L, _mm_srli_si128( L, 8 ) );
+    H = _mm_add_epi32( H, _mm_srli_si128( H, 8 ) );
+    L = _mm_add_epi32( L, _mm_srli_si128( L, 4 ) );
+    H = _mm_add_epi32( H, _mm_srli_si128( H, 4 ) );
+    return ((_mm_cvtsi128_si32( L ) + 2) >> 2) + ((_mm_cvtsi128_si32( H ) + 2) >> 2);
+}
+
+X265_TARGET("avx2")
+static UInt32 xSatdWxN_avx2( const UInt W, const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    UInt32 uiSatd = 0;
+    UInt x, y;
+
+    for( y=0; y<N; y+=8 ) {
+        for( x=0; x<W; x+=16 ) {
+            uiSatd += xSatd16x8_avx2( &pSrc[y * nStrideSrc + x], nStrideSrc, &pRef[y * nStrideRef + x], nStrideRef );
+        }
+    }
+    return uiSatd;
+}
+
+X265_TARGET("avx2")
+UInt32 xSatd16xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN_avx2( 16, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+X265_TARGET("avx2")
+UInt32 xSatd32xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN_avx2( 32, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+X265_TARGET("avx2")
+UInt32 xSatd64xN_avx2( const UInt N, const UInt8 *pSrc, const UInt nStrideSrc, const UInt8 *pRef, const UInt nStrideRef )
+{
+    return xSatdWxN_avx2( 64, N, pSrc, nStrideSrc, pRef, nStrideRef );
+}
+
+#undef HADAMARD_STAGE
+
+// ***************************************************************************
+// * Transpose Functions
+// ***************************************************************************
+X265_TARGET("sse2")
+void xTranspose_sse2( UInt8 *pDst, UInt8 *pSrc, UInt nStride, UInt nSize )
+{
+    UInt x, y;
+
+    if( nSize == 4 ) {
+        xTranspose( pDst, pSrc, nStride, nSize );
+        return;
+    }
+
+    // 8x8 tiles, interleave the bytes, words and dwords of the 8 rows
+    for( y=0; y<nSize; y+=8 ) {
+        for( x=0; x<nSize; x+=8 ) {
+            const UInt8 *S = &pSrc[y * nStride + x];
+                  UInt8 *D = &pDst[x * nStride + y];
+            __m128i a0 = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)&S[0*nStride] ), _mm_loadl_epi64( (const __m128i *)&S[1*nStride] ) );
+            __m128i a1 = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)&S[2*nStride] ), _mm_loadl_epi64( (const __m128i *)&S[3*nStride] ) );
+            __m128i a2 = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)&S[4*nStride] ), _mm_loadl_epi64( (const __m128i *)&S[5*nStride] ) );
+            __m128i a3 = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)&S[6*nStride] ), _mm_loadl_epi64( (const __m128i *)&S[7*nStride] ) );
+            __m128i b0 = _mm_unpacklo_epi16( a0, a1 );
+            __m128i b1 = _mm_unpackhi_epi16( a0, a1 );
+            __m128i b2 = _mm_unpacklo_epi16( a2, a3 );
+            __m128i b3 = _mm_unpackhi_epi16( a2, a3 );
+            __m128i c0 = _mm_unpacklo_epi32( b0, b2 );
+            __m128i c1 = _mm_unpackhi_epi32( b0, b2 );
+            __m128i c2 = _mm_unpacklo_epi32( b1, b3 );
+            __m128i c3 = _mm_unpackhi_epi32( b1, b3 );
+            _mm_storel_epi64( (__m128i *)&D[0*nStride], c0 );
+            _mm_storel_epi64( (__m128i *)&D[1*nStride], _mm_unpackhi_epi64( c0, c0 ) );
+            _mm_storel_epi64( (__m128i *)&D[2*nStride], c1 );
+            _mm_storel_epi64( (__m128i *)&D[3*nStride], _mm_unpackhi_epi64( c1, c1 ) );
+            _mm_storel_epi64( (__m128i *)&D[4*nStride], c2 );
+            _mm_storel_epi64( (__m128i *)&D[5*nStride], _mm_unpackhi_epi64( c2, c2 ) );
+            _mm_storel_epi64( (__m128i *)&D[6*nStride], c3 );
+            _mm_storel_epi64( (__m128i *)&D[7*nStride], _mm_unpackhi_epi64( c3, c3 ) );
+        }
+    }
+}
+
+// ***************************************************************************
+// * Quant Functions
+// ***************************************************************************
+X265_TARGET("sse2")
+UInt32 xQuant_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType, X265_CoeffInfo *pInfo )
+{
+    const UInt nQpDiv6 = nQP / 6;
+    const UInt nQpMod6 = nQP % 6;
+    const UInt uiLog2TrSize = xLog2( iWidth - 1 );
+    const UInt iTransformShift = MAX_TR_DYNAMIC_RANGE - 8 - uiLog2TrSize;
+    const Int iQBits = QUANT_SHIFT + nQpDiv6 + iTransformShift;
+    const Int32 iRnd = (eSType == SLICE_I ? 171 : 85) << (iQBits-9);
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i vQ    = _mm_set1_epi16( g_quantScales[nQpMod6] );
+    const __m128i vRnd  = _mm_set1_epi32( iRnd );
+    const __m128i vBits = _mm_cvtsi32_si128( iQBits );
+    UInt32 auiRowSig[MAX_CU_SIZE];
+    __m128i sum = _mm_setzero_si128();
+    Int x, y;
+
+    for( y=0; y<iHeight; y++ ) {
+        UInt32 uiRowSig = 0;
+        for( x=0; x<iWidth; x+=8 ) {
+            const UInt nBlockPos = y * nStride + x;
+            __m128i T = (iWidth == 4) ? _mm_loadl_epi64( (const __m128i *)&pSrc[nBlockPos] )
+                                      : _mm_loadu_si128( (const __m128i *)&pSrc[nBlockPos] );
+
+            // |Level| as unsigned 16 bits, so -32768 is fine
+            __m128i S16 = _mm_srai_epi16( T, 15 );
+            __m128i A   = _mm_sub_epi16( _mm_xor_si128( T, S16 ), S16 );
+
+            // (|Level| * Q + Rnd) >> QBits, the 32 bits product never overflow
+            __m128i L   = _mm_mullo_epi16( A, vQ );
+            __m128i H   = _mm_mulhi_epu16( A, vQ );
+            __m128i L0  = _mm_srl_epi32( _mm_add_epi32( _mm_unpacklo_epi16( L, H ), vRnd ), vBits );
+            __m128i L1  = _mm_srl_epi32( _mm_add_epi32( _mm_unpackhi_epi16( L, H ), vRnd ), vBits );
+            if( iWidth == 4 )
+                L1 = zero;
+            sum = _mm_add_epi32( sum, _mm_add_epi32( L0, L1 ) );
+
+            // Restore the sign before saturate, same as Clip3 on the signed level
+            __m128i S0  = _mm_unpacklo_epi16( S16, S16 );
+            __m128i S1  = _mm_unpackhi_epi16( S16, S16 );
+            L0 = _mm_sub_epi32( _mm_xor_si128( L0, S0 ), S0 );
+            L1 = _mm_sub_epi32( _mm_xor_si128( L1, S1 ), S1 );
+            __m128i R   = _mm_packs_epi32( L0, L1 );
+
+            if( iWidth == 4 )
+                _mm_storel_epi64( (__m128i *)&pDst[nBlockPos], R );
+            else
+                _mm_storeu_si128( (__m128i *)&pDst[nBlockPos], R );
+
+            __m128i Z   = _mm_cmpeq_epi16( R, zero );
+            uiRowSig |= (~_mm_movemask_epi8( _mm_packs_epi16( Z, Z ) ) & 0xFF) << x;
+        }
+        auiRowSig[y] = (iWidth == 4) ? (uiRowSig & 0xF) : uiRowSig;
+    }
+    xCoeffInfoFromRows( pInfo, auiRowSig, iHeight );
+
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+    sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 4 ) );
+    return _mm_cvtsi128_si32( sum );
+}
+
+X265_TARGET("sse2")
+void xDeQuant_sse2( Int16 *pDst, Int16 *pSrc, UInt nStride, UInt nQP, Int iWidth, Int iHeight, X265_SliceType eSType )
+{
+    const UInt nQpDiv6 = nQP / 6;
+    const UInt nQpMod6 = nQP % 6;
+    const UInt uiLog2TrSize = xLog2( iWidth - 1 );
+    const UInt iTransformShift = MAX_TR_DYNAMIC_RANGE - 8 - uiLog2TrSize;
+    const Int nShift = QUANT_IQUANT_SHIFT - QUANT_SHIFT - iTransformShift;
+    const __m128i vScale = _mm_set1_epi16( g_invQuantScales[nQpMod6] << nQpDiv6 );
+    const __m128i vRnd   = _mm_set1_epi32( 1 << (nShift-1) );
+    const __m128i vShift = _mm_cvtsi32_si128( nShift );
+    Int x, y;
+
+    for( y=0; y<iHeight; y++ ) {
+        for( x=0; x<iWidth; x+=8 ) {
+            const UInt nBlockPos = y * nStride + x;
+            __m128i T = (iWidth == 4) ? _mm_loadl_epi64( (const __m128i *)&pSrc[nBlockPos] )
+                                      : _mm_loadu_si128( (const __m128i *)&pSrc[nBlockPos] );
+            __m128i L  = _mm_mullo_epi16( T, vScale );
+            __m128i H  = _mm_mulhi_epi16( T, vScale );
+            __m128i L0 = _mm_sra_epi32( _mm_add_epi32( _mm_unpacklo_epi16( L, H ), vRnd ), vShift );
+            __m128i L1 = _mm_sra_epi32( _mm_add_epi32( _mm_unpackhi_epi16( L, H ), vRnd ), vShift );
+            __m128i R  = _mm_packs_epi32( L0, L1 );
+
+            if( iWidth == 4 )
+                _mm_storel_epi64( (__m128i *)&pDst[nBlockPos], R );
+            else
+                _mm_storeu_si128( (__m128i *)&pDst[nBlockPos], R );
+        }
+    }
+}
+
+#endif /* ARCH_X86 */
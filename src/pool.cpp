@@ -0,0 +1,322 @@
+/*****************************************************************************
+ * pool.cpp: Work stealing thread pool
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#include "x265.h"
+
+/// the worker running on this thread, NULL outside of the pools
+static X265_TLS X265_PoolWorker *s_pPoolSelf = NULL;
+
+/// jobs of one xPoolRun(), they are taken in the order of nJob
+typedef struct X265_PoolGroup {
+    xPOOLJOB   *pfnJob;
+    void       *pArg;
+    UInt32      nJobs;
+    UInt32      nJobNext;
+    UInt32      nHelpers;       ///< helper tasks submitted and not finished yet
+    X265_Mutex  mutex;
+    X265_Cond   cond;
+} X265_PoolGroup;
+
+// ***************************************************************************
+// * Deque Functions
+// ***************************************************************************
+static UInt xPoolPush( X265_PoolDeque *pDeque, xPOOLTASK *pfnTask, void *pArg )
+{
+    UInt bPushed = FALSE;
+
+    xMutexLock( &pDeque->mutex );
+    if( pDeque->uiBottom - pDeque->uiTop < POOL_DEQUE_SIZE ) {
+        X265_PoolTask *pTask = &pDeque->aTasks[pDeque->uiBottom & (POOL_DEQUE_SIZE - 1)];
+        pTask->pfnTask = pfnTask;
+        pTask->pArg    = pArg;
+        pDeque->uiBottom++;
+        bPushed = TRUE;
+    }
+    xMutexUnlock( &pDeque->mutex );
+    return bPushed;
+}
+
+/// the owner take the newest task, the others the oldest one
+static UInt xPoolPop( X265_PoolDeque *pDeque, X265_PoolTask *pTask, UInt bOwner )
+{
+    UInt bPopped = FALSE;
+
+    xMutexLock( &pDeque->mutex );
+    if( pDeque->uiBottom != pDeque->uiTop ) {
+        if( bOwner ) {
+            pDeque->uiBottom--;
+            *pTask = pDeque->aTasks[pDeque->uiBottom & (POOL_DEQUE_SIZE - 1)];
+        }
+        else {
+            *pTask = pDeque->aTasks[pDeque->uiTop & (POOL_DEQUE_SIZE - 1)];
+            pDeque->uiTop++;
+        }
+        bPopped = TRUE;
+    }
+    xMutexUnlock( &pDeque->mutex );
+    return bPopped;
+}
+
+/// take the own task first and steal from the next workers when there is none
+static UInt xPoolTake( X265_Pool *pPool, UInt nIndex, X265_PoolTask *pTask )
+{
+    UInt i;
+
+    for( i=0; i<pPool->nThreads; i++ ) {
+        const UInt nDeque = (nIndex + i) % pPool->nThreads;
+
+        if( xPoolPop( &pPool->deques[nDeque], pTask, (i == 0) ) ) {
+            // The task taken back by xPoolRun() is not counted anymore
+            if( pTask->pfnTask != NULL ) {
+                xMutexLock( &pPool->mutex );
+                pPool->nQueued--;
+                xMutexUnlock( &pPool->mutex );
+            }
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static UInt xPoolSubmit( X265_Pool *pPool, xPOOLTASK *pfnTask, void *pArg )
+{
+    UInt nDeque;
+
+    xMutexLock( &pPool->mutex );
+    if( s_pPoolSelf != NULL && s_pPoolSelf->pPool == pPool ) {
+        nDeque = s_pPoolSelf->nIndex;
+    }
+    else {
+        nDeque = pPool->nNextDeque++ % pPool->nThreads;
+    }
+    xMutexUnlock( &pPool->mutex );
+
+    if( !xPoolPush( &pPool->deques[nDeque], pfnTask, pArg ) )
+        return FALSE;
+
+    xMutexLock( &pPool->mutex );
+    pPool->nQueued++;
+    xCondBroadcast( &pPool->cond );
+    xMutexUnlock( &pPool->mutex );
+    return TRUE;
+}
+
+/// take back the tasks with pArg which are not started yet, return the count of them
+static UInt xPoolRetract( X265_Pool *pPool, void *pArg )
+{
+    UInt nCount = 0;
+    UInt i;
+    UInt32 j;
+
+    for( i=0; i<pPool->nThreads; i++ ) {
+        X265_PoolDeque *pDeque = &pPool->deques[i];
+
+        xMutexLock( &pDeque->mutex );
+        for( j=pDeque->uiTop; j != pDeque->uiBottom; j++ ) {
+            X265_PoolTask *pTask = &pDeque->aTasks[j & (POOL_DEQUE_SIZE - 1)];
+            if( pTask->pfnTask != NULL && pTask->pArg == pArg ) {
+                pTask->pfnTask = NULL;
+                nCount++;
+            }
+        }
+        xMutexUnlock( &pDeque->mutex );
+    }
+
+    if( nCount ) {
+        xMutexLock( &pPool->mutex );
+        pPool->nQueued -= nCount;
+        xMutexUnlock( &pPool->mutex );
+    }
+    return nCount;
+}
+
+// ***************************************************************************
+// * Worker Functions
+// ***************************************************************************
+static void *xPoolWorkerThread( void *pArg )
+{
+    X265_PoolWorker *pWorker = (X265_PoolWorker *)pArg;
+    X265_Pool       *pPool   = pWorker->pPool;
+    X265_PoolTask    task;
+
+    s_pPoolSelf = pWorker;
+    if( pPool->bAffinity ) {
+        xThreadSetAffinity( pWorker->nIndex % xThreadCpuCount() );
+    }
+
+    for( ;; ) {
+        if( xPoolTake( pPool, pWorker->nIndex, &task ) ) {
+            if( task.pfnTask != NULL )
+                task.pfnTask( task.pArg );
+            continue;
+        }
+
+        // Sleep until something is submitted, nQueued is checked under the lock so no wakeup is lost
+        xMutexLock( &pPool->mutex );
+        while( pPool->nQueued == 0 && !pPool->bExit ) {
+            xCondWait( &pPool->cond, &pPool->mutex );
+        }
+        if( pPool->nQueued == 0 && pPool->bExit ) {
+            xMutexUnlock( &pPool->mutex );
+            break;
+        }
+        xMutexUnlock( &pPool->mutex );
+    }
+    return NULL;
+}
+
+/// the helper of a group, the caller of xPoolRun() do the same loop
+static void xPoolGroupLoop( X265_PoolGroup *pGroup )
+{
+    UInt32 nJob;
+
+    for( ;; ) {
+        xMutexLock( &pGroup->mutex );
+        nJob = pGroup->nJobNext;
+        if( nJob < pGroup->nJobs )
+            pGroup->nJobNext++;
+        xMutexUnlock( &pGroup->mutex );
+
+        if( nJob >= pGroup->nJobs )
+            break;
+        pGroup->pfnJob( pGroup->pArg, nJob );
+    }
+}
+
+static void xPoolGroupHelper( void *pArg )
+{
+    X265_PoolGroup *pGroup = (X265_PoolGroup *)pArg;
+
+    xPoolGroupLoop( pGroup );
+
+    xMutexLock( &pGroup->mutex );
+    pGroup->nHelpers--;
+    xCondBroadcast( &pGroup->cond );
+    xMutexUnlock( &pGroup->mutex );
+}
+
+// ***************************************************************************
+// * Interface Functions
+// ***************************************************************************
+/// create a pool of nThreads workers, the callers of xPoolRun() work too so 0 is fine
+X265_Pool *xPoolCreate( UInt nThreads, UInt bAffinity )
+{
+    X265_Pool *pPool = (X265_Pool *)MALLOC( sizeof(X265_Pool) );
+    UInt i;
+
+    assert( pPool != NULL );
+    memset( pPool, 0, sizeof(X265_Pool) );
+    nThreads = MIN( nThreads, MAX_POOL_THREADS );
+
+    pPool->nThreads  = nThreads;
+    pPool->bAffinity = bAffinity;
+    xMutexInit( &pPool->mutex );
+    xCondInit( &pPool->cond );
+    for( i=0; i<MAX_POOL_THREADS; i++ ) {
+        xMutexInit( &pPool->deques[i].mutex );
+    }
+
+    // Fewer workers is fine when a thread can't be created, the others steal from its deque
+    for( i=0; i<nThreads; i++ ) {
+        pPool->workers[i].pPool  = pPool;
+        pPool->workers[i].nIndex = i;
+    }
+    for( i=0; i<nThreads; i++ ) {
+        if( xThreadCreate( &pPool->workers[i].thread, xPoolWorkerThread, &pPool->workers[i] ) != 0 )
+            break;
+        pPool->nStarted++;
+    }
+    return pPool;
+}
+
+void xPoolFree( X265_Pool *pPool )
+{
+    UInt i;
+
+    xMutexLock( &pPool->mutex );
+    pPool->bExit = TRUE;
+    xCondBroadcast( &pPool->cond );
+    xMutexUnlock( &pPool->mutex );
+
+    for( i=0; i<pPool->nStarted; i++ ) {
+        xThreadJoin( pPool->workers[i].thread );
+    }
+    for( i=0; i<MAX_POOL_THREADS; i++ ) {
+        xMutexFree( &pPool->deques[i].mutex );
+    }
+    xCondFree( &pPool->cond );
+    xMutexFree( &pPool->mutex );
+    FREE( pPool );
+}
+
+/// call pfnJob for every nJob of 0 to nJobs-1 on at most nMaxThreads threads, the calling thread is one of them
+/// a job may wait a job before it only, the jobs are taken in order so the one before is always running
+/// without a pool every job run on the calling thread
+void xPoolRun( X265_Pool *pPool, xPOOLJOB *pfnJob, void *pArg, UInt nJobs, UInt nMaxThreads )
+{
+    X265_PoolGroup  group;
+    UInt nHelpers;
+    UInt i;
+
+    if( pPool == NULL ) {
+        for( i=0; i<nJobs; i++ ) {
+            pfnJob( pArg, i );
+        }
+        return;
+    }
+
+    nHelpers = MIN( MIN( nMaxThreads, nJobs ), pPool->nThreads + 1 ) - 1;
+
+    group.pfnJob    = pfnJob;
+    group.pArg      = pArg;
+    group.nJobs     = nJobs;
+    group.nJobNext  = 0;
+    group.nHelpers  = nHelpers;
+    xMutexInit( &group.mutex );
+    xCondInit( &group.cond );
+
+    // Fewer helpers is fine when a deque is full
+    for( i=0; i<nHelpers; i++ ) {
+        if( !xPoolSubmit( pPool, xPoolGroupHelper, &group ) ) {
+            xMutexLock( &group.mutex );
+            group.nHelpers -= nHelpers - i;
+            xMutexUnlock( &group.mutex );
+            break;
+        }
+    }
+
+    xPoolGroupLoop( &group );
+
+    // The helpers not started yet have nothing to do, the group is on the stack so wait the running ones
+    i = xPoolRetract( pPool, &group );
+    xMutexLock( &group.mutex );
+    group.nHelpers -= i;
+    while( group.nHelpers != 0 ) {
+        xCondWait( &group.cond, &group.mutex );
+    }
+    xMutexUnlock( &group.mutex );
+
+    xCondFree( &group.cond );
+    xMutexFree( &group.mutex );
+}
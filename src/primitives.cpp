@@ -0,0 +1,229 @@
+/*****************************************************************************
+ * primitives.cpp: CPU detect and primitive functions dispatch
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+#include "x265.h"
+
+#if ARCH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+/// one table per level, so every encoder of a process may use its own level
+X265_Primitives g_aPrimitives[CPU_LEVEL_AVX2 + 1];
+
+// ***************************************************************************
+// * CPU Detect
+// ***************************************************************************
+#if ARCH_X86
+static void xCpuId( UInt32 uiLeaf, UInt32 auiReg[4] )
+{
+#ifdef _MSC_VER
+    int aiReg[4];
+    __cpuidex( aiReg, uiLeaf, 0 );
+    auiReg[0] = aiReg[0];
+    auiReg[1] = aiReg[1];
+    auiReg[2] = aiReg[2];
+    auiReg[3] = aiReg[3];
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count( uiLeaf, 0, a, b, c, d );
+    auiReg[0] = a;
+    auiReg[1] = b;
+    auiReg[2] = c;
+    auiReg[3] = d;
+#endif
+}
+
+static UInt32 xGetXCR0( void )
+{
+#ifdef _MSC_VER
+    return (UInt32)_xgetbv( 0 );
+#else
+    unsigned int a, d;
+    __asm__ __volatile__( "xgetbv" : "=a"(a), "=d"(d) : "c"(0) );
+    return a;
+#endif
+}
+#endif
+
+/// return the highest eCpuLevel the host supports, every lower level must be present too
+UInt xCpuDetect( void )
+{
+    UInt nLevel = CPU_LEVEL_C;
+#if ARCH_X86
+    UInt32 auiReg[4];
+    UInt32 uiMaxLeaf;
+
+    xCpuId( 0, auiReg );
+    uiMaxLeaf = auiReg[0];
+    if( uiMaxLeaf < 1 )
+        return nLevel;
+
+    xCpuId( 1, auiReg );
+    const UInt32 uiECX = auiReg[2];
+    const UInt32 uiEDX = auiReg[3];
+
+    if( !(uiEDX & (1 << 26)) )
+        return nLevel;
+    nLevel = CPU_LEVEL_SSE2;
+
+    if( !(uiECX & (1 <<  9)) )
+        return nLevel;
+    nLevel = CPU_LEVEL_SSSE3;
+
+    if( !(uiECX & (1 << 19)) )
+        return nLevel;
+    nLevel = CPU_LEVEL_SSE41;
+
+    // The CRC of the digest SEI need PCLMULQDQ at this level
+    if( !(uiECX & (1 << 20)) || !(uiECX & (1 << 1)) )
+        return nLevel;
+    nLevel = CPU_LEVEL_SSE42;
+
+    // AVX2 need the OS save the YMM state (OSXSAVE, AVX and XCR0 bit 1 and 2)
+    if( (uiECX & (1 << 27)) && (uiECX & (1 << 28)) && (xGetXCR0() & 6) == 6 && uiMaxLeaf >= 7 ) {
+        xCpuId( 7, auiReg );
+        if( auiReg[1] & (1 << 5) )
+            nLevel = CPU_LEVEL_AVX2;
+    }
+#endif
+    return nLevel;
+}
+
+// ***************************************************************************
+// * Primitives Init
+// ***************************************************************************
+/// fill the table p with the primitives of nCpuLevel, the host must support it
+void xPrimitivesInit( X265_Primitives *p, UInt nCpuLevel )
+{
+    // Reference C code, always the fallback
+    p->xSadN[0]         = xSad4xN;
+    p->xSadN[1]         = xSad8xN;
+    p->xSadN[2]         = xSad16xN;
+    p->xSadN[3]         = xSad32xN;
+    p->xSadN[4]         = xSad64xN;
+    p->xSatdN[0]        = xSatd4xN;
+    p->xSatdN[1]        = xSatd8xN;
+    p->xSatdN[2]        = xSatd16xN;
+    p->xSatdN[3]        = xSatd32xN;
+    p->xSatdN[4]        = xSatd64xN;
+    p->xTranspose       = xTranspose;
+    p->xDctN[0]         = xDST4;
+    p->xDctN[1]         = xDCT4;
+    p->xDctN[2]         = xDCT8;
+    p->xDctN[3]         = xDCT16;
+    p->xDctN[4]         = xDCT32;
+    p->xInvDctN[0]      = xInvDST4;
+    p->xInvDctN[1]      = xInvDCT4;
+    p->xInvDctN[2]      = xInvDCT8;
+    p->xInvDctN[3]      = xInvDCT16;
+    p->xInvDctN[4]      = xInvDCT32;
+    p->xSubDct          = xSubDct;
+    p->xIDctAdd         = xIDctAdd;
+    p->xQuant           = xQuant;
+    p->xDeQuant         = xDeQuant;
+    p->xPutRBSP         = xPutRBSP;
+    p->xCrc16           = xCrc16;
+    p->xChecksum        = xChecksum;
+    p->xReverseRef      = xReverseRef;
+    p->xFilterRef       = xFilterRef;
+    p->xPredIntraPlanar = xPredIntraPlanar;
+    p->xPredIntraDc     = xPredIntraDc;
+    p->xPredIntraAng    = xPredIntraAng;
+    p->xPredIntraAngSad = xPredIntraAngSad;
+    p->xDownSampleLM    = xDownSampleLM;
+    p->xPredIntraLM     = xPredIntraLM;
+
+#if (CHECK_TV)
+    // The test vector check is done inside the reference code
+    nCpuLevel = CPU_LEVEL_C;
+#endif
+
+    // Optimized code, every level override the entries of the level below
+#if ARCH_X86
+    if( nCpuLevel >= CPU_LEVEL_SSE2 ) {
+        p->xSadN[0]     = xSad4xN_sse2;
+        p->xSadN[1]     = xSad8xN_sse2;
+        p->xSadN[2]     = xSad16xN_sse2;
+        p->xSadN[3]     = xSad32xN_sse2;
+        p->xSadN[4]     = xSad64xN_sse2;
+        p->xSatdN[0]    = xSatd4xN_sse2;
+        p->xSatdN[1]    = xSatd8xN_sse2;
+        p->xSatdN[2]    = xSatd16xN_sse2;
+        p->xSatdN[3]    = xSatd32xN_sse2;
+        p->xSatdN[4]    = xSatd64xN_sse2;
+        p->xTranspose   = xTranspose_sse2;
+        p->xDctN[0]     = xDST4_sse2;
+        p->xDctN[1]     = xDCT4_sse2;
+        p->xDctN[2]     = xDCT8_sse2;
+        p->xDctN[3]     = xDCT16_sse2;
+        p->xDctN[4]     = xDCT32_sse2;
+        p->xInvDctN[0]  = xInvDST4_sse2;
+        p->xInvDctN[1]  = xInvDCT4_sse2;
+        p->xInvDctN[2]  = xInvDCT8_sse2;
+        p->xInvDctN[3]  = xInvDCT16_sse2;
+        p->xInvDctN[4]  = xInvDCT32_sse2;
+        p->xSubDct      = xSubDct_sse2;
+        p->xIDctAdd     = xIDctAdd_sse2;
+        p->xQuant       = xQuant_sse2;
+        p->xDeQuant     = xDeQuant_sse2;
+        p->xPutRBSP         = xPutRBSP_sse2;
+        p->xChecksum        = xChecksum_sse2;
+        p->xReverseRef      = xReverseRef_sse2;
+        p->xFilterRef       = xFilterRef_sse2;
+        p->xPredIntraPlanar = xPredIntraPlanar_sse2;
+        p->xPredIntraDc     = xPredIntraDc_sse2;
+        p->xDownSampleLM    = xDownSampleLM_sse2;
+        p->xPredIntraLM     = xPredIntraLM_sse2;
+    }
+    if( nCpuLevel >= CPU_LEVEL_SSSE3 ) {
+        p->xPredIntraAng    = xPredIntraAng_ssse3;
+        p->xPredIntraAngSad = xPredIntraAngSad_ssse3;
+    }
+    if( nCpuLevel >= CPU_LEVEL_SSE42 ) {
+        p->xCrc16           = xCrc16_sse42;
+    }
+    if( nCpuLevel >= CPU_LEVEL_AVX2 ) {
+        p->xSadN[2]     = xSad16xN_avx2;
+        p->xSadN[3]     = xSad32xN_avx2;
+        p->xSadN[4]     = xSad64xN_avx2;
+        p->xSatdN[2]    = xSatd16xN_avx2;
+        p->xSatdN[3]    = xSatd32xN_avx2;
+        p->xSatdN[4]    = xSatd64xN_avx2;
+        p->xDctN[2]     = xDCT8_avx2;
+        p->xDctN[3]     = xDCT16_avx2;
+        p->xDctN[4]     = xDCT32_avx2;
+        p->xInvDctN[2]  = xInvDCT8_avx2;
+        p->xInvDctN[3]  = xInvDCT16_avx2;
+        p->xInvDctN[4]  = xInvDCT32_avx2;
+        p->xSubDct      = xSubDct_avx2;
+        p->xIDctAdd     = xIDctAdd_avx2;
+        p->xPredIntraAng    = xPredIntraAng_avx2;
+        p->xPredIntraAngSad = xPredIntraAngSad_avx2;
+    }
+#endif
+}
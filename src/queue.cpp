@@ -0,0 +1,128 @@
+/*****************************************************************************
+ * queue.cpp: Lock-free frame queue
+ *****************************************************************************
+ * Copyright (C) 2011-2012 x265 project
+ *
+ * Authors: Min Chen <chenm003@163.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at chenm003@163.com.
+ *****************************************************************************/
+
+
+#include "x265.h"
+
+// ***************************************************************************
+// * Internal Functions
+// ***************************************************************************
+static UInt xQueueReady( X265_Queue *pQueue, UInt bSpace )
+{
+    const UInt32 nCount = xAtomicLoad( &pQueue->uiTail ) - xAtomicLoad( &pQueue->uiHead );
+
+    return (bSpace ? nCount < pQueue->nSlots : nCount > 0);
+}
+
+/// wake the other side after uiHead or uiTail is moved
+static void xQueueSignal( X265_Queue *pQueue )
+{
+    // The waiter count nWaiters before it check, so one of us see the other one
+    xAtomicFence();
+    if( xAtomicLoad( &pQueue->nWaiters ) != 0 ) {
+        xMutexLock( &pQueue->mutex );
+        xCondBroadcast( &pQueue->cond );
+        xMutexUnlock( &pQueue->mutex );
+    }
+}
+
+// ***************************************************************************
+// * Interface Functions
+// ***************************************************************************
+void xQueueInit( X265_Queue *pQueue, UInt32 nSlots, UInt32 uiSlotSize )
+{
+    memset( pQueue, 0, sizeof(X265_Queue) );
+    pQueue->nSlots     = nSlots;
+    pQueue->uiSlotSize = uiSlotSize;
+    pQueue->pucData    = (UInt8 *)MALLOC( nSlots * uiSlotSize );
+    pQueue->puiLength  = (UInt32 *)MALLOC( nSlots * sizeof(UInt32) );
+    assert( pQueue->pucData != NULL && pQueue->puiLength != NULL );
+    xMutexInit( &pQueue->mutex );
+    xCondInit( &pQueue->cond );
+}
+
+void xQueueFree( X265_Queue *pQueue )
+{
+    FREE( pQueue->pucData );
+    FREE( pQueue->puiLength );
+    xCondFree( &pQueue->cond );
+    xMutexFree( &pQueue->mutex );
+    memset( pQueue, 0, sizeof(X265_Queue) );
+}
+
+/// slots ready for the consumer
+UInt32 xQueueCount( X265_Queue *pQueue )
+{
+    return xAtomicLoad( &pQueue->uiTail ) - xAtomicLoad( &pQueue->uiHead );
+}
+
+/// wait a free slot for the producer or a filled one for the consumer, return FALSE when *puiAbort is set
+UInt xQueueWait( X265_Queue *pQueue, UInt bSpace, volatile UInt32 *puiAbort )
+{
+    if( xQueueReady( pQueue, bSpace ) )
+        return TRUE;
+
+    xMutexLock( &pQueue->mutex );
+    xAtomicAdd( &pQueue->nWaiters, 1 );
+    xAtomicFence();
+    while( !xQueueReady( pQueue, bSpace ) && !xAtomicLoad( puiAbort ) ) {
+        xCondWait( &pQueue->cond, &pQueue->mutex );
+    }
+    xAtomicAdd( &pQueue->nWaiters, -1 );
+    xMutexUnlock( &pQueue->mutex );
+    return !xAtomicLoad( puiAbort ) || xQueueReady( pQueue, bSpace );
+}
+
+/// wake every waiter to check the abort flag
+void xQueueWake( X265_Queue *pQueue )
+{
+    xMutexLock( &pQueue->mutex );
+    xCondBroadcast( &pQueue->cond );
+    xMutexUnlock( &pQueue->mutex );
+}
+
+/// the slot of uiIndex, uiTail for the producer and uiHead and after for the consumer
+UInt8 *xQueueSlot( X265_Queue *pQueue, UInt32 uiIndex, UInt32 **ppuiLength )
+{
+    const UInt32 nSlot = uiIndex % pQueue->nSlots;
+
+    *ppuiLength = &pQueue->puiLength[nSlot];
+    return pQueue->pucData + nSlot * pQueue->uiSlotSize;
+}
+
+/// publish the slot of uiTail, the data and the length are written before
+void xQueuePush( X265_Queue *pQueue )
+{
+    assert( xQueueReady( pQueue, TRUE ) );
+    xAtomicStore( &pQueue->uiTail, pQueue->uiTail + 1 );
+    xQueueSignal( pQueue );
+}
+
+/// give nCount slots from uiHead back to the producer
+void xQueuePop( X265_Queue *pQueue, UInt32 nCount )
+{
+    assert( xQueueCount( pQueue ) >= nCount );
+    xAtomicStore( &pQueue->uiHead, pQueue->uiHead + nCount );
+    xQueueSignal( pQueue );
+}
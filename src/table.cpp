@@ -68,8 +68,9 @@ const Int16 g_aucInvAngle[NUM_INTRA_MODE-1] = {
 // ***************************************************************************
 // * DCT Coeff Tables. Unused late, for GPU/FPGA only
 // ***************************************************************************
+// Int16, so the SIMD code can load a coeff pair as one pmaddwd operand
 // TBD: 8.5.4.1
-const Int8 g_aiT4[4*4] = {
+const Int16 g_aiT4[4*4] = {
    64, 64, 64, 64,
    83, 36,-36,-83,
    64,-64,-64, 64,
@@ -77,7 +78,7 @@ const Int8 g_aiT4[4*4] = {
 };
 
 // TBD: 8.5.4.2
-const Int8 g_aiT8[8*8] = {
+const Int16 g_aiT8[8*8] = {
    64, 64, 64, 64, 64, 64, 64, 64,
    89, 75, 50, 18,-18,-50,-75,-89,
    83, 36,-36,-83,-83,-36, 36, 83,
@@ -89,7 +90,7 @@ const Int8 g_aiT8[8*8] = {
 };
 
 // TBD: 8.5.4.3
-const Int8 g_aiT16[16*16] = {
+const Int16 g_aiT16[16*16] = {
    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
    90, 87, 80, 70, 57, 43, 25,  9, -9,-25,-43,-57,-70,-80,-87,-90,
    89, 75, 50, 18,-18,-50,-75,-89,-89,-75,-50,-18, 18, 50, 75, 89,
@@ -109,7 +110,7 @@ const Int8 g_aiT16[16*16] = {
 };
 
 // TBD: 8.5.4.4
-const Int8 g_aiT32[32*32] = {
+const Int16 g_aiT32[32*32] = {
    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
    90, 90, 88, 85, 82, 78, 73, 67, 61, 54, 46, 38, 31, 22, 13,  4, -4,-13,-22,-31,-38,-46,-54,-61,-67,-73,-78,-82,-85,-88,-90,-90,
    90, 87, 80, 70, 57, 43, 25,  9, -9,-25,-43,-57,-70,-80,-87,-90,-90,-87,-80,-70,-57,-43,-25, -9,  9, 25, 43, 57, 70, 80, 87, 90,
@@ -145,7 +146,7 @@ const Int8 g_aiT32[32*32] = {
 };
 
 // Mode-Dependent DCT/DST 
-const Int8 g_as_DST_MAT_4 [4*4]= {
+const Int16 g_as_DST_MAT_4[4*4]= {
   29,   55,    74,   84,
   74,   74,    0 ,  -74,
   84,  -29,   -74,   55,
@@ -171,25 +172,24 @@ const UInt8 g_aucChromaScale[52]= {
 };
 
 // Table 9-43 C State transition table 
-const UInt8 g_aucNextStateMPS[128] = {
-    2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17,
-    18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33,
-    34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49,
-    50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 65,
-    66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81,
-    82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95, 96, 97,
-    98, 99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113,
-    114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 124, 125, 126, 127
-};
-const UInt8 g_aucNextStateLPS[128] = {
-    1, 0, 0, 1, 2, 3, 4, 5, 4, 5, 8, 9, 8, 9, 10, 11,
-    12, 13, 14, 15, 16, 17, 18, 19, 18, 19, 22, 23, 22, 23, 24, 25,
-    26, 27, 26, 27, 30, 31, 30, 31, 32, 33, 32, 33, 36, 37, 36, 37,
-    38, 39, 38, 39, 42, 43, 42, 43, 44, 45, 44, 45, 46, 47, 48, 49,
-    48, 49, 50, 51, 52, 53, 52, 53, 54, 55, 54, 55, 56, 57, 58, 59,
-    58, 59, 60, 61, 60, 61, 60, 61, 62, 63, 64, 65, 64, 65, 66, 67,
-    66, 67, 66, 67, 68, 69, 68, 69, 70, 71, 70, 71, 70, 71, 72, 73,
-    72, 73, 72, 73, 74, 75, 74, 75, 74, 75, 76, 77, 76, 77, 126, 127
+/// next state indexed by the state and the coded bin, the MPS and LPS transitions in one lookup
+const UInt8 g_aucNextState[128][2] = {
+    {  2,   1}, {  0,   3}, {  4,   0}, {  1,   5}, {  6,   2}, {  3,   7}, {  8,   4}, {  5,   9},
+    { 10,   4}, {  5,  11}, { 12,   8}, {  9,  13}, { 14,   8}, {  9,  15}, { 16,  10}, { 11,  17},
+    { 18,  12}, { 13,  19}, { 20,  14}, { 15,  21}, { 22,  16}, { 17,  23}, { 24,  18}, { 19,  25},
+    { 26,  18}, { 19,  27}, { 28,  22}, { 23,  29}, { 30,  22}, { 23,  31}, { 32,  24}, { 25,  33},
+    { 34,  26}, { 27,  35}, { 36,  26}, { 27,  37}, { 38,  30}, { 31,  39}, { 40,  30}, { 31,  41},
+    { 42,  32}, { 33,  43}, { 44,  32}, { 33,  45}, { 46,  36}, { 37,  47}, { 48,  36}, { 37,  49},
+    { 50,  38}, { 39,  51}, { 52,  38}, { 39,  53}, { 54,  42}, { 43,  55}, { 56,  42}, { 43,  57},
+    { 58,  44}, { 45,  59}, { 60,  44}, { 45,  61}, { 62,  46}, { 47,  63}, { 64,  48}, { 49,  65},
+    { 66,  48}, { 49,  67}, { 68,  50}, { 51,  69}, { 70,  52}, { 53,  71}, { 72,  52}, { 53,  73},
+    { 74,  54}, { 55,  75}, { 76,  54}, { 55,  77}, { 78,  56}, { 57,  79}, { 80,  58}, { 59,  81},
+    { 82,  58}, { 59,  83}, { 84,  60}, { 61,  85}, { 86,  60}, { 61,  87}, { 88,  60}, { 61,  89},
+    { 90,  62}, { 63,  91}, { 92,  64}, { 65,  93}, { 94,  64}, { 65,  95}, { 96,  66}, { 67,  97},
+    { 98,  66}, { 67,  99}, {100,  66}, { 67, 101}, {102,  68}, { 69, 103}, {104,  68}, { 69, 105},
+    {106,  70}, { 71, 107}, {108,  70}, { 71, 109}, {110,  70}, { 71, 111}, {112,  72}, { 73, 113},
+    {114,  72}, { 73, 115}, {116,  72}, { 73, 117}, {118,  74}, { 75, 119}, {120,  74}, { 75, 121},
+    {122,  74}, { 75, 123}, {124,  76}, { 77, 125}, {124,  76}, { 77, 125}, {126, 126}, {127, 127},
 };
 
 // Table 9-42 C Specification of rangeTabLPS depending on pStateIdx and qCodIRangeIdx
@@ -260,7 +260,8 @@ const UInt8 g_aucLPSTable[64][4] = {
     {   2,   2,   2,   2}
 };
 
-const UInt8 g_aucRenormTable[32] = {
+/// renormalization shift indexed by uiRange >> 3, cover both the LPS range and the MPS range
+const UInt8 g_aucRenormTable[64] = {
     6,  5,  4,  4,
     3,  3,  3,  3,
     2,  2,  2,  2,
@@ -268,7 +269,36 @@ const UInt8 g_aucRenormTable[32] = {
     1,  1,  1,  1,
     1,  1,  1,  1,
     1,  1,  1,  1,
-    1,  1,  1,  1
+    1,  1,  1,  1,
+    0,  0,  0,  0,
+    0,  0,  0,  0,
+    0,  0,  0,  0,
+    0,  0,  0,  0,
+    0,  0,  0,  0,
+    0,  0,  0,  0,
+    0,  0,  0,  0,
+    0,  0,  0,  0
+};
+
+/// estimated bits of a bin in 1/(1 << CABAC_FRAC_BITS) unit, indexed by state ^ binValue,
+/// -log2(p) of the MPS and the LPS with pLPS = 0.5 * alpha^pStateIdx, alpha = (0.01875/0.5)^(1/63)
+const UInt32 g_auiEntropyBits[128] = {
+     32768,  32768,  30426,  35232,  28306,  37696,  26377,  40159,
+     24617,  42623,  23005,  45087,  21523,  47551,  20159,  50015,
+     18899,  52479,  17734,  54942,  16653,  57406,  15650,  59870,
+     14717,  62334,  13849,  64798,  13038,  67262,  12282,  69725,
+     11575,  72189,  10914,  74653,  10294,  77117,   9714,  79581,
+      9169,  82044,   8658,  84508,   8178,  86972,   7727,  89436,
+      7303,  91900,   6903,  94364,   6527,  96827,   6173,  99291,
+      5840, 101755,   5525, 104219,   5228, 106683,   4948, 109147,
+      4684, 111610,   4435, 114074,   4199, 116538,   3977, 119002,
+      3767, 121466,   3568, 123929,   3380, 126393,   3202, 128857,
+      3034, 131321,   2876, 133785,   2725, 136249,   2583, 138712,
+      2448, 141176,   2321, 143640,   2200, 146104,   2086, 148568,
+      1978, 151032,   1875, 153495,   1778, 155959,   1686, 158423,
+      1599, 160887,   1517, 163351,   1439, 165814,   1364, 168278,
+      1294, 170742,   1228, 173206,   1164, 175670,   1105, 178134,
+      1048, 180597,    994, 183061,    943, 185525,    895, 187989,
 };
 
 const UInt16 ausScanIdx2[4][2*2] = {